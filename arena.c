@@ -0,0 +1,193 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Helper functions just used by this C file to clean up our code
+static ArenaBlock *arena_add_block(Arena *arena, size_t min_size);
+static void arena_intern_grow(Arena *arena, size_t new_capacity);
+static size_t arena_hash(const char *string);
+
+/**
+ * Initializes an empty `Arena`.
+ *
+ * @param[out] arena       Pointer to the `Arena` to initialize.
+ * @param[in]  block_size  Bytes reserved per block; larger requests get a block of their own.
+ */
+void arena_init(Arena *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = (block_size > 0) ? block_size : ARENA_BLOCK_SIZE;
+    arena->strings = NULL;
+    arena->string_count = 0;
+    arena->string_capacity = 0;
+}
+
+/**
+ * Frees every block of the `Arena`, which releases everything allocated from it at once.
+ *
+ * Objects holding pthread mutexes must have destroyed them beforehand.
+ *
+ * @param[in,out] arena  Pointer to the `Arena` to clean.
+ */
+void arena_clean(Arena *arena) {
+    ArenaBlock *current = arena->head;
+    ArenaBlock *next;
+
+    while (current != NULL) {
+        next = current->next;
+        free(current);
+        current = next;
+    }
+    free(arena->strings);
+
+    arena->head = NULL;
+    arena->strings = NULL;
+    arena->string_count = 0;
+    arena->string_capacity = 0;
+}
+
+/**
+ * Allocates zeroed memory from the `Arena` by bumping a pointer.
+ *
+ * Consecutive allocations are adjacent in memory, so objects created together stay together in cache.
+ *
+ * @param[in,out] arena      Pointer to the `Arena`.
+ * @param[in]     size       Number of bytes.
+ * @param[in]     alignment  Required alignment, a power of two.
+ * @return                   Pointer to the memory, valid until `arena_clean`.
+ */
+void *arena_alloc(Arena *arena, size_t size, size_t alignment) {
+    ArenaBlock *block = arena->head;
+    size_t offset = 0;
+
+    // Align the address itself, the block data only guarantees max_align_t
+    if (block != NULL) {
+        uintptr_t address = (uintptr_t)(block->data + block->used);
+        offset = block->used + ((alignment - (address & (alignment - 1))) & (alignment - 1));
+    }
+    if (block == NULL || offset + size > block->size) {
+        block = arena_add_block(arena, size + alignment);
+        uintptr_t address = (uintptr_t)block->data;
+        offset = (alignment - (address & (alignment - 1))) & (alignment - 1);
+    }
+
+    char *memory = block->data + offset;
+    block->used = offset + size;
+    memset(memory, 0, size);
+    return memory;
+}
+
+/**
+ * Returns the arena's single copy of a string, copying it in on first use.
+ *
+ * Systems and resources with the same name share one copy.
+ *
+ * @param[in,out] arena   Pointer to the `Arena`.
+ * @param[in]     string  String to intern.
+ * @return                NUL-terminated copy owned by the arena.
+ */
+char *arena_intern(Arena *arena, const char *string) {
+    if (arena->string_count * 2 >= arena->string_capacity) {
+        arena_intern_grow(arena, (arena->string_capacity == 0) ? 64 : arena->string_capacity * 2);
+    }
+
+    size_t mask = arena->string_capacity - 1;
+    size_t index = arena_hash(string) & mask;
+    while (arena->strings[index] != NULL) {
+        if (strcmp(arena->strings[index], string) == 0) {
+            return arena->strings[index];
+        }
+        index = (index + 1) & mask;
+    }
+
+    size_t length = strlen(string) + 1;
+    char *copy = arena_alloc(arena, length, 1);
+    memcpy(copy, string, length);
+    arena->strings[index] = copy;
+    arena->string_count++;
+    return copy;
+}
+
+/**
+ * Sizes the intern table for `count` more strings, so interning them never rehashes.
+ *
+ * @param[in,out] arena  Pointer to the `Arena`.
+ * @param[in]     count  Number of strings about to be interned.
+ */
+void arena_reserve_strings(Arena *arena, size_t count) {
+    size_t capacity = (arena->string_capacity == 0) ? 64 : arena->string_capacity;
+
+    while ((arena->string_count + count) * 2 >= capacity) {
+        capacity *= 2;
+    }
+    if (capacity > arena->string_capacity) {
+        arena_intern_grow(arena, capacity);
+    }
+}
+
+/**
+ * Adds a block able to hold at least `min_size` bytes at the head of the block list.
+ *
+ * @param[in,out] arena     Pointer to the `Arena`.
+ * @param[in]     min_size  Bytes the block must be able to hold.
+ * @return                  The new block.
+ */
+static ArenaBlock *arena_add_block(Arena *arena, size_t min_size) {
+    size_t size = (min_size > arena->block_size) ? min_size : arena->block_size;
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+
+    if (block == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Arena block.\n");
+        exit(EXIT_FAILURE);
+    }
+    block->next = arena->head;
+    block->size = size;
+    block->used = 0;
+    arena->head = block;
+    return block;
+}
+
+/**
+ * Grows the intern table and rehashes every string.
+ *
+ * @param[in,out] arena         Pointer to the `Arena`.
+ * @param[in]     new_capacity  New number of entries, a power of two larger than the current one.
+ */
+static void arena_intern_grow(Arena *arena, size_t new_capacity) {
+    char **new_strings = calloc(new_capacity, sizeof(char *));
+
+    if (new_strings == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Arena string table.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < arena->string_capacity; i++) {
+        if (arena->strings[i] != NULL) {
+            size_t index = arena_hash(arena->strings[i]) & (new_capacity - 1);
+            while (new_strings[index] != NULL) {
+                index = (index + 1) & (new_capacity - 1);
+            }
+            new_strings[index] = arena->strings[i];
+        }
+    }
+
+    free(arena->strings);
+    arena->strings = new_strings;
+    arena->string_capacity = new_capacity;
+}
+
+/**
+ * FNV-1a hash of a string.
+ *
+ * @param[in] string  String to hash.
+ * @return            Hash value.
+ */
+static size_t arena_hash(const char *string) {
+    size_t hash = 14695981039346656037ULL;
+
+    while (*string != '\0') {
+        hash ^= (unsigned char)*string++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
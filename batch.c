@@ -0,0 +1,244 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+// Helper functions just used by this C file to clean up our code
+static void *batch_thread_func(void *arg);
+static void batch_mission(Batch *batch, int index);
+static int batch_compare(const void *a, const void *b);
+static double batch_seconds(void);
+
+/**
+ * Initializes a `Batch` of `missions` runs of a scenario.
+ *
+ * Every mission is an exact copy of the scenario until `spread` is set.
+ *
+ * @param[out] batch     Pointer to the `Batch` to initialize.
+ * @param[in]  scenario  Scenario every mission starts from; must outlive the batch.
+ * @param[in]  missions  Number of missions.
+ */
+void batch_init(Batch *batch, const Scenario *scenario, int missions) {
+    int resource_count = (int)scenario->header->resource_count;
+
+    batch->scenario = scenario;
+    batch->missions = missions;
+    batch->spread = 0.0;
+    batch->seed = 1;
+    batch->control = 0;
+    batch->engine = MANAGER_ENGINE_EVENTS;
+    batch->checkpoint = NULL;
+    atomic_init(&batch->next, 0);
+    batch->results = calloc(missions + 1, sizeof(BatchResult));
+    batch->amounts = calloc((size_t)missions * resource_count + 1, sizeof(int));
+    if (batch->results == NULL || batch->amounts == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Batch.\n");
+        exit(EXIT_FAILURE);
+    }
+    batch->threads = 0;
+    batch->wall = 0.0;
+}
+
+/**
+ * Runs every mission of a `Batch` on `threads` threads.
+ *
+ * Each thread claims the next mission, builds a quiet virtual-time `Manager` for it
+ * from its own varied copy of the scenario, flies it and records the outcome. The
+ * missions touch no common state, so the batch scales with the cores, and mission
+ * `i` has the same outcome whichever thread runs it. With a `checkpoint` every
+ * mission continues from the one shared, read-only image instead of from the start.
+ *
+ * @param[in,out] batch    Pointer to the `Batch`.
+ * @param[in]     threads  Number of threads, at least 1.
+ */
+void batch_run(Batch *batch, int threads) {
+    pthread_t *workers = malloc(sizeof(pthread_t) * (threads + 1));
+    if (workers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Batch threads.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double begin = batch_seconds();
+    atomic_store(&batch->next, 0);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, batch_thread_func, batch) != 0) {
+            fprintf(stderr, "Error: Failed to create a batch thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    batch->wall = batch_seconds() - begin;
+    batch->threads = threads;
+    free(workers);
+}
+
+/**
+ * Prints the aggregated outcomes of a `Batch` that ran.
+ *
+ * Reports the spread of mission lengths and event counts, which critical resource
+ * ended how many missions, and the mean, minimum and maximum final amount of every resource.
+ *
+ * @param[in] batch  Pointer to the `Batch`.
+ */
+void batch_print(const Batch *batch) {
+    const ScenarioHeader *header = batch->scenario->header;
+    int resource_count = (int)header->resource_count;
+    int missions = batch->missions;
+    unsigned long long *lengths = malloc(sizeof(unsigned long long) * (missions + 1));
+    int *endings = calloc(resource_count + 1, sizeof(int)); // Per resource, then one for every other ending
+    unsigned long long events = 0, events_min = 0, events_max = 0;
+    double length_sum = 0.0;
+
+    if (lengths == NULL || endings == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the batch report.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (missions == 0) {
+        log_printf(LOG_LEVEL_INFO, "Batch: no missions.\n");
+        free(lengths);
+        free(endings);
+        return;
+    }
+
+    for (int i = 0; i < missions; i++) {
+        const BatchResult *result = &batch->results[i];
+        lengths[i] = result->length;
+        length_sum += (double)result->length;
+        events += result->events;
+        events_min = (i == 0 || result->events < events_min) ? result->events : events_min;
+        events_max = (result->events > events_max) ? result->events : events_max;
+        endings[(result->depleted >= 0) ? result->depleted : resource_count]++;
+    }
+    qsort(lengths, missions, sizeof(unsigned long long), batch_compare);
+
+    log_printf(LOG_LEVEL_INFO, "Batch: %d missions on %d threads, %.3f s wall clock (%.0f missions/s)\n",
+               missions, batch->threads, batch->wall, (batch->wall > 0.0) ? missions / batch->wall : 0.0);
+    log_printf(LOG_LEVEL_INFO, "Mission length (ms): mean %.1f, min %llu, p50 %llu, p90 %llu, max %llu\n",
+               length_sum / missions, lengths[0], lengths[missions / 2], lengths[(int)(missions * 0.9)],
+               lengths[missions - 1]);
+    log_printf(LOG_LEVEL_INFO, "Events handled: mean %.1f, min %llu, max %llu\n",
+               (double)events / missions, events_min, events_max);
+
+    log_printf(LOG_LEVEL_INFO, "\nEnded by:\n");
+    for (int r = 0; r <= resource_count; r++) {
+        if (endings[r] == 0) {
+            continue;
+        }
+        if (r < resource_count) {
+            log_printf(LOG_LEVEL_INFO, "  %s depleted: %d\n",
+                       batch->scenario->strings + batch->scenario->resources[r].name_offset, endings[r]);
+        } else {
+            log_printf(LOG_LEVEL_INFO, "  all systems blocked: %d\n", endings[r]);
+        }
+    }
+
+    log_printf(LOG_LEVEL_INFO, "\nFinal amounts (mean / min / max):\n");
+    for (int r = 0; r < resource_count; r++) {
+        double sum = 0.0;
+        int minimum = 0, maximum = 0;
+        for (int i = 0; i < missions; i++) {
+            int amount = batch->amounts[(size_t)i * resource_count + r];
+            sum += amount;
+            minimum = (i == 0 || amount < minimum) ? amount : minimum;
+            maximum = (i == 0 || amount > maximum) ? amount : maximum;
+        }
+        log_printf(LOG_LEVEL_INFO, "  %s: %.1f / %d / %d\n",
+                   batch->scenario->strings + batch->scenario->resources[r].name_offset,
+                   sum / missions, minimum, maximum);
+    }
+    log_flush();
+
+    free(lengths);
+    free(endings);
+}
+
+/**
+ * Frees the outcomes of a `Batch`.
+ *
+ * @param[in,out] batch  Pointer to the `Batch` to clean.
+ */
+void batch_clean(Batch *batch) {
+    free(batch->results);
+    free(batch->amounts);
+    batch->results = NULL;
+    batch->amounts = NULL;
+}
+
+/**
+ * Thread function of a batch, runs missions until none is left to claim.
+ *
+ * @param[in] arg  Pointer to the `Batch`.
+ * @return         NULL.
+ */
+static void *batch_thread_func(void *arg) {
+    Batch *batch = (Batch *)arg;
+    int index;
+
+    while ((index = atomic_fetch_add(&batch->next, 1)) < batch->missions) {
+        batch_mission(batch, index);
+    }
+
+    return NULL;
+}
+
+/**
+ * Builds, flies and records one mission of a batch.
+ *
+ * @param[in,out] batch  Pointer to the `Batch`.
+ * @param[in]     index  Number of the mission.
+ */
+static void batch_mission(Batch *batch, int index) {
+    Manager manager;
+    Scenario copy;
+    BatchResult *result = &batch->results[index];
+    int *amounts = &batch->amounts[(size_t)index * batch->scenario->header->resource_count];
+
+    manager_init(&manager);
+    manager_set_virtual_time(&manager, 1);
+    manager.quiet = 1;
+    manager.controller.enabled = batch->control;
+    manager.engine = batch->engine;
+    scenario_jitter(batch->scenario, &copy, batch->spread, batch->seed + (unsigned long long)index);
+    scenario_apply(&copy, &manager);
+    scenario_free(&copy);
+    if (batch->checkpoint != NULL) {
+        manager_restore(&manager, batch->checkpoint);
+    }
+
+    manager_run(&manager);
+
+    result->length = sim_clock_now(&manager.clock);
+    result->events = manager.events_handled;
+    result->depleted = (manager.depleted != NULL) ? manager.depleted->id : -1;
+    for (int i = 0; i < manager.resource_array.size; i++) {
+        amounts[i] = resource_get_amount(manager.resource_array.resources[i]);
+    }
+    manager_clean(&manager);
+}
+
+/**
+ * Orders mission lengths for the percentiles.
+ *
+ * @param[in] a  First length.
+ * @param[in] b  Second length.
+ * @return       Negative, zero or positive like `strcmp`.
+ */
+static int batch_compare(const void *a, const void *b) {
+    unsigned long long left = *(const unsigned long long *)a;
+    unsigned long long right = *(const unsigned long long *)b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Seconds since an arbitrary fixed point.
+ */
+static double batch_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
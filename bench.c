@@ -0,0 +1,917 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_EVENTS_PER_PRODUCER 200000  // Events pushed by each producer thread
+#define BENCH_KEYS 64                     // Distinct resources per producer, limits coalescing
+#define BENCH_UPDATES_PER_THREAD 2000000  // Amount updates made by each thread in the layout benchmark
+#define BENCH_RESOURCE_OPS_PER_THREAD 500000 // Store and consume pairs made by each thread on the shared resource
+#define BENCH_PINGS 200                   // Events timed by the wake latency benchmark
+#define BENCH_TRACE_RECORDS 10000000      // Amount changes recorded by the trace benchmark
+#define BENCH_TRACE_PATH "cuinspace_bench.trace" // Scratch trace file, removed afterwards
+#define BENCH_SCHEDULER_SYSTEMS 64        // Systems handed to the scheduler in the start/stop benchmark
+#define BENCH_SCHEDULER_ROUNDS 20         // Starts and stops timed per measurement
+#define BENCH_TIMERS 200000               // Timers added and expired by the timer wheel benchmark
+#define BENCH_TIMER_SPAN 5000             // Farthest timer in ticks, so most of them cascade down from a coarse level
+#define BENCH_TIMER_STEP 10               // Ticks the wheel is advanced between batches of new timers
+#define BENCH_MISSION_FUEL 200000         // Fuel of the end-to-end mission, one unit per conversion
+#define BENCH_MISSION_CONVERSIONS 100     // Least conversions per generator, larger fleets get more fuel
+#define BENCH_CONTROL_SCENARIO "scenarios/default.txt" // The built-in mission, flown with and without the controller
+#define BENCH_BATCH_MISSIONS 2000        // Varied missions of the built-in scenario per batch measurement
+#define BENCH_REPEAT 3                    // Default runs per measurement, the median is reported
+#define BENCH_MAX_REPEAT 15
+
+// Benchmark functions share one signature so every measurement can be repeated the same way
+typedef double (*BenchFunc)(int threads, int variant);
+
+// Where results go: the console table, and optionally a JSON file
+typedef struct BenchReport {
+    FILE *json;               // NULL without --json
+    int results;              // Results written to `json` so far
+    int repeat;               // Runs per measurement
+} BenchReport;
+
+// Outcome of one flight of the controller benchmark's mission
+typedef struct BenchFlight {
+    double length;            // Virtual milliseconds until the mission ended
+    double distance;          // Distance reached
+    double fuel;              // Fuel spent
+} BenchFlight;
+
+// Arguments of one producer thread in the queue benchmark
+typedef struct QueueProducer {
+    EventQueue *queue;
+    System *system;           // Zeroed, its address is part of the event key
+    Resource *resources;      // BENCH_KEYS resources, likewise only used for their addresses
+    atomic_int *start;
+    pthread_t thread;
+} QueueProducer;
+
+// Arguments of the producer thread in the wake latency benchmark
+typedef struct PingProducer {
+    EventQueue *queue;
+    System *systems;            // BENCH_PINGS zeroed systems, one per ping so the pings never coalesce
+    double pushed[BENCH_PINGS]; // Push time of every ping in seconds, indexed by the ping number sent as the amount
+} PingProducer;
+
+// Field layout of `Resource` before hot and cold data were split, packed back to back in one array
+typedef struct PackedResource {
+    char *name;
+    atomic_int amount;
+    int max_capacity;
+} PackedResource;
+
+// Arguments of one updater thread in the layout benchmark
+typedef struct AmountUpdater {
+    atomic_int *amount;       // The thread's own resource amount, never touched by other threads
+    atomic_int *start;
+    pthread_t thread;
+} AmountUpdater;
+
+// Arguments of one thread in the resource contention benchmark
+typedef struct ResourceUser {
+    Resource *resource;       // Shared by every thread
+    atomic_int *start;
+    pthread_t thread;
+} ResourceUser;
+
+static void bench_section(const char *title, const char *column, const char *variant_column, const char *unit);
+static void bench_run(BenchReport *report, const char *benchmark, BenchFunc run, int threads,
+                      int variant, const char *variant_name, const char *unit);
+static double bench_median(double *values, int count);
+static double bench_queue(int producers, int batched);
+static void *queue_producer_func(void *arg);
+static double bench_layout(int threads, int padded);
+static void *amount_updater_func(void *arg);
+static double bench_resource(int threads, int flags);
+static void *resource_user_func(void *arg);
+static double bench_scheduler(int workers, int unused);
+static double bench_timers(int threads, int unused);
+static double bench_mission(int systems, int engine);
+static double bench_control_length(int systems, int controlled);
+static double bench_control_throughput(int systems, int controlled);
+static double bench_control_efficiency(int systems, int controlled);
+static BenchFlight bench_control_flight(int controlled);
+static double bench_batch(int threads, int unused);
+static double bench_wake(int threads, int blocking);
+static void *ping_producer_func(void *arg);
+static double bench_trace(int threads, int recording);
+static double bench_seconds(void);
+static void usage(const char *program);
+
+/**
+ * Entry point of the benchmark program.
+ *
+ * Measures how fast the manager can drain events pushed by a growing number of
+ * producer threads, popping one event per lock acquisition versus a batch, how
+ * updates to the `amount` of neighbouring resources scale with the resource layout,
+ * how consumes and stores scale on one shared resource, what starting and stopping
+ * the worker threads of `manager_run` costs, what a timer costs on the timer wheel, how many conversions per second a
+ * whole virtual mission runs, how much longer and farther the built-in mission flies
+ * with the throughput controller, how a batch of missions scales with threads, how long an event waits before a sleeping manager
+ * sees it, and what recording a binary trace costs per record.
+ *
+ * Every workload is fixed, each measurement is run `--repeat` times and the median
+ * is reported. With `--json`, the results and the build variant are also written as
+ * one JSON document whose layout stays the same from run to run, so results of
+ * different builds can be compared.
+ *
+ * Usage: cuinspace_bench [--json FILE] [--repeat N]
+ */
+int main(int argc, char *argv[]) {
+    int thread_counts[] = {1, 2, 4, 8};
+    int mission_sizes[] = {8, 64, 20000};
+    size_t counts = sizeof(thread_counts) / sizeof(thread_counts[0]);
+    BenchReport report = {NULL, 0, BENCH_REPEAT};
+    const char *json_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            report.repeat = atoi(argv[++i]);
+            if (report.repeat < 1 || report.repeat > BENCH_MAX_REPEAT) {
+                usage(argv[0]);
+            }
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (json_path != NULL) {
+        report.json = fopen(json_path, "w");
+        if (report.json == NULL) {
+            fprintf(stderr, "Error: Cannot open benchmark output %s.\n", json_path);
+            exit(EXIT_FAILURE);
+        }
+#ifdef EVENT_QUEUE_MPSC
+        const char *event_queue = "mpsc";
+#else
+        const char *event_queue = "mutex";
+#endif
+#ifdef RESOURCE_ATOMIC
+        const char *resource = "atomic";
+#else
+        const char *resource = "mutex";
+#endif
+#ifdef __OPTIMIZE__
+        int optimized = 1;
+#else
+        int optimized = 0;
+#endif
+        fprintf(report.json, "{\"build\":{\"event_queue\":\"%s\",\"resource\":\"%s\",\"optimized\":%s},"
+                "\"cores\":%ld,\"repeat\":%d,\"results\":[",
+                event_queue, resource, optimized ? "true" : "false", sysconf(_SC_NPROCESSORS_ONLN), report.repeat);
+    }
+
+    // Simulation output of the end-to-end runs is not part of the measurement
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0) {
+        fprintf(stderr, "Error: Cannot open /dev/null.\n");
+        exit(EXIT_FAILURE);
+    }
+    log_start(null_fd, LOG_POLICY_BLOCK);
+
+    printf("Median of %d runs per measurement\n", report.repeat);
+    bench_section("EventQueue contention", "producers", "drain", "Mevents/s");
+    for (size_t i = 0; i < counts; i++) {
+        bench_run(&report, "event_queue", bench_queue, thread_counts[i], 0, "single", "Mevents/s");
+        bench_run(&report, "event_queue", bench_queue, thread_counts[i], 1, "batch", "Mevents/s");
+    }
+
+    bench_section("Resource amount updates, one resource per thread", "threads", "layout", "Mupdates/s");
+    for (size_t i = 0; i < counts; i++) {
+        bench_run(&report, "resource_layout", bench_layout, thread_counts[i], 0, "packed", "Mupdates/s");
+        bench_run(&report, "resource_layout", bench_layout, thread_counts[i], 1, "padded", "Mupdates/s");
+    }
+
+    bench_section("Resource store and consume, one resource shared by all threads", "threads", "resource", "Mops/s");
+    for (size_t i = 0; i < counts; i++) {
+#ifdef RESOURCE_ATOMIC
+        bench_run(&report, "resource_contention", bench_resource, thread_counts[i], 0, "atomic", "Mops/s");
+#else
+        bench_run(&report, "resource_contention", bench_resource, thread_counts[i], 0, "mutex", "Mops/s");
+#endif
+        bench_run(&report, "resource_contention", bench_resource, thread_counts[i], RESOURCE_FLAG_SHARDED,
+                  "sharded", "Mops/s");
+    }
+
+    bench_section("Scheduler start and stop, as in manager_run", "workers", "systems", "us");
+    for (size_t i = 0; i < counts; i++) {
+        bench_run(&report, "scheduler_start_stop", bench_scheduler, thread_counts[i], 0, "64", "us");
+    }
+
+    bench_section("Timer wheel, near and far timers mixed", "threads", "span", "ns/timer");
+    bench_run(&report, "timer_wheel", bench_timers, 1, 0, "5000", "ns/timer");
+
+    bench_section("End-to-end virtual mission", "systems", "engine", "Mconv/s");
+    for (size_t i = 0; i < sizeof(mission_sizes) / sizeof(mission_sizes[0]); i++) {
+        bench_run(&report, "mission", bench_mission, mission_sizes[i], MANAGER_ENGINE_EVENTS, "events", "Mconv/s");
+        bench_run(&report, "mission", bench_mission, mission_sizes[i], MANAGER_ENGINE_SOA, "soa", "Mconv/s");
+    }
+
+    bench_section("Built-in mission length, static STANDARD versus the controller", "systems", "speeds", "ms");
+    bench_run(&report, "control_length", bench_control_length, 4, 0, "static", "ms");
+    bench_run(&report, "control_length", bench_control_length, 4, 1, "control", "ms");
+    bench_section("Built-in mission throughput", "systems", "speeds", "distance/s");
+    bench_run(&report, "control_throughput", bench_control_throughput, 4, 0, "static", "distance/s");
+    bench_run(&report, "control_throughput", bench_control_throughput, 4, 1, "control", "distance/s");
+    bench_section("Built-in mission distance per 100 fuel", "systems", "speeds", "distance");
+    bench_run(&report, "control_efficiency", bench_control_efficiency, 4, 0, "static", "distance/100 fuel");
+    bench_run(&report, "control_efficiency", bench_control_efficiency, 4, 1, "control", "distance/100 fuel");
+
+    bench_section("Batch of varied missions, virtual clock", "threads", "missions", "missions/s");
+    for (size_t i = 0; i < counts; i++) {
+        bench_run(&report, "batch", bench_batch, thread_counts[i], 0, "2000", "missions/s");
+    }
+
+    bench_section("Manager wake latency, one event every 1-3 ms", "producers", "wait", "mean us");
+    bench_run(&report, "wake_latency", bench_wake, 1, 0, "poll", "us");
+    bench_run(&report, "wake_latency", bench_wake, 1, 1, "condvar", "us");
+
+    bench_section("Trace recording, virtual clock", "systems", "trace", "ns/record");
+    bench_run(&report, "trace", bench_trace, 1, 0, "off", "ns/record");
+    bench_run(&report, "trace", bench_trace, 1, 1, "file", "ns/record");
+
+    log_stop();
+    close(null_fd);
+    if (report.json != NULL) {
+        fprintf(report.json, "]}\n");
+        if (fclose(report.json) != 0) {
+            fprintf(stderr, "Error: Cannot write benchmark output %s.\n", json_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Prints the title and column headers of a group of measurements.
+ *
+ * @param[in] title           Title of the group.
+ * @param[in] column          Header of the thread count column.
+ * @param[in] variant_column  Header of the variant column.
+ * @param[in] unit            Header of the value column.
+ */
+static void bench_section(const char *title, const char *column, const char *variant_column, const char *unit) {
+    printf("\n%s\n", title);
+    printf("%-10s %-10s %12s\n", column, variant_column, unit);
+    fflush(stdout);
+}
+
+/**
+ * Runs a measurement `repeat` times and reports the median.
+ *
+ * @param[in,out] report        Pointer to the `BenchReport`.
+ * @param[in]     benchmark     Name of the benchmark in the JSON output.
+ * @param[in]     run           The benchmark function.
+ * @param[in]     threads       Thread (or system) count passed to `run`.
+ * @param[in]     variant       Variant passed to `run`.
+ * @param[in]     variant_name  Name of the variant in both outputs.
+ * @param[in]     unit          Unit of the value in the JSON output.
+ */
+static void bench_run(BenchReport *report, const char *benchmark, BenchFunc run, int threads,
+                      int variant, const char *variant_name, const char *unit) {
+    double values[BENCH_MAX_REPEAT];
+
+    for (int i = 0; i < report->repeat; i++) {
+        values[i] = run(threads, variant);
+    }
+    double median = bench_median(values, report->repeat);
+
+    printf("%-10d %-10s %12.2f\n", threads, variant_name, median);
+    fflush(stdout);
+    if (report->json != NULL) {
+        fprintf(report->json, "%s\n{\"benchmark\":\"%s\",\"threads\":%d,\"variant\":\"%s\",\"unit\":\"%s\",\"value\":%.3f}",
+                (report->results > 0) ? "," : "", benchmark, threads, variant_name, unit, median);
+    }
+    report->results++;
+}
+
+/**
+ * Sorts a handful of values and returns their median.
+ *
+ * @param[in,out] values  The values, sorted in place.
+ * @param[in]     count   Number of values, at least 1.
+ * @return                The middle value, or the mean of both middle values.
+ */
+static double bench_median(double *values, int count) {
+    for (int i = 1; i < count; i++) {
+        double value = values[i];
+        int at = i;
+        while (at > 0 && values[at - 1] > value) {
+            values[at] = values[at - 1];
+            at--;
+        }
+        values[at] = value;
+    }
+    return (count % 2 == 1) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/**
+ * Runs one queue benchmark.
+ *
+ * The consumer keeps draining until the counts of the received (possibly
+ * coalesced) events add up to everything the producers pushed.
+ *
+ * @param[in] producers  Number of producer threads.
+ * @param[in] batched    Non-zero to drain with `event_queue_pop_batch`, zero for `event_queue_pop`.
+ * @return               Millions of events drained per second.
+ */
+static double bench_queue(int producers, int batched) {
+    EventQueue queue;
+    Arena arena;
+    QueueProducer *threads = malloc(sizeof(QueueProducer) * producers);
+    System *systems;
+    Resource *resources;
+    Event events[MANAGER_EVENT_BATCH];
+    atomic_int start;
+    long long expected = (long long)producers * BENCH_EVENTS_PER_PRODUCER;
+    long long received = 0;
+
+    if (threads == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the queue benchmark.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    systems = arena_alloc(&arena, sizeof(System) * producers, _Alignof(System));
+    resources = arena_alloc(&arena, sizeof(Resource) * BENCH_KEYS, _Alignof(Resource));
+    event_queue_init(&queue);
+    atomic_init(&start, 0);
+    for (int i = 0; i < producers; i++) {
+        threads[i].queue = &queue;
+        threads[i].system = &systems[i];
+        threads[i].resources = resources;
+        threads[i].start = &start;
+        pthread_create(&threads[i].thread, NULL, queue_producer_func, &threads[i]);
+    }
+
+    double begin = bench_seconds();
+    atomic_store(&start, 1);
+    while (received < expected) {
+        if (batched) {
+            int count = event_queue_pop_batch(&queue, events, MANAGER_EVENT_BATCH);
+            for (int e = 0; e < count; e++) {
+                received += events[e].count;
+            }
+        } else if (event_queue_pop(&queue, &events[0])) {
+            received += events[0].count;
+        }
+    }
+    double elapsed = bench_seconds() - begin;
+
+    for (int i = 0; i < producers; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    event_queue_clean(&queue);
+    free(threads);
+    arena_clean(&arena);
+
+    return expected / elapsed / 1e6;
+}
+
+/**
+ * Thread function of a producer, pushes events cycling through `BENCH_KEYS` keys.
+ *
+ * @param[in] arg  Pointer to the `QueueProducer`.
+ * @return         NULL.
+ */
+static void *queue_producer_func(void *arg) {
+    QueueProducer *producer = (QueueProducer *)arg;
+    Event event;
+
+    while (!atomic_load(producer->start)) {
+        // Spin so every producer starts at the same time
+    }
+
+    for (int i = 0; i < BENCH_EVENTS_PER_PRODUCER; i++) {
+        event_init(&event, producer->system, &producer->resources[i % BENCH_KEYS], STATUS_INSUFFICIENT, PRIORITY_HIGH, i);
+        event_queue_push(producer->queue, &event);
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs one layout benchmark.
+ *
+ * Every thread updates only its own resource, so any slowdown with more threads
+ * comes from resources sharing cache lines (false sharing).
+ *
+ * @param[in] threads  Number of updater threads.
+ * @param[in] padded   Non-zero for `Resource` as laid out now, zero for the packed layout.
+ * @return             Millions of updates per second over all threads.
+ */
+static double bench_layout(int threads, int padded) {
+    Arena arena;
+    AmountUpdater *updaters = malloc(sizeof(AmountUpdater) * threads);
+    atomic_int start;
+
+    if (updaters == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the layout benchmark.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Both layouts come from an arena, back to back like the resources of a simulation
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    Resource *resources = arena_alloc(&arena, sizeof(Resource) * threads, _Alignof(Resource));
+    PackedResource *packed = arena_alloc(&arena, sizeof(PackedResource) * threads, _Alignof(PackedResource));
+
+    atomic_init(&start, 0);
+    for (int i = 0; i < threads; i++) {
+        updaters[i].amount = padded ? &resources[i].amount : &packed[i].amount;
+        atomic_init(updaters[i].amount, 0);
+        updaters[i].start = &start;
+        pthread_create(&updaters[i].thread, NULL, amount_updater_func, &updaters[i]);
+    }
+
+    double begin = bench_seconds();
+    atomic_store(&start, 1);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(updaters[i].thread, NULL);
+    }
+    double elapsed = bench_seconds() - begin;
+
+    free(updaters);
+    arena_clean(&arena);
+
+    return (double)threads * BENCH_UPDATES_PER_THREAD / elapsed / 1e6;
+}
+
+/**
+ * Thread function of an updater, alternately adds to and takes from its resource like a producer and consumer.
+ *
+ * @param[in] arg  Pointer to the `AmountUpdater`.
+ * @return         NULL.
+ */
+static void *amount_updater_func(void *arg) {
+    AmountUpdater *updater = (AmountUpdater *)arg;
+
+    while (!atomic_load(updater->start)) {
+        // Spin so every updater starts at the same time
+    }
+
+    for (int i = 0; i < BENCH_UPDATES_PER_THREAD; i++) {
+        atomic_fetch_add_explicit(updater->amount, (i & 1) ? -1 : 1, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs one resource contention benchmark.
+ *
+ * Every thread stores into and consumes from the same resource, which starts half
+ * full so neither ever fails. This is the worst case for the resource lock, or for
+ * the compare-and-swap loops in the atomic build. A sharded resource keeps every
+ * thread on its own shard once the first stores have spread the free space.
+ *
+ * @param[in] threads  Number of threads.
+ * @param[in] flags    `RESOURCE_FLAG_*` bits of the resource, the lock or the atomics are chosen at compile time.
+ * @return             Millions of stores and consumes per second over all threads.
+ */
+static double bench_resource(int threads, int flags) {
+    Arena arena;
+    Resource *resource;
+    ResourceUser *users = malloc(sizeof(ResourceUser) * threads);
+    atomic_int start;
+
+    if (users == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the resource benchmark.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    resource_create(&resource, &arena, "Shared", threads * 2, threads * 4, flags);
+    atomic_init(&start, 0);
+    for (int i = 0; i < threads; i++) {
+        users[i].resource = resource;
+        users[i].start = &start;
+        pthread_create(&users[i].thread, NULL, resource_user_func, &users[i]);
+    }
+
+    double begin = bench_seconds();
+    atomic_store(&start, 1);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(users[i].thread, NULL);
+    }
+    double elapsed = bench_seconds() - begin;
+
+    resource_destroy(resource);
+    arena_clean(&arena);
+    free(users);
+
+    return 2.0 * threads * BENCH_RESOURCE_OPS_PER_THREAD / elapsed / 1e6;
+}
+
+/**
+ * Thread function of the resource contention benchmark, stores one unit and consumes it again.
+ *
+ * @param[in] arg  Pointer to the `ResourceUser`.
+ * @return         NULL.
+ */
+static void *resource_user_func(void *arg) {
+    ResourceUser *user = (ResourceUser *)arg;
+
+    while (!atomic_load(user->start)) {
+        // Spin so every thread starts at the same time
+    }
+
+    for (int i = 0; i < BENCH_RESOURCE_OPS_PER_THREAD; i++) {
+        resource_store(user->resource, 1);
+        resource_consume(user->resource, 1);
+    }
+
+    return NULL;
+}
+
+/**
+ * Times starting and stopping the scheduler, which is what `manager_run` spends on threads.
+ *
+ * Every system waits on an empty resource, so after its first step it sits on the
+ * resource's wait list and the time is spent creating, waking and joining threads.
+ *
+ * @param[in] workers  Number of worker threads.
+ * @param[in] unused   Unused.
+ * @return             Microseconds per start and stop.
+ */
+static double bench_scheduler(int workers, int unused) {
+    double elapsed = 0.0;
+    atomic_int running;
+
+    (void)unused;
+    atomic_init(&running, 1);
+    for (int round = 0; round < BENCH_SCHEDULER_ROUNDS; round++) {
+        Arena arena;
+        EventQueue queue;
+        SystemArray systems;
+        Scheduler scheduler;
+        Resource *empty;
+
+        // Fresh systems every round, the previous ones are still on the wait list
+        arena_init(&arena, ARENA_BLOCK_SIZE);
+        event_queue_init(&queue);
+        system_array_init(&systems);
+        resource_create(&empty, &arena, "Empty", 0, 1, 0);
+        for (int i = 0; i < BENCH_SCHEDULER_SYSTEMS; i++) {
+            System *system;
+            system_create(&system, &arena, "Waiter", (ResourceAmount){empty, 1}, (ResourceAmount){NULL, 0}, 1, &queue);
+            system_array_add(&systems, system);
+        }
+
+        double begin = bench_seconds();
+        scheduler_start(&scheduler, &systems, workers, &running, 0);
+        scheduler_stop(&scheduler);
+        elapsed += bench_seconds() - begin;
+
+        free(systems.systems);  // A System owns no locks, system_array_clean would only add debug output
+        resource_destroy(empty);
+        event_queue_clean(&queue);
+        arena_clean(&arena);
+    }
+
+    return elapsed / BENCH_SCHEDULER_ROUNDS * 1e6;
+}
+
+/**
+ * Adds and expires timers on a `TimerWheel`, checking that each one fires on time.
+ *
+ * Batches of timers between 1 and `BENCH_TIMER_SPAN` ticks away are added while the
+ * wheel advances `BENCH_TIMER_STEP` ticks at a time, so timers due within a level 0
+ * window always share the wheel with timers that still have to cascade down. A timer
+ * returned by an advance must have expired within the ticks that advance covered.
+ *
+ * @param[in] threads  Unused, the wheel is driven by one thread.
+ * @param[in] unused   Unused.
+ * @return             Nanoseconds per timer added and expired.
+ */
+static double bench_timers(int threads, int unused) {
+    TimerWheel *wheel = malloc(sizeof(TimerWheel));
+    TimerNode *nodes = malloc(sizeof(TimerNode) * BENCH_TIMERS);
+    unsigned long long now = 0;
+    int added = 0, fired = 0;
+
+    (void)threads;
+    (void)unused;
+    if (wheel == NULL || nodes == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the timer wheel benchmark.\n");
+        exit(EXIT_FAILURE);
+    }
+    timer_wheel_init(wheel, 0);
+
+    double begin = bench_seconds();
+    while (fired < BENCH_TIMERS) {
+        for (int i = 0; i < BENCH_TIMER_STEP && added < BENCH_TIMERS; i++, added++) {
+            timer_node_init(&nodes[added], NULL);
+            timer_wheel_add(wheel, &nodes[added], now + 1 + (unsigned long long)added * 7919 % BENCH_TIMER_SPAN);
+        }
+
+        unsigned long long target = now + BENCH_TIMER_STEP;
+        for (TimerNode *node = timer_wheel_advance(wheel, target); node != NULL; node = node->next) {
+            if (node->expiry <= now || node->expiry > target) {
+                fprintf(stderr, "Error: Timer due at tick %llu expired between ticks %llu and %llu.\n",
+                        node->expiry, now, target);
+                exit(EXIT_FAILURE);
+            }
+            fired++;
+        }
+        now = target;
+
+        if (added == BENCH_TIMERS && now > (unsigned long long)BENCH_TIMERS + BENCH_TIMER_SPAN) {
+            fprintf(stderr, "Error: %d timers never expired.\n", BENCH_TIMERS - fired);
+            exit(EXIT_FAILURE);
+        }
+    }
+    double elapsed = bench_seconds() - begin;
+
+    free(nodes);
+    free(wheel);
+
+    return elapsed / BENCH_TIMERS * 1e9;
+}
+
+/**
+ * Runs a whole mission against the virtual clock and times it.
+ *
+ * `systems` generators each turn one unit of Fuel into one unit of Cargo per
+ * millisecond until the Fuel is gone, which stops the mission; there is at least
+ * `BENCH_MISSION_CONVERSIONS` units of it per generator. Everything the manager
+ * does is included: stepping the systems, events, and publishing snapshots.
+ *
+ * @param[in] systems  Number of generator systems.
+ * @param[in] engine   `MANAGER_ENGINE_EVENTS` or `MANAGER_ENGINE_SOA`.
+ * @return             Millions of conversions per wall-clock second.
+ */
+static double bench_mission(int systems, int engine) {
+    Manager manager;
+    Resource *fuel, *cargo;
+    char name[32];
+    int amount = (systems * BENCH_MISSION_CONVERSIONS > BENCH_MISSION_FUEL) ? systems * BENCH_MISSION_CONVERSIONS
+                                                                             : BENCH_MISSION_FUEL;
+
+    manager_init(&manager);
+    manager_set_virtual_time(&manager, 1);
+    manager.engine = engine;
+    resource_create(&fuel, &manager.arena, "Fuel", amount, amount, RESOURCE_FLAG_CRITICAL);
+    resource_create(&cargo, &manager.arena, "Cargo", 0, amount, 0);
+    resource_array_add(&manager.resource_array, fuel);
+    resource_array_add(&manager.resource_array, cargo);
+    for (int i = 0; i < systems; i++) {
+        System *system;
+        snprintf(name, sizeof(name), "Generator %d", i);
+        system_create(&system, &manager.arena, name, (ResourceAmount){fuel, 1}, (ResourceAmount){cargo, 1}, 1, &manager.event_queue);
+        system_array_add(&manager.system_array, system);
+    }
+
+    double begin = bench_seconds();
+    manager_run(&manager);
+    double elapsed = bench_seconds() - begin;
+
+    int conversions = resource_get_amount(cargo);
+    manager_clean(&manager);
+
+    return conversions / elapsed / 1e6;
+}
+
+/**
+ * Length of the built-in mission in virtual time.
+ *
+ * @param[in] systems     Unused, the mission has 4 systems.
+ * @param[in] controlled  Non-zero to fly with the throughput controller.
+ * @return                Milliseconds until the mission ended.
+ */
+static double bench_control_length(int systems, int controlled) {
+    (void)systems;
+    return bench_control_flight(controlled).length;
+}
+
+/**
+ * Distance the built-in mission covers per second of virtual time.
+ *
+ * @param[in] systems     Unused, the mission has 4 systems.
+ * @param[in] controlled  Non-zero to fly with the throughput controller.
+ * @return                Distance per virtual second.
+ */
+static double bench_control_throughput(int systems, int controlled) {
+    (void)systems;
+    BenchFlight flight = bench_control_flight(controlled);
+    return (flight.length > 0) ? flight.distance / flight.length * 1000.0 : 0.0;
+}
+
+/**
+ * Distance the built-in mission gets out of its fuel.
+ *
+ * @param[in] systems     Unused, the mission has 4 systems.
+ * @param[in] controlled  Non-zero to fly with the throughput controller.
+ * @return                Distance per 100 units of fuel spent.
+ */
+static double bench_control_efficiency(int systems, int controlled) {
+    (void)systems;
+    BenchFlight flight = bench_control_flight(controlled);
+    return (flight.fuel > 0) ? flight.distance / flight.fuel * 100.0 : 0.0;
+}
+
+/**
+ * Flies the built-in mission against the virtual clock, with every system at STANDARD or under the controller.
+ *
+ * @param[in] controlled  Non-zero to enable the throughput controller.
+ * @return                Length, distance and fuel spent.
+ */
+static BenchFlight bench_control_flight(int controlled) {
+    Manager manager;
+    Scenario scenario;
+    BenchFlight flight = {0.0, 0.0, 0.0};
+    int fuel_start = 0;
+
+    manager_init(&manager);
+    manager_set_virtual_time(&manager, 1);
+    manager.controller.enabled = controlled;
+    scenario_load(&scenario, BENCH_CONTROL_SCENARIO);
+    scenario_apply(&scenario, &manager);
+    scenario_free(&scenario);
+    for (int i = 0; i < manager.resource_array.size; i++) {
+        if (strcmp(manager.resource_array.resources[i]->name, "Fuel") == 0) {
+            fuel_start = resource_get_amount(manager.resource_array.resources[i]);
+        }
+    }
+
+    manager_run(&manager);
+
+    flight.length = (double)sim_clock_now(&manager.clock);
+    for (int i = 0; i < manager.resource_array.size; i++) {
+        Resource *resource = manager.resource_array.resources[i];
+        if (strcmp(resource->name, "Fuel") == 0) {
+            flight.fuel = fuel_start - resource_get_amount(resource);
+        } else if (strcmp(resource->name, "Distance") == 0) {
+            flight.distance = resource_get_amount(resource);
+        }
+    }
+    manager_clean(&manager);
+
+    return flight;
+}
+
+/**
+ * Flies a batch of missions of the built-in scenario, each varied by up to 20% and under the controller.
+ *
+ * @param[in] threads  Number of batch threads.
+ * @param[in] unused   Unused.
+ * @return             Missions per wall-clock second.
+ */
+static double bench_batch(int threads, int unused) {
+    Scenario scenario;
+    Batch batch;
+
+    (void)unused;
+    scenario_load(&scenario, BENCH_CONTROL_SCENARIO);
+    batch_init(&batch, &scenario, BENCH_BATCH_MISSIONS);
+    batch.spread = 0.2;
+    batch.control = 1;
+    batch_run(&batch, threads);
+    double rate = BENCH_BATCH_MISSIONS / batch.wall;
+    batch_clean(&batch);
+    scenario_free(&scenario);
+
+    return rate;
+}
+
+/**
+ * Runs one wake latency benchmark, timing the delay between a push and the manager popping it.
+ *
+ * @param[in] threads   Unused, there is always one producer.
+ * @param[in] blocking  Non-zero to wait with `event_queue_wait`, zero to poll every `MANAGER_WAIT_TIME` ms.
+ * @return              Mean delay in microseconds.
+ */
+static double bench_wake(int threads, int blocking) {
+    EventQueue queue;
+    Arena arena;
+    PingProducer ping;
+    pthread_t producer;
+    Event event;
+    double total = 0.0;
+    int received = 0;
+
+    (void)threads;
+    event_queue_init(&queue);
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    ping.queue = &queue;
+    ping.systems = arena_alloc(&arena, sizeof(System) * BENCH_PINGS, _Alignof(System));
+    pthread_create(&producer, NULL, ping_producer_func, &ping);
+
+    while (received < BENCH_PINGS) {
+        if (blocking) {
+            event_queue_wait(&queue, 1000);
+        } else {
+            usleep(MANAGER_WAIT_TIME * 1000);
+        }
+        while (event_queue_pop(&queue, &event)) {
+            // The producer sends the ping number as the amount, its push time was recorded before the push
+            total += (bench_seconds() - ping.pushed[event.amount]) * 1e6;
+            received++;
+        }
+    }
+
+    pthread_join(producer, NULL);
+    event_queue_clean(&queue);
+    arena_clean(&arena);
+
+    return total / received;
+}
+
+/**
+ * Thread function of the wake latency producer, pushes `BENCH_PINGS` events at irregular intervals.
+ *
+ * @param[in,out] arg  Pointer to the `PingProducer`, receives the push times.
+ * @return             NULL.
+ */
+static void *ping_producer_func(void *arg) {
+    PingProducer *ping = (PingProducer *)arg;
+    Event event;
+
+    for (int i = 0; i < BENCH_PINGS; i++) {
+        usleep(1000 + (i * 7919) % 2000);
+        event_init(&event, &ping->systems[i], NULL, STATUS_EMPTY, PRIORITY_HIGH, i);
+        ping->pushed[i] = bench_seconds(); // Published to the consumer by the push
+        event_queue_push(ping->queue, &event);
+    }
+
+    return NULL;
+}
+
+/**
+ * Times `trace_amount` calls of one system, with tracing off or into a scratch trace file.
+ *
+ * @param[in] threads    Unused, recording is always done by one system.
+ * @param[in] recording  Non-zero to record into a file, zero to time the check of a disabled trace.
+ * @return               Nanoseconds per record.
+ */
+static double bench_trace(int threads, int recording) {
+    Arena arena;
+    EventQueue queue;
+    SimClock clock;
+    Trace trace;
+    ResourceArray resources;
+    SystemArray systems;
+    Resource *resource;
+    System *system;
+
+    (void)threads;
+    arena_init(&arena, ARENA_BLOCK_SIZE);
+    event_queue_init(&queue);
+    sim_clock_init(&clock, 1);
+    resource_array_init(&resources);
+    system_array_init(&systems);
+    resource_create(&resource, &arena, "Fuel", 0, BENCH_TRACE_RECORDS, 0);
+    resource_array_add(&resources, resource);
+    system_create(&system, &arena, "Tracer", (ResourceAmount){NULL, 0}, (ResourceAmount){resource, 1}, 0, &queue);
+    system_array_add(&systems, system);
+    trace_init(&trace);
+    if (recording) {
+        trace_start(&trace, BENCH_TRACE_PATH, &clock, &resources, &systems);
+    }
+
+    double begin = bench_seconds();
+    for (int i = 0; i < BENCH_TRACE_RECORDS; i++) {
+        if ((i & 1023) == 0) {
+            sim_clock_set(&clock, i >> 10);
+        }
+        trace_amount(system, resource, 1);
+    }
+    double elapsed = bench_seconds() - begin;
+
+    trace_stop(&trace);
+    unlink(BENCH_TRACE_PATH);
+    free(systems.systems);  // A System owns no locks, system_array_clean would only add debug output
+    resource_array_clean(&resources);
+    event_queue_clean(&queue);
+    arena_clean(&arena);
+
+    return elapsed / BENCH_TRACE_RECORDS * 1e9;
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Seconds since an arbitrary fixed point.
+ */
+static double bench_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Prints the command line usage and exits.
+ *
+ * @param[in] program  Name the program was started with.
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--json FILE] [--repeat N]\n", program);
+    exit(EXIT_FAILURE);
+}
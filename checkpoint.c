@@ -0,0 +1,459 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Helper functions just used by this C file to clean up our code
+static size_t checkpoint_align(size_t offset);
+static int checkpoint_table_fits(const CheckpointHeader *header, size_t size, uint64_t offset, size_t count, size_t element_size);
+static void checkpoint_validate(const Checkpoint *checkpoint, const char *path);
+static void checkpoint_mismatch(const char *what, const char *name);
+
+/**
+ * Writes a checkpoint image of a virtual-time run between two ticks.
+ *
+ * The caller has taken every timer off its wheel and every event out of the queue,
+ * and puts them back afterwards; together with the amounts, the statuses and the
+ * wait lists they are the whole state a run continues from. The image is laid out
+ * exactly as `checkpoint_load` maps it, fixed-size tables of plain integers and
+ * indices followed by the names, so restoring needs no parsing and no pointer fixups.
+ *
+ * @param[in] path         Path of the file to create.
+ * @param[in] manager      Pointer to the `Manager` being checkpointed.
+ * @param[in] timers       Timers of the wheel in expiry order, linked by `next`.
+ * @param[in] events       Pending events in the order the manager would handle them.
+ * @param[in] event_count  Number of `events`.
+ */
+void checkpoint_write(const char *path, Manager *manager, TimerNode *timers, const Event *events, int event_count) {
+    ResourceArray *resources = &manager->resource_array;
+    SystemArray *systems = &manager->system_array;
+    CheckpointHeader header;
+    size_t string_size = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.resource_count = (uint32_t)resources->size;
+    header.system_count = (uint32_t)systems->size;
+    header.event_count = (uint32_t)event_count;
+    for (int r = 0; r < resources->size; r++) {
+        Resource *resource = resources->resources[r];
+        string_size += strlen(resource->name) + 1;
+        header.shard_count += (resource->shards != NULL) ? RESOURCE_SHARDS : 0;
+        for (System *system = resource->consumers.head; system != NULL; system = system->wait_next) {
+            header.waiter_count++;
+        }
+        for (System *system = resource->producers.head; system != NULL; system = system->wait_next) {
+            header.waiter_count++;
+        }
+    }
+    for (int s = 0; s < systems->size; s++) {
+        string_size += strlen(systems->systems[s]->name) + 1;
+        header.pending_count += (uint32_t)systems->systems[s]->produced_count;
+    }
+    for (TimerNode *node = timers; node != NULL; node = node->next) {
+        header.timer_count++;
+    }
+    header.string_size = (uint32_t)string_size;
+
+    header.time = sim_clock_now(&manager->clock);
+    header.events_handled = manager->events_handled;
+    for (int s = 0; s < EXPORT_STATUSES; s++) {
+        header.events_by_status[s] = manager->events_by_status[s];
+    }
+    header.controller_next_update = manager->controller.next_update;
+
+    // Every table on an 8-byte boundary, so the mapped image can be read in place
+    size_t size = checkpoint_align(sizeof(CheckpointHeader));
+    header.resource_offset = size;
+    size = checkpoint_align(size + (size_t)header.resource_count * sizeof(CheckpointResource));
+    header.system_offset = size;
+    size = checkpoint_align(size + (size_t)header.system_count * sizeof(CheckpointSystem));
+    header.shard_offset = size;
+    size = checkpoint_align(size + (size_t)header.shard_count * sizeof(CheckpointShard));
+    header.pending_offset = size;
+    size = checkpoint_align(size + (size_t)header.pending_count * sizeof(int32_t));
+    header.timer_offset = size;
+    size = checkpoint_align(size + (size_t)header.timer_count * sizeof(CheckpointTimer));
+    header.waiter_offset = size;
+    size = checkpoint_align(size + (size_t)header.waiter_count * sizeof(CheckpointWaiter));
+    header.event_offset = size;
+    size = checkpoint_align(size + (size_t)header.event_count * sizeof(CheckpointEvent));
+    header.string_offset = size;
+    size += string_size;
+
+    char *base = calloc(size, 1);
+    if (base == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the checkpoint.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(base, &header, sizeof(header));
+
+    CheckpointResource *resource_records = (CheckpointResource *)(base + header.resource_offset);
+    CheckpointShard *shards = (CheckpointShard *)(base + header.shard_offset);
+    CheckpointWaiter *waiters = (CheckpointWaiter *)(base + header.waiter_offset);
+    char *strings = base + header.string_offset;
+    size_t string_used = 0;
+    for (int r = 0; r < resources->size; r++) {
+        Resource *resource = resources->resources[r];
+        CheckpointResource *record = &resource_records[r];
+
+        record->name_offset = (uint32_t)string_used;
+        strcpy(strings + string_used, resource->name);
+        string_used += strlen(resource->name) + 1;
+        record->amount = resource_get_amount(resource);
+        record->max_capacity = resource->max_capacity;
+        record->low_state = atomic_load(&resource->low_state);
+        record->starved = (manager->controller.starved != NULL) ? manager->controller.starved[r] : 0;
+        record->flags = (uint32_t)resource->flags;
+        if (resource->shards != NULL) {
+            for (int i = 0; i < RESOURCE_SHARDS; i++) {
+                shards->units = atomic_load(&resource->shards[i].units);
+                shards->space = atomic_load(&resource->shards[i].space);
+                shards++;
+            }
+        }
+
+        // Consumers first, each list in the order its waiters are woken
+        for (int list = 0; list < 2; list++) {
+            System *head = (list == 0) ? resource->consumers.head : resource->producers.head;
+            for (System *system = head; system != NULL; system = system->wait_next) {
+                waiters->resource = (uint32_t)r;
+                waiters->system = (uint32_t)system->id;
+                waiters->need = system->wait_need;
+                waiters->is_space = list;
+                waiters++;
+            }
+        }
+    }
+
+    CheckpointSystem *system_records = (CheckpointSystem *)(base + header.system_offset);
+    int32_t *pending = (int32_t *)(base + header.pending_offset);
+    for (int s = 0; s < systems->size; s++) {
+        System *system = systems->systems[s];
+        CheckpointSystem *record = &system_records[s];
+
+        record->name_offset = (uint32_t)string_used;
+        strcpy(strings + string_used, system->name);
+        string_used += strlen(system->name) + 1;
+        record->status = system_get_status(system);
+        record->amount_stored = system->amount_stored;
+        record->processing = system->processing;
+        record->output_count = (uint32_t)system->produced_count;
+        record->last_event_time = system->last_event_time;
+        record->last_event_resource = (system->last_event_resource != NULL) ? system->last_event_resource->id : -1;
+        record->last_event_status = system->last_event_status;
+        record->suppressed = system->suppressed;
+        for (int o = 0; o < system->produced_count; o++) {
+            *pending++ = system->pending[o];
+        }
+    }
+
+    CheckpointTimer *timer_records = (CheckpointTimer *)(base + header.timer_offset);
+    for (TimerNode *node = timers; node != NULL; node = node->next) {
+        timer_records->expiry = node->expiry;
+        timer_records->system = (node->owner != NULL) ? (uint32_t)((System *)node->owner)->id : CHECKPOINT_MANAGER_TICK;
+        timer_records++;
+    }
+
+    CheckpointEvent *event_records = (CheckpointEvent *)(base + header.event_offset);
+    for (int e = 0; e < event_count; e++) {
+        event_records[e].system = (uint32_t)events[e].system->id;
+        event_records[e].resource = (uint32_t)events[e].resource->id;
+        event_records[e].status = events[e].status;
+        event_records[e].priority = events[e].priority;
+        event_records[e].amount = events[e].amount;
+        event_records[e].count = events[e].count;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(base, 1, size, file) != size || fclose(file) != 0) {
+        fprintf(stderr, "Error: Cannot write checkpoint %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    free(base);
+}
+
+/**
+ * Maps a checkpoint image and checks that every table, offset and index stays in bounds.
+ *
+ * The mapping is read-only and private: the image is never copied, and every run
+ * restored from it, in this process or in forked ones, shares its pages.
+ *
+ * @param[out] checkpoint  Pointer to the `Checkpoint` to fill.
+ * @param[in]  path        Path of a file written by `checkpoint_write`.
+ */
+void checkpoint_load(Checkpoint *checkpoint, const char *path) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error: Cannot open checkpoint %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t)info.st_size < sizeof(CheckpointHeader)) {
+        fprintf(stderr, "Error: Checkpoint %s is corrupt or from another version.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    void *base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map checkpoint %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    const CheckpointHeader *header = (const CheckpointHeader *)base;
+    checkpoint->base = base;
+    checkpoint->size = (size_t)info.st_size;
+    checkpoint->header = header;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 || header->version != CHECKPOINT_VERSION ||
+        !checkpoint_table_fits(header, checkpoint->size, header->resource_offset, header->resource_count, sizeof(CheckpointResource)) ||
+        !checkpoint_table_fits(header, checkpoint->size, header->system_offset, header->system_count, sizeof(CheckpointSystem)) ||
+        !checkpoint_table_fits(header, checkpoint->size, header->shard_offset, header->shard_count, sizeof(CheckpointShard)) ||
+        !checkpoint_table_fits(header, checkpoint->size, header->pending_offset, header->pending_count, sizeof(int32_t)) ||
+        !checkpoint_table_fits(header, checkpoint->size, header->timer_offset, header->timer_count, sizeof(CheckpointTimer)) ||
+        !checkpoint_table_fits(header, checkpoint->size, header->waiter_offset, header->waiter_count, sizeof(CheckpointWaiter)) ||
+        !checkpoint_table_fits(header, checkpoint->size, header->event_offset, header->event_count, sizeof(CheckpointEvent)) ||
+        header->string_size == 0 || header->string_offset + header->string_size != checkpoint->size ||
+        ((const char *)base)[checkpoint->size - 1] != '\0') {
+        fprintf(stderr, "Error: Checkpoint %s is corrupt or from another version.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *image = (const char *)base;
+    checkpoint->resources = (const CheckpointResource *)(image + header->resource_offset);
+    checkpoint->systems = (const CheckpointSystem *)(image + header->system_offset);
+    checkpoint->shards = (const CheckpointShard *)(image + header->shard_offset);
+    checkpoint->pending = (const int32_t *)(image + header->pending_offset);
+    checkpoint->timers = (const CheckpointTimer *)(image + header->timer_offset);
+    checkpoint->waiters = (const CheckpointWaiter *)(image + header->waiter_offset);
+    checkpoint->events = (const CheckpointEvent *)(image + header->event_offset);
+    checkpoint->strings = image + header->string_offset;
+    checkpoint_validate(checkpoint, path);
+}
+
+/**
+ * Unmaps a checkpoint image.
+ *
+ * @param[in,out] checkpoint  Pointer to the `Checkpoint` to free.
+ */
+void checkpoint_free(Checkpoint *checkpoint) {
+    munmap(checkpoint->base, checkpoint->size);
+    checkpoint->base = NULL;
+    checkpoint->size = 0;
+}
+
+/**
+ * Puts a `Manager` built from the checkpointed scenario into the checkpointed state.
+ *
+ * Restores the clock, the counters, the amounts, the statuses, the partial outputs and
+ * the pending events; the timers and wait lists follow in `checkpoint_schedule` once
+ * the run has a wheel. Resources and systems are matched by position and checked by
+ * name. A scenario varied with `scenario_jitter` may differ in capacities: amounts
+ * are then clamped to the new capacity and a sharded resource starts from one shard.
+ *
+ * @param[in]     checkpoint  Pointer to the loaded `Checkpoint`.
+ * @param[in,out] manager     Pointer to a virtual-time `Manager` that has not run yet.
+ */
+void checkpoint_apply(const Checkpoint *checkpoint, Manager *manager) {
+    const CheckpointHeader *header = checkpoint->header;
+    ResourceArray *resources = &manager->resource_array;
+    SystemArray *systems = &manager->system_array;
+
+    if (!manager->clock.is_virtual) {
+        fprintf(stderr, "Error: A checkpoint can only be restored into a virtual-time run.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (header->resource_count != (uint32_t)resources->size || header->system_count != (uint32_t)systems->size) {
+        fprintf(stderr, "Error: Checkpoint has %u resources and %u systems, the scenario %d and %d.\n",
+                header->resource_count, header->system_count, resources->size, systems->size);
+        exit(EXIT_FAILURE);
+    }
+
+    const CheckpointShard *shards = checkpoint->shards;
+    for (int r = 0; r < resources->size; r++) {
+        Resource *resource = resources->resources[r];
+        const CheckpointResource *record = &checkpoint->resources[r];
+        int amount = (record->amount < resource->max_capacity) ? record->amount : resource->max_capacity;
+
+        if (strcmp(resource->name, checkpoint->strings + record->name_offset) != 0 ||
+            (resource->shards != NULL) != ((record->flags & RESOURCE_FLAG_SHARDED) != 0)) {
+            checkpoint_mismatch("resource", resource->name);
+        }
+        atomic_store(&resource->amount, amount);
+        atomic_store(&resource->low_state, record->low_state);
+        if (resource->shards != NULL) {
+            int units = 0;
+            for (int i = 0; i < RESOURCE_SHARDS; i++) {
+                units += shards[i].units;
+            }
+            units = (units < resource->max_capacity) ? units : resource->max_capacity;
+            for (int i = 0; i < RESOURCE_SHARDS; i++) {
+                if (record->max_capacity == resource->max_capacity) {
+                    atomic_store(&resource->shards[i].units, shards[i].units);
+                    atomic_store(&resource->shards[i].space, shards[i].space);
+                } else {
+                    atomic_store(&resource->shards[i].units, (i == 0) ? units : 0);
+                    atomic_store(&resource->shards[i].space, (i == 0) ? resource->max_capacity - units : 0);
+                }
+            }
+            shards += RESOURCE_SHARDS;
+        }
+    }
+
+    const int32_t *pending = checkpoint->pending;
+    for (int s = 0; s < systems->size; s++) {
+        System *system = systems->systems[s];
+        const CheckpointSystem *record = &checkpoint->systems[s];
+
+        if (strcmp(system->name, checkpoint->strings + record->name_offset) != 0 ||
+            record->output_count != (uint32_t)system->produced_count) {
+            checkpoint_mismatch("system", system->name);
+        }
+        system_set_status(system, record->status);
+        system->amount_stored = record->amount_stored;
+        system->processing = record->processing;
+        for (int o = 0; o < system->produced_count; o++) {
+            system->pending[o] = *pending++;
+        }
+        system->last_event_time = record->last_event_time;
+        system->last_event_resource = (record->last_event_resource >= 0) ? resources->resources[record->last_event_resource] : NULL;
+        system->last_event_status = record->last_event_status;
+        system->suppressed = record->suppressed;
+    }
+
+    sim_clock_set(&manager->clock, header->time);
+    manager->events_handled = header->events_handled;
+    for (int s = 0; s < EXPORT_STATUSES; s++) {
+        manager->events_by_status[s] = header->events_by_status[s];
+    }
+
+    for (uint32_t e = 0; e < header->event_count; e++) {
+        const CheckpointEvent *record = &checkpoint->events[e];
+        Event event;
+
+        event_init(&event, systems->systems[record->system], resources->resources[record->resource],
+                   record->status, record->priority, record->amount);
+        event.count = record->count;
+        event_queue_push(&manager->event_queue, &event);
+    }
+}
+
+/**
+ * Puts the checkpointed timers and waiters back into a virtual-time run.
+ *
+ * Timers are added in the order they were going to expire and waiters in the order
+ * they were going to be woken, so the run continues exactly as the checkpointed one.
+ * The controller, started afresh by `manager_run`, gets its counts back as well.
+ *
+ * @param[in]     checkpoint    Pointer to the `Checkpoint` applied with `checkpoint_apply`.
+ * @param[in,out] manager       Pointer to the `Manager` about to run.
+ * @param[in,out] wheel         Empty wheel of the run, at the checkpointed time.
+ * @param[in,out] manager_tick  Timer of the manager's poll.
+ */
+void checkpoint_schedule(const Checkpoint *checkpoint, Manager *manager, TimerWheel *wheel, TimerNode *manager_tick) {
+    const CheckpointHeader *header = checkpoint->header;
+    Controller *controller = &manager->controller;
+
+    controller->next_update = header->controller_next_update;
+    if (controller->starved != NULL) {
+        for (uint32_t r = 0; r < header->resource_count; r++) {
+            controller->starved[r] = checkpoint->resources[r].starved;
+        }
+    }
+
+    for (uint32_t t = 0; t < header->timer_count; t++) {
+        const CheckpointTimer *record = &checkpoint->timers[t];
+        TimerNode *node = (record->system == CHECKPOINT_MANAGER_TICK) ? manager_tick
+                                                                      : &manager->system_array.systems[record->system]->timer;
+        timer_wheel_add(wheel, node, record->expiry);
+    }
+
+    for (uint32_t w = 0; w < header->waiter_count; w++) {
+        const CheckpointWaiter *record = &checkpoint->waiters[w];
+        resource_wait_restore(manager->resource_array.resources[record->resource],
+                              manager->system_array.systems[record->system], record->need, record->is_space);
+    }
+}
+
+/**
+ * Rounds an offset up to the alignment of every checkpoint table.
+ *
+ * @param[in] offset  Byte offset.
+ * @return            The next multiple of 8.
+ */
+static size_t checkpoint_align(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+/**
+ * Checks that a table of a checkpoint image is aligned and lies before the string table.
+ *
+ * @param[in] header        Header of the image.
+ * @param[in] size          Size of the image in bytes.
+ * @param[in] offset        Offset of the table.
+ * @param[in] count         Records in the table.
+ * @param[in] element_size  Bytes per record.
+ * @return                  Non-zero if the table is in bounds.
+ */
+static int checkpoint_table_fits(const CheckpointHeader *header, size_t size, uint64_t offset, size_t count, size_t element_size) {
+    return offset >= sizeof(CheckpointHeader) && (offset & 7) == 0 && offset <= header->string_offset &&
+           header->string_offset <= size && count <= (header->string_offset - offset) / element_size;
+}
+
+/**
+ * Checks every name offset and index of a mapped checkpoint image.
+ *
+ * @param[in] checkpoint  Pointer to the mapped `Checkpoint`.
+ * @param[in] path        Path of the file, for error messages.
+ */
+static void checkpoint_validate(const Checkpoint *checkpoint, const char *path) {
+    const CheckpointHeader *header = checkpoint->header;
+    uint32_t shard_count = 0;
+    uint64_t pending_count = 0;
+    int bad = 0;
+
+    for (uint32_t r = 0; r < header->resource_count; r++) {
+        bad |= checkpoint->resources[r].name_offset >= header->string_size;
+        shard_count += (checkpoint->resources[r].flags & RESOURCE_FLAG_SHARDED) ? RESOURCE_SHARDS : 0;
+    }
+    for (uint32_t s = 0; s < header->system_count; s++) {
+        const CheckpointSystem *record = &checkpoint->systems[s];
+        bad |= record->name_offset >= header->string_size;
+        bad |= record->last_event_resource >= (int32_t)header->resource_count;
+        pending_count += record->output_count;
+    }
+    bad |= shard_count != header->shard_count || pending_count != header->pending_count;
+    for (uint32_t t = 0; t < header->timer_count; t++) {
+        const CheckpointTimer *record = &checkpoint->timers[t];
+        bad |= record->expiry <= header->time;
+        bad |= record->system >= header->system_count && record->system != CHECKPOINT_MANAGER_TICK;
+    }
+    for (uint32_t w = 0; w < header->waiter_count; w++) {
+        bad |= checkpoint->waiters[w].resource >= header->resource_count || checkpoint->waiters[w].system >= header->system_count;
+    }
+    for (uint32_t e = 0; e < header->event_count; e++) {
+        bad |= checkpoint->events[e].resource >= header->resource_count || checkpoint->events[e].system >= header->system_count;
+    }
+
+    if (bad) {
+        fprintf(stderr, "Error: Checkpoint %s has a bad record.\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Reports a checkpoint taken from another scenario and exits.
+ *
+ * @param[in] what  "resource" or "system".
+ * @param[in] name  Name of the first one that does not match.
+ */
+static void checkpoint_mismatch(const char *what, const char *name) {
+    fprintf(stderr, "Error: Checkpoint does not match the scenario at %s [%s].\n", what, name);
+    exit(EXIT_FAILURE);
+}
@@ -0,0 +1,178 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define CONTROL_PRODUCES_SCARCE   0x1 // An output is scarce
+#define CONTROL_CONSUMES_SCARCE   0x2 // An input is scarce
+#define CONTROL_OUTPUTS_PLENTIFUL 0x4 // The system has outputs and all of them are plentiful
+
+// One row of the rule table: a system with any of `facts` runs at `status`
+typedef struct ControlRule {
+    int facts;
+    int status;
+} ControlRule;
+
+// Rules in order of precedence, the first that matches decides; no match means STANDARD.
+// Refilling a scarce resource beats saving the inputs spent on it, so a chain of producers
+// feeding a critical resource speeds up as a whole, while systems that only drain a scarce
+// resource slow down, and nothing runs faster than its outputs can be used.
+static const ControlRule control_rules[] = {
+    {CONTROL_PRODUCES_SCARCE,   FAST},
+    {CONTROL_CONSUMES_SCARCE,   SLOW},
+    {CONTROL_OUTPUTS_PLENTIFUL, SLOW},
+};
+
+// Helper functions just used by this C file to clean up our code
+static int controller_facts(const Controller *controller, const System *system);
+static int controller_scarce(const Controller *controller, Resource *resource);
+
+/**
+ * Initializes a `Controller` that is disabled.
+ *
+ * @param[out] controller  Pointer to the `Controller` to initialize.
+ */
+void controller_init(Controller *controller) {
+    controller->enabled = 0;
+    controller->next_update = 0;
+    controller->starved = NULL;
+    controller->resource_count = 0;
+    controller->changes = 0;
+}
+
+/**
+ * Prepares an enabled `Controller` for a run over `resource_count` resources.
+ *
+ * Does nothing if the controller is disabled.
+ *
+ * @param[in,out] controller      Pointer to the `Controller`.
+ * @param[in]     resource_count  Number of resources, ids must be below it.
+ */
+void controller_start(Controller *controller, int resource_count) {
+    if (!controller->enabled) {
+        return;
+    }
+
+    free(controller->starved);
+    controller->starved = calloc(resource_count + 1, sizeof(int));
+    if (controller->starved == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Controller.\n");
+        exit(EXIT_FAILURE);
+    }
+    controller->resource_count = resource_count;
+    controller->next_update = 0;
+    controller->changes = 0;
+}
+
+/**
+ * Frees the event counters of a `Controller`.
+ *
+ * @param[in,out] controller  Pointer to the `Controller` to clean.
+ */
+void controller_clean(Controller *controller) {
+    free(controller->starved);
+    controller->starved = NULL;
+    controller->resource_count = 0;
+}
+
+/**
+ * Counts an event the manager handled towards the next decision.
+ *
+ * @param[in,out] controller  Pointer to the `Controller`.
+ * @param[in]     event       The event.
+ */
+void controller_observe(Controller *controller, const Event *event) {
+    if (!controller->enabled || event->resource->id >= controller->resource_count) {
+        return;
+    }
+    if (event->status == STATUS_EMPTY || event->status == STATUS_LOW || event->status == STATUS_INSUFFICIENT) {
+        controller->starved[event->resource->id] += event->count;
+    }
+}
+
+/**
+ * Sets the status of every running system from the rule table, once every `CONTROLLER_INTERVAL` ms.
+ *
+ * A resource is scarce while it is below its low mark or had starvation events since
+ * the last decision, and plentiful from `THRESHOLD_RESOURCE_HIGH` of its capacity up.
+ * Producers of scarce resources are sped up and their consumers slowed down, so the
+ * inputs that keep the mission going are spent where they are missing. Only the
+ * manager thread may call this; systems that are TERMINATE or DISABLED are left alone.
+ *
+ * @param[in,out] controller  Pointer to the `Controller`.
+ * @param[in,out] systems     Systems whose statuses are set.
+ * @param[in]     now         Current simulation time in milliseconds.
+ */
+void controller_update(Controller *controller, SystemArray *systems, unsigned long long now) {
+    if (!controller->enabled || now < controller->next_update) {
+        return;
+    }
+    controller->next_update = now + CONTROLLER_INTERVAL;
+
+    for (int i = 0; i < systems->size; i++) {
+        System *system = systems->systems[i];
+        int current = system_get_status(system);
+        int facts = controller_facts(controller, system);
+        int status = STANDARD;
+
+        if (current != SLOW && current != STANDARD && current != FAST) {
+            continue;
+        }
+        for (size_t r = 0; r < sizeof(control_rules) / sizeof(control_rules[0]); r++) {
+            if (facts & control_rules[r].facts) {
+                status = control_rules[r].status;
+                break;
+            }
+        }
+        if (status != current) {
+            system_set_status(system, status);
+            controller->changes++;
+        }
+    }
+
+    for (int i = 0; i < controller->resource_count; i++) {
+        controller->starved[i] = 0;
+    }
+}
+
+/**
+ * Collects the `CONTROL_*` facts of a system from the levels of its inputs and outputs.
+ *
+ * @param[in] controller  Pointer to the `Controller`.
+ * @param[in] system      The `System`.
+ * @return                The facts.
+ */
+static int controller_facts(const Controller *controller, const System *system) {
+    int facts = 0;
+    int plentiful = (system->produced_count > 0);
+
+    for (int i = 0; i < system->consumed_count; i++) {
+        if (controller_scarce(controller, system->consumed[i].resource)) {
+            facts |= CONTROL_CONSUMES_SCARCE;
+        }
+    }
+    for (int i = 0; i < system->produced_count; i++) {
+        Resource *resource = system->produced[i].resource;
+        if (controller_scarce(controller, resource)) {
+            facts |= CONTROL_PRODUCES_SCARCE;
+        }
+        if (resource_get_amount(resource) < resource->max_capacity * THRESHOLD_RESOURCE_HIGH) {
+            plentiful = 0;
+        }
+    }
+
+    return plentiful ? (facts | CONTROL_OUTPUTS_PLENTIFUL) : facts;
+}
+
+/**
+ * Decides whether a resource is scarce.
+ *
+ * @param[in] controller  Pointer to the `Controller`.
+ * @param[in] resource    The `Resource`.
+ * @return                Non-zero if it is below its low mark or starved since the last decision.
+ */
+static int controller_scarce(const Controller *controller, Resource *resource) {
+    if (resource_get_amount(resource) < resource->low_mark) {
+        return 1;
+    }
+    return resource->id < controller->resource_count && controller->starved[resource->id] > 0;
+}
@@ -1,5 +1,9 @@
 #include <semaphore.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 // Don't worry about these! These are special codes that allow us to do some formatting in the terminal
 // Such as clearing the line before printing or moving the location of the "cursor" that will print.
 #define ANSI_CLEAR "\033[2J"
@@ -22,38 +26,259 @@
 #define STATUS_CAPACITY     3
 #define STATUS_PRODUCED     10
 
+#define RESOURCE_FLAG_CRITICAL  0x1 // Running out stops the mission
+#define RESOURCE_FLAG_ALARM_LOW 0x2 // Running low is logged as an alarm
+#define RESOURCE_FLAG_SHARDED   0x4 // Held in per-thread shards, for resources many threads store into at once
+#define RESOURCE_FLAGS (RESOURCE_FLAG_CRITICAL | RESOURCE_FLAG_ALARM_LOW | RESOURCE_FLAG_SHARDED) // Every defined flag
+#define RESOURCE_SHARDS 8           // Shards of a sharded resource, threads are spread over them round-robin
+
 #define THRESHOLD_RESOURCE_LOW 0.3  // Percentage of resource before it is considered low.
-#define MANAGER_WAIT_TIME 5         // Milliseconds for the manager to wait between popping the queue
-#define SYSTEM_WAIT_TIME 20         // Milliseconds between loops of the system when production cannot occur
+#define THRESHOLD_RESOURCE_RECOVER 0.4 // Percentage a low resource must climb back to before it can be reported low again
+#define THRESHOLD_RESOURCE_HIGH 0.8 // Percentage of resource above which the controller considers it plentiful
+
+#define RESOURCE_LOW_ARMED    0     // Above the recover mark since the last report, the next drop below the low mark is reported
+#define RESOURCE_LOW_PENDING  1     // Dropped below the low mark, waiting for a system to report it
+#define RESOURCE_LOW_REPORTED 2     // Reported, quiet until the amount is back at the recover mark
+#define MANAGER_WAIT_TIME 5         // Milliseconds between event polls of the virtual-time manager loop
+#define MANAGER_DISPLAY_INTERVAL 1000 // Milliseconds between refreshes of the console display
+#define CONTROLLER_INTERVAL 10      // Milliseconds between decisions of the throughput controller
+#define MANAGER_ENGINE_EVENTS 0     // Virtual clock driven one system step at a time off the timer wheel
+#define MANAGER_ENGINE_SOA 1        // Virtual clock driven by the struct-of-arrays tick engine, simple systems only
+#define MANAGER_EVENT_BATCH 64      // Events the manager moves out of the queue per lock acquisition
+#define SYSTEM_WAIT_TIME 20         // Milliseconds between loops of the system when production cannot occur and it has no wake hook
+#define SYSTEM_BLOCKED -1           // Returned by system_run when the system waits on a resource wait list
 
 #define PRIORITY_HIGH 3
 #define PRIORITY_MED 2
 #define PRIORITY_LOW 1
+#define PRIORITY_LEVELS 3           // Number of distinct priorities, one EventQueue bucket each
+
+#define EVENT_POOL_BLOCK 256        // EventNodes preallocated per pool block of the EventQueue
+#define EVENT_INDEX_SIZE 256        // Hash buckets used to find a pending event with the same key (power of two)
+#define EVENT_RING_SIZE 4096        // Slots in the MPSC ring (power of two), only used with EVENT_QUEUE_MPSC
+#define CACHE_LINE_SIZE 64          // Bytes, used to keep fields written by different threads apart
+
+#define ARENA_BLOCK_SIZE 65536     // Default bytes per Arena block
+
+#define LOG_RING_SIZE 1024          // Messages the logger ring holds (power of two)
+#define LOG_LINE_SIZE 256           // Bytes per message including the NUL, longer ones are truncated
+#define LOG_BUFFER_SIZE 65536       // Bytes the logger thread gathers into a single write
+#define LOG_FLUSH_INTERVAL 50       // Milliseconds a partial buffer waits for more messages
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_CRITICAL 2        // Never dropped, written out at once
+
+#define LOG_POLICY_BLOCK 0          // A full ring makes the logging thread wait
+#define LOG_POLICY_DROP 1           // A full ring drops (and counts) everything below LOG_LEVEL_CRITICAL
+
+// Debug output, compiled out of release builds (make BUILD=release)
+#ifdef NDEBUG
+#define LOG_DEBUG(...) ((void)0)
+#else
+#define LOG_DEBUG(...) log_printf(LOG_LEVEL_DEBUG, "Debug: " __VA_ARGS__)
+#endif
+
+// Hot-path counters and histograms, compiled in with make STATS=on
+#define STATS_STEPS 0               // system_run calls
+#define STATS_CONVERSIONS 1         // Conversions started, every input consumed
+#define STATS_STATUS_OK 2           // One counter per STATUS_OK..STATUS_CAPACITY outcome of a consume or store
+#define STATS_EVENTS_PUSHED (STATS_STATUS_OK + STATUS_CAPACITY - STATUS_OK + 1)
+#define STATS_EVENTS_HANDLED (STATS_EVENTS_PUSHED + 1) // Fewer than pushed when events were coalesced
+#define STATS_COUNTERS (STATS_EVENTS_HANDLED + 1)
+
+#define STATS_HIST_RESOURCE_LOCK 0  // Nanoseconds spent acquiring Resource.mutex, 0 when uncontended
+#define STATS_HIST_QUEUE_LOCK 1     // Nanoseconds spent acquiring EventQueue.mutex, 0 when uncontended
+#define STATS_HIST_EVENT_LATENCY 2  // Nanoseconds from an event's push to the manager handling it
+#define STATS_HIST_PROCESSING 3     // Nanoseconds from a conversion's consume to its outputs being credited
+#define STATS_HISTOGRAMS 4
+
+#define STATS_SUB_BITS 3            // 8 linear sub-buckets per power of two, values within 12.5%
+#define STATS_MAX_BITS 40           // Values are clamped below 2^40 ns, about 18 minutes
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+#ifdef SIM_STATS
+#define STATS_INIT() stats_init()
+#define STATS_COUNT(counter) stats_count(counter)
+#define STATS_STATUS(status) stats_count(STATS_STATUS_OK + (status) - STATUS_OK)
+#define STATS_START(timestamp) ((timestamp) = stats_now_ns())
+#define STATS_RECORD(histogram, start) stats_record(histogram, stats_now_ns() - (start))
+#define STATS_LOCK(mutex, histogram) stats_lock(mutex, histogram)
+#define STATS_POLL(file) stats_poll(file)
+#define STATS_DUMP(file) stats_dump(file)
+#else
+#define STATS_INIT() ((void)0)
+#define STATS_COUNT(counter) ((void)0)
+#define STATS_STATUS(status) ((void)0)
+#define STATS_START(timestamp) ((void)0)
+#define STATS_RECORD(histogram, start) ((void)0)
+#define STATS_LOCK(mutex, histogram) pthread_mutex_lock(mutex)
+#define STATS_POLL(file) ((void)0)
+#define STATS_DUMP(file) ((void)0)
+#endif
+
+#define SCENARIO_MAGIC "CUISCN\0\0"  // First 8 bytes of a compiled scenario file
+#define SCENARIO_VERSION 3
+
+#define TRACE_MAGIC "CUITRACE"      // First 8 bytes of a trace file
+#define TRACE_VERSION 1
+#define TRACE_BUFFER_RECORDS 256    // Records a system gathers before copying them into the trace file
+#define TRACE_INITIAL_RECORDS 65536 // Records the trace file has room for before it first grows
+#define TRACE_EVENT 0               // TraceRecord.type of an event reported by a system
+#define TRACE_AMOUNT 1              // TraceRecord.type of a change of a resource amount
+
+#define EXPORT_MAGIC "CUIEXPRT"     // First 8 bytes of the shared-memory telemetry ring
+#define EXPORT_VERSION 1
+#define EXPORT_SLOTS 64             // Frames the shared-memory ring keeps, readers may lag this far
+#define EXPORT_PACKET_SIZE 1432     // Bytes per StatsD datagram, fits an Ethernet frame with IPv6 and UDP headers
+#define EXPORT_STATUSES (STATUS_CAPACITY + 1) // Handled events counted per status, STATUS_EMPTY..STATUS_CAPACITY
+
+#define CHECKPOINT_MAGIC "CUICKPT\0"  // First 8 bytes of a checkpoint image
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_MANAGER_TICK UINT32_MAX // CheckpointTimer.system of the manager's own poll
+
+#define TIMER_WHEEL_BITS 6                          // log2 of the slots per timer wheel level
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4                        // 64^4 ms of range, about 4.6 hours
+#define TIMER_NEVER (~0ULL)                         // Returned when no timers are registered
+
+// Intrusive node for the timer wheel, embedded in whatever object is waiting on a deadline
+typedef struct TimerNode {
+    struct TimerNode *next;
+    struct TimerNode *prev;
+    unsigned long long expiry;  // Tick (millisecond) at which the timer expires
+    int level;                  // Wheel level holding the node, -1 when not registered
+    void *owner;                // Object handed back on expiry
+} TimerNode;
+
+// Hierarchical timer wheel: level L has 64 slots of 64^L ticks each
+typedef struct TimerWheel {
+    TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // Sentinels of circular slot lists
+    int level_count[TIMER_WHEEL_LEVELS];
+    int count;                  // Timers registered in the wheel
+    unsigned long long now;     // Last tick processed
+} TimerWheel;
+
+// One chunk of an Arena, allocations are carved from `data` front to back
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;    // Previously filled block
+    size_t size;                // Bytes available in `data`
+    size_t used;                // Bytes handed out so far
+    _Alignas(max_align_t) char data[];
+} ArenaBlock;
+
+// Bump allocator for objects that live as long as the simulation, freed all at once
+typedef struct Arena {
+    ArenaBlock *head;           // Block currently allocated from
+    size_t block_size;
+    char **strings;             // Open-addressing table of interned strings
+    size_t string_count;
+    size_t string_capacity;     // Power of two, 0 until the first string is interned
+} Arena;
+
+// Time source of a simulation: the monotonic clock, or a virtual clock moved by the manager
+typedef struct SimClock {
+    int is_virtual;                 // Non-zero if time only advances through sim_clock_set
+    unsigned long long start;       // Monotonic milliseconds at initialization (real time)
+    atomic_ullong virtual_now;      // Current virtual time in milliseconds
+} SimClock;
+
+// FIFO list of systems blocked on a resource, linked through `System.wait_next`
+typedef struct ResourceWaitList {
+    struct System *head;
+    struct System *tail;
+} ResourceWaitList;
+
+// One shard of a sharded resource, on a cache line of its own
+// The units of all shards plus their free space always add up to the capacity, less units in flight.
+typedef struct ResourceShard {
+    _Alignas(CACHE_LINE_SIZE) atomic_int units; // Units held here, any thread may take them
+    atomic_int space;                  // Free capacity this shard may fill, credited by consumes
+} ResourceShard;
 
 // Represents the resource amounts for the entire rocket
+// With RESOURCE_ATOMIC, `amount` is only ever changed through CAS loops and there is no mutex.
+// Fields are grouped by who writes them and each group starts a cache line, so threads hammering
+// one resource's `amount` never invalidate the line holding its name or a neighbouring resource.
 typedef struct Resource {
-    char *name;              // Dynamically allocated string
-    int amount;              // Current amount of the resource
+    // Cold: fixed after creation
+    char *name;              // Interned in the arena the resource was created in
     int max_capacity;        // Maximum capacity of the resource
+    int id;                  // Index in the ResourceArray it was added to
+    int flags;               // RESOURCE_FLAG_* bits, the manager's policy for this resource
+    int low_mark;            // Amounts below this are low, from THRESHOLD_RESOURCE_LOW
+    int recover_mark;        // Amount that re-arms the low report, from THRESHOLD_RESOURCE_RECOVER
+    ResourceShard *shards;   // RESOURCE_SHARDS shards with RESOURCE_FLAG_SHARDED, NULL otherwise
+
+    // Hot: written by every consume and store
+    _Alignas(CACHE_LINE_SIZE) atomic_int amount; // Current amount of the resource, read lock-free with resource_get_amount;
+                                       // for a sharded resource the sum of its shards at the last resource_reconcile
+    atomic_int waiters;                // Systems on either wait list, lets updates skip `wait_mutex`
+    atomic_int low_state;              // RESOURCE_LOW_*, only written when the amount crosses a mark
+#ifdef RESOURCE_ATOMIC
+    atomic_int held;                   // Units taken by unfinished multi-resource consumes, not free space yet
+#else
     pthread_mutex_t mutex;   // Mutex to ensure thread-safe operations
+#endif
+
+    // Warm: only touched when systems block or are woken
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t wait_mutex; // Guards both wait lists
+    ResourceWaitList consumers;        // Systems waiting for `amount` to cover what they consume
+    ResourceWaitList producers;        // Systems waiting for free capacity to store into
+    pthread_mutex_t shard_mutex;       // Serializes gathering all shards of a sharded resource
 } Resource;
 
-// Represents the amount of a resource consumed/produced for a single system
+// Represents the amount of a resource consumed/produced for a single system, one term of a recipe
 typedef struct ResourceAmount {
     Resource *resource;
     int amount;
 } ResourceAmount;
 
-// A system which consumes resources, waits for `processing_time` milliseconds, then produced the produced resource
+// A system which consumes the inputs of its recipe, waits for `processing_time` milliseconds, then produces its outputs
+// Like `Resource`, fields are split by writer on separate cache lines: configuration, the state of the
+// worker currently running the system, and the status the manager changes.
 typedef struct System {
-    char *name;     // Dynamically allocated string
-    ResourceAmount consumed;
-    ResourceAmount produced;
-    int amount_stored;
+    // Cold: fixed after creation
+    char *name;     // Interned in the arena the system was created in
+    ResourceAmount *consumed;        // Recipe inputs in lock order, taken all at once or not at all
+    int consumed_count;
+    ResourceAmount *produced;        // Recipe outputs
+    int produced_count;
+    int *pending;                    // Per output, units produced but not stored yet
     int processing_time;
-    int status; 
+    int event_interval;              // Minimum milliseconds between repeats of the same event, 0 for no limit
     struct EventQueue *event_queue;  // Pointer to event queue shared by all systems and manager
-    pthread_mutex_t mutex;
+    void (*wake)(struct System *system, void *context); // Makes the system runnable again, set by the driver
+    void *wake_context;
+    int id;                          // Index in the SystemArray it was added to
+    int home;                        // Worker the scheduler queues the system on, -1 for any (see partition_systems)
+    struct Trace *trace;             // Records events and amount changes, NULL when not tracing
+
+    // Hot: written by the worker running the system and by whoever wakes it
+    _Alignas(CACHE_LINE_SIZE) int amount_stored; // Sum of `pending`
+    int processing;  // Non-zero while a conversion waits out its processing time
+    TimerNode timer;                 // Parks the system on the scheduler's timer wheel
+    struct System *wait_next;        // Next system on the same resource wait list
+    int wait_need;                   // Units (or free space) the system waits for
+    int last_event_status;
+    Resource *last_event_resource;   // Resource and status of the last event pushed, to detect repeats
+    unsigned long long last_event_time;
+    int suppressed;                  // Repeats held back by the rate limit, reported with the next push
+#ifdef EVENT_QUEUE_MPSC
+    atomic_int ring_marked;          // 0 if none of its events in the MPSC ring is marked, else 1 + repeats folded into it
+    atomic_int ring_amount;          // Amount of the latest repeat folded into the marked event
+    Resource *ring_resource;         // Resource and status of the marked event, only touched by the system's producer
+    int ring_status;
+#endif
+    struct TraceRecord *trace_records; // TRACE_BUFFER_RECORDS records not yet in the trace file
+    int trace_count;
+#ifdef SIM_STATS
+    unsigned long long convert_started; // Monotonic nanoseconds when the current conversion consumed
+#endif
+
+    // Written by the manager, read by the worker on every step
+    _Alignas(CACHE_LINE_SIZE) atomic_int status; // SLOW/STANDARD/FAST/TERMINATE, read with acquire and written with release
 } System;
 
 // Used to send notifications to the manager about an issue / state of the system
@@ -62,21 +287,64 @@ typedef struct Event {
     Resource *resource;
     int status;     
     int priority;   // Higher values indicate higher priority
-    int amount;     // Amount of the resource in question
+    int amount;     // Amount of the resource in question (latest value when coalesced)
+    int count;      // Number of occurrences folded into this event
+#ifdef SIM_STATS
+    unsigned long long created; // Monotonic nanoseconds, of the first occurrence when coalesced
+#endif
 } Event;
 
-// Linked List Node for the Event queue
+// Linked List Node for the Event queue, taken from and returned to the queue's free-list
 typedef struct EventNode {
     Event event;
     struct EventNode *next;
-    pthread_mutex_t mutex; 
+    struct EventNode *index_next;   // Next pending node in the same `EventQueue.index` chain
 } EventNode;
 
-// Linked List structure with a head and no tail, single instance shared by all systems
-typedef struct EventQueue {
+// A chunk of preallocated nodes, chained so the queue can free every chunk on cleanup
+typedef struct EventPoolBlock {
+    struct EventPoolBlock *next;
+    EventNode nodes[EVENT_POOL_BLOCK];
+} EventPoolBlock;
+
+// FIFO list holding the pending events of a single priority level
+typedef struct EventBucket {
     EventNode *head;
-    int size;
-    pthread_mutex_t mutex; 
+    EventNode *tail;
+} EventBucket;
+
+#ifdef EVENT_QUEUE_MPSC
+// Slot of the MPSC ring, `sequence` tells producers and the consumer whose turn it is
+typedef struct EventSlot {
+    atomic_size_t sequence;
+    Event event;
+    int marked;     // Non-zero if producers fold repeats into this event through its system's ring_marked
+} EventSlot;
+#endif
+
+// Bucketed priority queue, single instance shared by all systems
+// With EVENT_QUEUE_MPSC, producers publish into a lock-free ring and the buckets
+// belong to the single consumer (the manager), which drains the ring into them.
+// Nodes come from the pool, which only holds one node per pending key since repeats
+// are coalesced. The one exception to allocation-free pushes: when every pooled node
+// is pending, the pool grows by a block, under the queue mutex in the mutex variant.
+typedef struct EventQueue {
+    EventBucket buckets[PRIORITY_LEVELS]; // Indexed by priority - PRIORITY_LOW
+    EventNode *index[EVENT_INDEX_SIZE];   // Pending nodes hashed by (system, resource, status)
+    EventNode *free_list;                 // Unused nodes, recycled by push/pop
+    EventPoolBlock *blocks;               // Every block ever allocated for the pool
+    int size;                             // Events held in the buckets
+    SimClock *clock;                      // Time source for producer-side rate limiting, may be NULL
+#ifdef EVENT_QUEUE_MPSC
+    EventSlot *ring;
+    size_t ring_head;                     // Next slot to read, only touched by the consumer
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t ring_tail; // Next slot to reserve, shared by producers
+#else
+    pthread_mutex_t mutex;
+#endif
+    _Alignas(CACHE_LINE_SIZE) atomic_int consumer_waiting; // Non-zero while the consumer sleeps in event_queue_wait
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t wait_cond;             // Signalled by push while the consumer sleeps, uses CLOCK_MONOTONIC
 } EventQueue;
 
 // A basic dynamic array to store all of the systems in the simulation
@@ -93,27 +361,485 @@ typedef struct ResourceArray {
     int capacity;
 } ResourceArray;
 
+// Double-ended queue of runnable systems, the owning worker takes from the head, thieves from the tail
+typedef struct WorkDeque {
+    System **items;         // Circular buffer with room for every system
+    int capacity;
+    int head;               // Index of the oldest entry
+    int count;
+    pthread_mutex_t mutex;
+} WorkDeque;
+
+// A worker thread of the scheduler and its local run queue
+typedef struct Worker {
+    pthread_t thread;
+    int index;
+    struct Scheduler *scheduler;
+    WorkDeque deque;
+} Worker;
+
+// Fixed pool of worker threads running `System` steps, with a timer thread for parked systems
+typedef struct Scheduler {
+    Worker *workers;
+    int worker_count;
+    atomic_int running;      // Cleared by scheduler_stop
+    atomic_int *simulation_running; // Shared termination flag, no system starts a step once it is zero
+    atomic_int pending;      // Systems sitting in any deque
+    atomic_int idle_workers; // Workers blocked on `idle_cond`
+    pthread_mutex_t idle_mutex;
+    pthread_cond_t idle_cond;
+
+    TimerWheel timers;       // Parked systems, ticks are monotonic milliseconds
+    int next_worker;         // Round-robin target for systems without a home leaving the timer wheel
+    int pinned;              // Non-zero if every worker is pinned to a core
+    pthread_t timer_thread;
+    pthread_mutex_t timer_mutex;
+    pthread_cond_t timer_cond;
+} Scheduler;
+
+// One of the two buffers of a Snapshot, values are atomics so readers may copy them while the publisher runs
+typedef struct SnapshotBuffer {
+    atomic_ullong time;         // Simulation time the frame was taken at, in milliseconds
+    atomic_int running;         // Non-zero while the simulation ran
+    atomic_int *amounts;        // One per resource, in ResourceArray order
+    atomic_int *statuses;       // One per system, in SystemArray order
+} SnapshotBuffer;
+
+// Double-buffered, sequence-protected picture of the whole simulation, published by a single thread
+// Frame n lives in buffers[n % 2]; `sequence` is 2n once frame n is complete and odd while frame n + 1 is written.
+typedef struct Snapshot {
+    atomic_uint sequence;
+    SnapshotBuffer buffers[2];
+    int resource_count;
+    int system_count;
+} Snapshot;
+
+// A reader's private copy of one snapshot frame
+typedef struct SnapshotFrame {
+    unsigned int number;        // Frames published before and including this one
+    unsigned long long time;
+    int running;
+    int resource_count;
+    int system_count;
+    int *amounts;
+    int *statuses;
+} SnapshotFrame;
+
+// Slot of the logger ring, `sequence` works like in the MPSC event ring
+typedef struct LogSlot {
+    atomic_size_t sequence;
+    int length;                 // Bytes of `text`, without a NUL
+    int flush;                  // Non-zero if the logger should write out after this message
+    char text[LOG_LINE_SIZE];
+} LogSlot;
+
+// Console logger: any thread formats into the ring, one thread gathers and writes
+typedef struct Logger {
+    LogSlot *ring;
+    size_t ring_head;                     // Next slot to read, only touched by the logger thread
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t ring_tail; // Next slot to reserve, shared by every logging thread
+    _Alignas(CACHE_LINE_SIZE) atomic_int consumer_waiting; // Non-zero while the logger thread sleeps
+    atomic_int policy;                    // LOG_POLICY_BLOCK or LOG_POLICY_DROP
+    atomic_ullong dropped;                // Messages dropped since the start
+    atomic_int running;
+    unsigned long long reported;          // Drops already reported in the output
+    pthread_t thread;
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t wait_cond;
+    int fd;                               // Where the output goes
+    char *buffer;                         // LOG_BUFFER_SIZE bytes gathered for the next write
+    size_t used;
+} Logger;
+
+// One fixed-size entry of a trace file
+typedef struct TraceRecord {
+    uint64_t time;              // Simulation milliseconds
+    uint32_t system;            // System id
+    uint16_t resource;          // Resource id
+    uint8_t type;               // TRACE_EVENT or TRACE_AMOUNT
+    int8_t status;              // Event status, 0 for amount changes
+    int32_t amount;             // Event: amount reported. Amount change: units added, negative when consumed
+    int16_t priority;           // Event priority, 0 for amount changes
+    uint16_t count;             // Records folded into this one, always 1 for now
+} TraceRecord;
+
+// Header of a trace file, followed by the resource records, one name offset per system, the string
+// table and, at `record_offset`, `record_count` TraceRecords in the order buffers were copied in
+typedef struct TraceHeader {
+    char magic[8];              // TRACE_MAGIC
+    uint32_t version;           // TRACE_VERSION
+    uint32_t resource_count;
+    uint32_t system_count;
+    uint32_t string_size;
+    uint64_t record_offset;     // Multiple of 8
+    uint64_t record_count;      // Records copied in so far, the file may be longer while recording
+} TraceHeader;
+
+// Resource as it was when recording started
+typedef struct TraceResource {
+    uint32_t name_offset;       // Into the string table
+    int32_t amount;
+    int32_t max_capacity;
+} TraceResource;
+
+// Header of the shared-memory telemetry ring, followed at `capacity_offset` by one int32 capacity per
+// resource, at `string_offset` by the NUL-terminated names of the resources then the systems, and at
+// `slot_offset` by `slot_count` slots of `slot_size` bytes each
+// Readers map the object read-only and never make a system call: the newest frame is in slot
+// (head - 1) % slot_count, and a slot whose `sequence` is odd or changed during the copy is being rewritten.
+typedef struct ExportHeader {
+    char magic[8];              // EXPORT_MAGIC
+    uint32_t version;           // EXPORT_VERSION
+    uint32_t resource_count;
+    uint32_t system_count;
+    uint32_t slot_count;
+    uint32_t slot_size;         // Multiple of CACHE_LINE_SIZE
+    uint32_t interval;          // Milliseconds of simulation time between frames
+    uint64_t capacity_offset;
+    uint64_t string_offset;
+    uint64_t slot_offset;       // Multiple of CACHE_LINE_SIZE
+    _Alignas(CACHE_LINE_SIZE) atomic_ullong head; // Frames written so far
+} ExportHeader;
+
+// One frame of the telemetry ring, followed by `resource_count` amounts and `system_count` statuses
+typedef struct ExportSlot {
+    atomic_uint sequence;       // Odd while the slot is written, even once it is complete
+    atomic_int running;         // Non-zero while the simulation ran
+    atomic_ullong frame;        // Number of the frame, from 1
+    atomic_ullong time;         // Simulation milliseconds
+    atomic_ullong events_handled;
+    atomic_ullong events[EXPORT_STATUSES]; // Handled events by status, carried counts included
+    atomic_int values[];        // Amounts in ResourceArray order, then statuses in SystemArray order
+} ExportSlot;
+
+// Publisher of telemetry frames into a shared-memory ring and a StatsD sink
+typedef struct Exporter {
+    const char *shm_name;       // POSIX shared-memory object for the ring, NULL for none
+    const char *statsd;         // HOST:PORT of a StatsD sink, NULL for none
+    int interval;               // Milliseconds of simulation time between frames
+    unsigned long long next_due; // Simulation time the next frame is due
+    ExportHeader *ring;         // Mapping of the ring, NULL when not publishing into one
+    size_t ring_size;
+    int socket;                 // Non-blocking UDP socket connected to the sink, -1 for none
+    char packet[EXPORT_PACKET_SIZE];
+    int packet_length;          // Bytes of metrics gathered for the next datagram
+    unsigned long long sent[EXPORT_STATUSES]; // Event counts already sent, StatsD counters get the increase
+    unsigned long long frames;  // Frames published so far
+    unsigned long long dropped; // Datagrams the kernel refused instead of blocking
+} Exporter;
+
+// Binary trace being recorded into a memory-mapped file
+typedef struct Trace {
+    int fd;                     // Trace file, -1 when not recording
+    char *base;                 // Mapping of the whole file
+    size_t size;                // Bytes mapped, grows by doubling
+    size_t record_offset;
+    unsigned long long record_count; // Records copied into the file so far
+    pthread_mutex_t mutex;      // Held while a buffer is copied in or the file grows
+    SimClock *clock;            // Time stamps the records
+    SystemArray *systems;       // Whose buffers are flushed by trace_stop
+    TraceRecord *buffers;       // TRACE_BUFFER_RECORDS per system
+} Trace;
+
+// Counters and histograms of one thread, only written by that thread and summed by stats_dump
+typedef struct StatsBlock {
+    _Alignas(CACHE_LINE_SIZE) atomic_ullong counters[STATS_COUNTERS];
+    atomic_ullong sums[STATS_HISTOGRAMS];
+    atomic_ullong maxima[STATS_HISTOGRAMS];
+    atomic_ullong buckets[STATS_HISTOGRAMS][STATS_BUCKETS];
+    struct StatsBlock *next;    // Every block ever created, newest first
+} StatsBlock;
+
+// Rule-based feedback controller that sets the SLOW/STANDARD/FAST status of every system
+// Only the manager thread touches it.
+typedef struct Controller {
+    int enabled;                // Non-zero to let the controller change statuses
+    unsigned long long next_update; // Simulation time of the next decision
+    int *starved;               // EMPTY, LOW or INSUFFICIENT events per resource id since the last decision
+    int resource_count;
+    unsigned long long changes; // Status changes made so far
+} Controller;
+
+// Struct-of-arrays copy of simple systems (at most one input and one output) flown by the
+// virtual tick engine; indices are system and resource ids. Only the manager thread touches it.
+typedef struct Engine {
+    int count;                  // Systems
+    int resource_count;
+    System **systems;           // Read for statuses and named in events
+    Resource **resources;       // Receive the amounts in engine_sync
+
+    // Per system
+    int *input;                 // Resource id, -1 for none
+    int *input_amount;
+    int *output;                // Resource id, -1 for none
+    int *output_amount;
+    int *processing_time;
+    int *pending;               // Units produced but not stored yet
+    int *state;                 // ENGINE_* state in engine.c
+    int *status;                // Copy of the system's status, refreshed by engine_sync
+    int *request;               // Units to store or consume in the current round
+    unsigned long long *done;   // Time the current conversion finishes
+
+    // Per resource
+    int *amounts;
+    int *capacity;
+    int *low_mark;
+    int *recover_mark;
+    int *low_reported;          // Non-zero from a low report until the amount reaches the recover mark
+    int *total;                 // Scratch: sum of the requests of a round, or units left to wake consumers with
+    int *space;                 // Scratch: free space left to wake producers with
+} Engine;
+
 // Container structure which contains all of the core data for our simulation
 typedef struct Manager {
-    int simulation_running; // non-zero if the simulation is running, zero if it should be stopped
+    atomic_int simulation_running; // non-zero if the simulation is running, zero stops every system at once
+    int worker_count;       // Number of scheduler worker threads, defaults to the core count
+    SimClock clock;         // Real or virtual time of the simulation
+    int event_interval;     // Rate limit applied to every system's repeated events, 0 for none
     SystemArray system_array;
     ResourceArray resource_array;
     EventQueue event_queue;
+    Arena arena;            // Owns every System, Resource and name of the simulation
+    Snapshot snapshot;      // Published by the manager loop, feeds the display and telemetry
+    FILE *telemetry;        // Receives a JSON line per display refresh, NULL for none
+    Exporter exporter;      // Publishes frames to external dashboards when configured
+    const char *trace_path; // Binary trace recorded by manager_run, NULL for none
+    Trace trace;
+    Controller controller;  // Adapts system speeds to resource levels when enabled
+    int engine;             // MANAGER_ENGINE_*, how the virtual clock is driven
+    int partition;          // Non-zero to keep connected systems on one worker and pin the workers to cores
+    int quiet;              // Non-zero to log nothing, as for the missions of a batch
+    unsigned long long events_handled; // Events the manager loop handled
+    unsigned long long events_by_status[EXPORT_STATUSES]; // Handled events by status, carried counts included
+    Resource *depleted;     // Critical resource whose depletion stopped the run, NULL otherwise
+    const char *checkpoint_path;       // Checkpoint written by a virtual run, NULL for none
+    unsigned long long checkpoint_at;  // Virtual time from which the checkpoint is written
+    const struct Checkpoint *restore;  // Image the next virtual run continues from, NULL to start afresh
 } Manager;
 
+// Header of a compiled scenario, followed by the resource records, the system records, the recipe
+// terms and the string table
+// All fields are native-endian, a compiled scenario is meant for the machine that compiled it.
+typedef struct ScenarioHeader {
+    char magic[8];              // SCENARIO_MAGIC
+    uint32_t version;           // SCENARIO_VERSION
+    uint32_t resource_count;
+    uint32_t system_count;
+    uint32_t term_count;
+    uint32_t string_size;       // Bytes of NUL-terminated names at the end of the file
+} ScenarioHeader;
+
+// Fixed-size description of one resource in a scenario
+typedef struct ScenarioResource {
+    uint32_t name_offset;       // Into the string table
+    int32_t amount;
+    int32_t max_capacity;
+    uint32_t flags;             // RESOURCE_FLAG_* bits
+} ScenarioResource;
+
+// One input or output of a system's recipe
+typedef struct ScenarioTerm {
+    int32_t resource;           // Resource index
+    int32_t amount;
+} ScenarioTerm;
+
+// Fixed-size description of one system in a scenario, resources are referenced by index
+typedef struct ScenarioSystem {
+    uint32_t name_offset;       // Into the string table
+    uint32_t first_term;        // Index of the first input, the outputs follow the inputs
+    uint32_t input_count;
+    uint32_t output_count;
+    int32_t processing_time;
+} ScenarioSystem;
+
+// A scenario image, memory-mapped from a compiled file or compiled in memory from text
+typedef struct Scenario {
+    void *base;                 // Start of the image
+    size_t size;
+    int mapped;                 // Non-zero if `base` is a file mapping rather than malloc'd
+    const ScenarioHeader *header;
+    const ScenarioResource *resources;
+    const ScenarioSystem *systems;
+    const ScenarioTerm *terms;
+    const char *strings;
+} Scenario;
+
+// Header of a checkpoint image, followed by the tables at the offsets it names and the string table
+// Native-endian like a compiled scenario; every table starts 8-byte aligned.
+typedef struct CheckpointHeader {
+    char magic[8];              // CHECKPOINT_MAGIC
+    uint32_t version;           // CHECKPOINT_VERSION
+    uint32_t resource_count;
+    uint32_t system_count;
+    uint32_t shard_count;       // RESOURCE_SHARDS per sharded resource, in resource order
+    uint32_t pending_count;     // Per-output pending units, every system's outputs in system order
+    uint32_t timer_count;
+    uint32_t waiter_count;
+    uint32_t event_count;
+    uint32_t string_size;       // Bytes of NUL-terminated names at the end of the image
+    uint32_t reserved;
+    uint64_t time;              // Virtual time of the checkpoint
+    uint64_t events_handled;
+    uint64_t events_by_status[EXPORT_STATUSES];
+    uint64_t controller_next_update;
+    uint64_t resource_offset;   // Byte offsets of the tables from the start of the image
+    uint64_t system_offset;
+    uint64_t shard_offset;
+    uint64_t pending_offset;
+    uint64_t timer_offset;
+    uint64_t waiter_offset;
+    uint64_t event_offset;
+    uint64_t string_offset;
+} CheckpointHeader;
+
+// State of one resource, matched to the scenario by name on restore
+typedef struct CheckpointResource {
+    uint32_t name_offset;       // Into the string table
+    int32_t amount;             // Resource.amount, the last reconciled sum for a sharded resource
+    int32_t max_capacity;       // Capacity it was checkpointed with
+    int32_t low_state;          // RESOURCE_LOW_*
+    int32_t starved;            // Controller.starved of the resource
+    uint32_t flags;             // RESOURCE_FLAG_* bits
+} CheckpointResource;
+
+// Units and free space of one shard of a sharded resource
+typedef struct CheckpointShard {
+    int32_t units;
+    int32_t space;
+} CheckpointShard;
+
+// State of one system, matched to the scenario by name on restore
+typedef struct CheckpointSystem {
+    uint64_t last_event_time;
+    uint32_t name_offset;       // Into the string table
+    int32_t status;
+    int32_t amount_stored;
+    int32_t processing;
+    uint32_t output_count;      // Entries of the pending table it owns
+    int32_t last_event_resource; // Resource index, -1 for none
+    int32_t last_event_status;
+    int32_t suppressed;
+} CheckpointSystem;
+
+// One timer on the wheel, in the order they expire
+typedef struct CheckpointTimer {
+    uint64_t expiry;
+    uint32_t system;            // System index, CHECKPOINT_MANAGER_TICK for the manager's poll
+    uint32_t reserved;
+} CheckpointTimer;
+
+// One system on a resource wait list, in list order
+typedef struct CheckpointWaiter {
+    uint32_t resource;          // Resource index
+    uint32_t system;            // System index
+    int32_t need;               // System.wait_need
+    int32_t is_space;           // Non-zero on the producer list
+} CheckpointWaiter;
+
+// One pending event, in the order the manager would handle them
+typedef struct CheckpointEvent {
+    uint32_t system;            // System index
+    uint32_t resource;          // Resource index
+    int32_t status;
+    int32_t priority;
+    int32_t amount;
+    int32_t count;
+} CheckpointEvent;
+
+// A checkpoint image mapped read-only and private, so any number of runs can restore from it at once
+typedef struct Checkpoint {
+    void *base;                 // Start of the mapping
+    size_t size;
+    const CheckpointHeader *header;
+    const CheckpointResource *resources;
+    const CheckpointSystem *systems;
+    const CheckpointShard *shards;
+    const int32_t *pending;
+    const CheckpointTimer *timers;
+    const CheckpointWaiter *waiters;
+    const CheckpointEvent *events;
+    const char *strings;
+} Checkpoint;
+
+// Outcome of one mission of a batch
+typedef struct BatchResult {
+    unsigned long long length;  // Virtual milliseconds until the mission ended
+    unsigned long long events;  // Events the manager handled
+    int depleted;               // Id of the critical resource that ran out, -1 if the mission stopped otherwise
+} BatchResult;
+
+// Many independent missions of one scenario, run side by side against the virtual clock
+// Every mission builds its own Manager; the only thing the threads share is the counter they claim missions with.
+typedef struct Batch {
+    const Scenario *scenario;   // Base of every mission, only read
+    int missions;
+    double spread;              // Variation of each mission, see scenario_jitter
+    unsigned long long seed;    // Mission i is varied with seed + i, whatever thread runs it
+    int control;                // Non-zero to fly every mission with the throughput controller
+    int engine;                 // MANAGER_ENGINE_* every mission is flown with
+    const Checkpoint *checkpoint; // Image every mission continues from, NULL to fly them from the start
+    atomic_int next;            // Next mission to claim
+    BatchResult *results;       // One per mission, written only by the thread that ran it
+    int *amounts;               // Final amount of every resource, resource_count per mission
+    int threads;                // Threads of the last batch_run
+    double wall;                // Seconds the last batch_run took
+} Batch;
+
 // Manager functions
 void manager_init(Manager *manager);
 void manager_clean(Manager *manager);
 void manager_run(Manager *manager);
+void manager_set_virtual_time(Manager *manager, int is_virtual);
+void manager_checkpoint(Manager *manager, unsigned long long at, const char *path);
+void manager_restore(Manager *manager, const Checkpoint *checkpoint);
 
 // System functions
-void system_create(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue);
+void system_create(System **system, Arena *arena, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue);
+void system_create_recipe(System **system, Arena *arena, const char *name, const ResourceAmount *consumed, int consumed_count,
+                          const ResourceAmount *produced, int produced_count, int processing_time, EventQueue *event_queue);
+void system_init_recipe(System *system, Arena *arena, const char *name, const ResourceAmount *consumed, int consumed_count,
+                        const ResourceAmount *produced, int produced_count, int processing_time, EventQueue *event_queue);
 void system_destroy(System *system);
-void system_run(System *system);
+int system_get_status(System *system);
+void system_set_status(System *system, int status);
+int system_run(System *system);
+
+// Arena functions
+void arena_init(Arena *arena, size_t block_size);
+void arena_clean(Arena *arena);
+void *arena_alloc(Arena *arena, size_t size, size_t alignment);
+char *arena_intern(Arena *arena, const char *string);
+void arena_reserve_strings(Arena *arena, size_t count);
+
+// SimClock functions
+void sim_clock_init(SimClock *clock, int is_virtual);
+unsigned long long sim_clock_now(SimClock *clock);
+void sim_clock_set(SimClock *clock, unsigned long long now);
+
+// Timer wheel functions
+void timer_wheel_init(TimerWheel *wheel, unsigned long long now);
+void timer_node_init(TimerNode *node, void *owner);
+void timer_wheel_add(TimerWheel *wheel, TimerNode *node, unsigned long long expiry);
+unsigned long long timer_wheel_next_expiry(const TimerWheel *wheel);
+TimerNode *timer_wheel_advance(TimerWheel *wheel, unsigned long long target);
+
+// Scheduler functions
+void scheduler_start(Scheduler *scheduler, SystemArray *systems, int worker_count, atomic_int *simulation_running, int pin);
+void scheduler_stop(Scheduler *scheduler);
 
 // Resource functions
-void resource_create(Resource **resource, const char *name, int amount, int max_capacity);
+void resource_create(Resource **resource, Arena *arena, const char *name, int amount, int max_capacity, int flags);
+void resource_init(Resource *resource, Arena *arena, const char *name, int amount, int max_capacity, int flags);
 void resource_destroy(Resource *resource);
+int resource_consume(Resource *resource, int amount);
+int resource_consume_all(const ResourceAmount *amounts, int count, int *failed);
+int resource_store(Resource *resource, int amount);
+int resource_get_amount(Resource *resource);
+void resource_reconcile(Resource *resource);
+int resource_claim_low(Resource *resource);
+int resource_wait_amount(Resource *resource, System *system, int amount);
+int resource_wait_space(Resource *resource, System *system);
+void resource_wait_restore(Resource *resource, System *system, int need, int is_space);
 
 // ResourceAmount functions
 void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, int amount);
@@ -126,12 +852,96 @@ void event_queue_init(EventQueue *queue);
 void event_queue_clean(EventQueue *queue);
 void event_queue_push(EventQueue *queue, const Event *event); 
 int event_queue_pop(EventQueue *queue, Event* event);
+int event_queue_pop_batch(EventQueue *queue, Event *out, int max);
+void event_queue_wait(EventQueue *queue, int timeout_ms);
+
+// Logger functions
+void log_start(int fd, int policy);
+void log_stop(void);
+void log_set_policy(int policy);
+void log_printf(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void log_flush(void);
+
+// Snapshot functions
+void snapshot_init(Snapshot *snapshot, int resource_count, int system_count);
+void snapshot_clean(Snapshot *snapshot);
+void snapshot_publish(Snapshot *snapshot, const ResourceArray *resources, const SystemArray *systems,
+                      unsigned long long now, int running);
+void snapshot_frame_init(SnapshotFrame *frame, const Snapshot *snapshot);
+void snapshot_frame_clean(SnapshotFrame *frame);
+int snapshot_read(Snapshot *snapshot, SnapshotFrame *frame);
+void snapshot_write_json(const SnapshotFrame *frame, const ResourceArray *resources, const SystemArray *systems, FILE *file);
+
+// Trace functions
+void trace_init(Trace *trace);
+void trace_start(Trace *trace, const char *path, SimClock *clock, ResourceArray *resources, SystemArray *systems);
+void trace_stop(Trace *trace);
+void trace_event(System *system, const Event *event);
+void trace_amount(System *system, Resource *resource, int change);
+
+// Controller functions
+void controller_init(Controller *controller);
+void controller_start(Controller *controller, int resource_count);
+void controller_clean(Controller *controller);
+void controller_observe(Controller *controller, const Event *event);
+void controller_update(Controller *controller, SystemArray *systems, unsigned long long now);
+
+// Export functions
+void export_init(Exporter *exporter);
+void export_start(Exporter *exporter, const ResourceArray *resources, const SystemArray *systems);
+void export_poll(Exporter *exporter, Manager *manager, SnapshotFrame *frame, unsigned long long now);
+void export_stop(Exporter *exporter, Manager *manager, SnapshotFrame *frame);
+
+// Partition functions
+int partition_systems(SystemArray *systems, int resource_count, int parts);
+int partition_shared(const SystemArray *systems, int resource_count);
+
+// Tick engine functions
+int engine_supports(const SystemArray *systems);
+void engine_init(Engine *engine, ResourceArray *resources, SystemArray *systems);
+void engine_clean(Engine *engine);
+void engine_step(Engine *engine, unsigned long long now);
+unsigned long long engine_next(const Engine *engine);
+void engine_sync(Engine *engine);
+
+// Checkpoint functions
+void checkpoint_write(const char *path, Manager *manager, TimerNode *timers, const Event *events, int event_count);
+void checkpoint_load(Checkpoint *checkpoint, const char *path);
+void checkpoint_free(Checkpoint *checkpoint);
+void checkpoint_apply(const Checkpoint *checkpoint, Manager *manager);
+void checkpoint_schedule(const Checkpoint *checkpoint, Manager *manager, TimerWheel *wheel, TimerNode *manager_tick);
+
+// Batch functions
+void batch_init(Batch *batch, const Scenario *scenario, int missions);
+void batch_run(Batch *batch, int threads);
+void batch_print(const Batch *batch);
+void batch_clean(Batch *batch);
+
+// Stats functions, only defined with SIM_STATS
+void stats_init(void);
+void stats_count(int counter);
+void stats_record(int histogram, unsigned long long value);
+void stats_lock(pthread_mutex_t *mutex, int histogram);
+unsigned long long stats_now_ns(void);
+void stats_poll(FILE *file);
+void stats_dump(FILE *file);
+
+// Scenario functions
+void scenario_load(Scenario *scenario, const char *path);
+void scenario_write(const Scenario *scenario, const char *path);
+void scenario_apply(const Scenario *scenario, Manager *manager);
+void scenario_jitter(const Scenario *scenario, Scenario *copy, double spread, unsigned long long seed);
+void scenario_free(Scenario *scenario);
 
 // Dynamic array functions for systems and resources
 void system_array_init(SystemArray *array);
 void system_array_clean(SystemArray *array);
 void system_array_add(SystemArray *array, System *system);
+void system_array_reserve(SystemArray *array, int capacity);
+void system_array_add_block(SystemArray *array, System *systems, int count);
 
 void resource_array_init(ResourceArray *array);
 void resource_array_clean(ResourceArray *array);
-void resource_array_add(ResourceArray *array, Resource *resource);
\ No newline at end of file
+void resource_array_add(ResourceArray *array, Resource *resource);
+void resource_array_reserve(ResourceArray *array, int capacity);
+void resource_array_add_block(ResourceArray *array, Resource *resources, int count);
\ No newline at end of file
@@ -0,0 +1,373 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define ENGINE_IDLE        0 // Consumes its input next
+#define ENGINE_PROCESSING  1 // Converting until `done`
+#define ENGINE_STORING     2 // Stores its pending output next
+#define ENGINE_WAIT_INPUT  3 // Blocked until its input covers the recipe
+#define ENGINE_WAIT_OUTPUT 4 // Blocked until its output has free space
+
+// Helper functions just used by this C file to clean up our code
+static void *engine_alloc(int count, size_t size);
+static int engine_collect(Engine *engine, unsigned long long now);
+static void engine_store(Engine *engine);
+static void engine_consume(Engine *engine, unsigned long long now);
+static void engine_report(Engine *engine, int system, int resource, int status, int priority);
+
+/**
+ * Decides whether the tick engine can run a set of systems.
+ *
+ * Only simple systems fit its arrays: at most one input and one output each, and
+ * none on a sharded resource, whose amount lives in its shards rather than in `amount`.
+ *
+ * @param[in] systems  The systems.
+ * @return             Non-zero if every system is simple.
+ */
+int engine_supports(const SystemArray *systems) {
+    for (int i = 0; i < systems->size; i++) {
+        const System *system = systems->systems[i];
+        if (system->consumed_count > 1 || system->produced_count > 1) {
+            return 0;
+        }
+        if ((system->consumed_count == 1 && system->consumed[0].resource->shards != NULL) ||
+            (system->produced_count == 1 && system->produced[0].resource->shards != NULL)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Copies simple systems and their resources into the struct-of-arrays layout of an `Engine`.
+ *
+ * Every field a tick reads is a plain array indexed by system or resource id, so a
+ * pass over all systems walks memory in order instead of chasing `System` pointers.
+ * The systems and resources are only touched again by `engine_sync` and for events.
+ *
+ * @param[out] engine     Pointer to the `Engine` to initialize.
+ * @param[in]  resources  Resources of the simulation, ids are their indices.
+ * @param[in]  systems    Systems of the simulation, all simple (see `engine_supports`).
+ */
+void engine_init(Engine *engine, ResourceArray *resources, SystemArray *systems) {
+    int count = systems->size;
+    int resource_count = resources->size;
+
+    engine->count = count;
+    engine->resource_count = resource_count;
+    engine->systems = systems->systems;
+    engine->resources = resources->resources;
+
+    engine->input = engine_alloc(count, sizeof(int));
+    engine->input_amount = engine_alloc(count, sizeof(int));
+    engine->output = engine_alloc(count, sizeof(int));
+    engine->output_amount = engine_alloc(count, sizeof(int));
+    engine->processing_time = engine_alloc(count, sizeof(int));
+    engine->pending = engine_alloc(count, sizeof(int));
+    engine->state = engine_alloc(count, sizeof(int));
+    engine->status = engine_alloc(count, sizeof(int));
+    engine->request = engine_alloc(count, sizeof(int));
+    engine->done = engine_alloc(count, sizeof(unsigned long long));
+    engine->amounts = engine_alloc(resource_count, sizeof(int));
+    engine->capacity = engine_alloc(resource_count, sizeof(int));
+    engine->low_mark = engine_alloc(resource_count, sizeof(int));
+    engine->recover_mark = engine_alloc(resource_count, sizeof(int));
+    engine->low_reported = engine_alloc(resource_count, sizeof(int));
+    engine->total = engine_alloc(resource_count, sizeof(int));
+    engine->space = engine_alloc(resource_count, sizeof(int));
+
+    for (int r = 0; r < resource_count; r++) {
+        Resource *resource = resources->resources[r];
+        engine->amounts[r] = resource_get_amount(resource);
+        engine->capacity[r] = resource->max_capacity;
+        engine->low_mark[r] = resource->low_mark;
+        engine->recover_mark[r] = resource->recover_mark;
+        engine->low_reported[r] = (atomic_load(&resource->low_state) != RESOURCE_LOW_ARMED);
+    }
+    for (int i = 0; i < count; i++) {
+        System *system = systems->systems[i];
+        engine->input[i] = (system->consumed_count > 0) ? system->consumed[0].resource->id : -1;
+        engine->input_amount[i] = (system->consumed_count > 0) ? system->consumed[0].amount : 0;
+        engine->output[i] = (system->produced_count > 0) ? system->produced[0].resource->id : -1;
+        engine->output_amount[i] = (system->produced_count > 0) ? system->produced[0].amount : 0;
+        engine->processing_time[i] = system->processing_time;
+        engine->pending[i] = system->amount_stored;
+        engine->state[i] = (system->amount_stored > 0) ? ENGINE_STORING : ENGINE_IDLE;
+        engine->status[i] = system_get_status(system);
+        engine->request[i] = 0;
+        engine->done[i] = 0;
+    }
+}
+
+/**
+ * Frees the arrays of an `Engine`.
+ *
+ * @param[in,out] engine  Pointer to the `Engine` to clean.
+ */
+void engine_clean(Engine *engine) {
+    free(engine->input);
+    free(engine->input_amount);
+    free(engine->output);
+    free(engine->output_amount);
+    free(engine->processing_time);
+    free(engine->pending);
+    free(engine->state);
+    free(engine->status);
+    free(engine->request);
+    free(engine->done);
+    free(engine->amounts);
+    free(engine->capacity);
+    free(engine->low_mark);
+    free(engine->recover_mark);
+    free(engine->low_reported);
+    free(engine->total);
+    free(engine->space);
+    engine->count = 0;
+    engine->resource_count = 0;
+}
+
+/**
+ * Advances every system due at the current tick.
+ *
+ * Runs in rounds until no system is left to move at `now`. Each round finishes the
+ * conversions that are done and wakes, in system order, as many blocked systems as
+ * their resource now has units or space for, then stores every pending output and consumes every input
+ * asked for. Stores go first, so a unit stored in a round can be consumed in it.
+ * When the requests on a resource fit, all of them are granted at once; only a
+ * contended resource is handed out one request at a time in system order, which
+ * keeps runs deterministic.
+ *
+ * @param[in,out] engine  Pointer to the `Engine`.
+ * @param[in]     now     Current virtual time in milliseconds.
+ */
+void engine_step(Engine *engine, unsigned long long now) {
+    while (engine_collect(engine, now) > 0) {
+        engine_store(engine);
+        engine_consume(engine, now);
+    }
+}
+
+/**
+ * Finds the next time a conversion finishes.
+ *
+ * @param[in] engine  Pointer to the `Engine`.
+ * @return            Virtual time in milliseconds, or `TIMER_NEVER` if no system is processing.
+ */
+unsigned long long engine_next(const Engine *engine) {
+    unsigned long long next = TIMER_NEVER;
+
+    for (int i = 0; i < engine->count; i++) {
+        unsigned long long done = (engine->state[i] == ENGINE_PROCESSING) ? engine->done[i] : TIMER_NEVER;
+        next = (done < next) ? done : next;
+    }
+    return next;
+}
+
+/**
+ * Writes the amounts of an `Engine` back to its resources and reads the statuses of its systems.
+ *
+ * The manager calls this before it looks at the simulation and after it may have
+ * changed statuses, so snapshots, the controller and the final report see the
+ * engine's state, and SLOW/FAST apply from the next conversion.
+ *
+ * @param[in,out] engine  Pointer to the `Engine`.
+ */
+void engine_sync(Engine *engine) {
+    for (int r = 0; r < engine->resource_count; r++) {
+        atomic_store_explicit(&engine->resources[r]->amount, engine->amounts[r], memory_order_release);
+    }
+    for (int i = 0; i < engine->count; i++) {
+        engine->status[i] = system_get_status(engine->systems[i]);
+    }
+}
+
+/**
+ * Allocates one array of an `Engine`.
+ *
+ * @param[in] count  Number of elements.
+ * @param[in] size   Size of an element.
+ * @return           The zero-filled array.
+ */
+static void *engine_alloc(int count, size_t size) {
+    void *array = calloc((size_t)count + 1, size);
+    if (array == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Engine.\n");
+        exit(EXIT_FAILURE);
+    }
+    return array;
+}
+
+/**
+ * Moves every system that is due to its next request and sums the requests per resource.
+ *
+ * @param[in,out] engine  Pointer to the `Engine`.
+ * @param[in]     now     Current virtual time in milliseconds.
+ * @return                Number of systems with a request this round.
+ */
+static int engine_collect(Engine *engine, unsigned long long now) {
+    int *state = engine->state;
+    int *request = engine->request;
+    int *amount = engine->total;
+    int *space = engine->space;
+    int due = 0;
+
+    // Finished conversions, and blocked systems while their resource covers them like `resource_wake` does
+    for (int r = 0; r < engine->resource_count; r++) {
+        amount[r] = engine->amounts[r];
+        space[r] = engine->capacity[r] - engine->amounts[r];
+    }
+    for (int i = 0; i < engine->count; i++) {
+        int s = state[i];
+        if (s == ENGINE_PROCESSING && engine->done[i] <= now) {
+            engine->pending[i] = engine->output_amount[i];
+            s = (engine->output[i] >= 0) ? ENGINE_STORING : ENGINE_IDLE;
+        } else if (s == ENGINE_WAIT_INPUT && amount[engine->input[i]] >= engine->input_amount[i]) {
+            amount[engine->input[i]] -= engine->input_amount[i];
+            s = ENGINE_IDLE;
+        } else if (s == ENGINE_WAIT_OUTPUT && space[engine->output[i]] > 0) {
+            space[engine->output[i]] -= engine->pending[i];
+            s = ENGINE_STORING;
+        }
+        state[i] = s;
+    }
+
+    // Requests: pending units to store, or inputs to consume
+    for (int i = 0; i < engine->count; i++) {
+        int active = (engine->status[i] != TERMINATE);
+        int storing = active && state[i] == ENGINE_STORING;
+        int idle = active && state[i] == ENGINE_IDLE;
+        request[i] = storing ? engine->pending[i] : (idle ? engine->input_amount[i] : 0);
+        due += storing | idle;
+    }
+
+    return due;
+}
+
+/**
+ * Stores the pending output of every system that is storing this round.
+ *
+ * @param[in,out] engine  Pointer to the `Engine`.
+ */
+static void engine_store(Engine *engine) {
+    int *total = engine->total;
+    int *amounts = engine->amounts;
+
+    for (int r = 0; r < engine->resource_count; r++) {
+        total[r] = 0;
+    }
+    for (int i = 0; i < engine->count; i++) {
+        if (engine->state[i] == ENGINE_STORING && engine->request[i] > 0) {
+            total[engine->output[i]] += engine->request[i];
+        }
+    }
+
+    // Resources with room for every offer take them all, `total` is left at 0 for the contended ones
+    for (int r = 0; r < engine->resource_count; r++) {
+        int fits = (total[r] <= engine->capacity[r] - amounts[r]);
+        amounts[r] += fits ? total[r] : 0;
+        total[r] = fits;
+    }
+
+    for (int i = 0; i < engine->count; i++) {
+        if (engine->state[i] != ENGINE_STORING || engine->request[i] == 0) {
+            continue;
+        }
+        int r = engine->output[i];
+        if (!total[r]) {
+            int space = engine->capacity[r] - amounts[r];
+            int stored = (engine->pending[i] < space) ? engine->pending[i] : space;
+            amounts[r] += stored;
+            engine->pending[i] -= stored;
+        } else {
+            engine->pending[i] = 0;
+        }
+
+        if (engine->pending[i] > 0) {
+            engine->state[i] = ENGINE_WAIT_OUTPUT;
+            engine_report(engine, i, r, STATUS_CAPACITY, PRIORITY_LOW);
+        } else {
+            engine->state[i] = ENGINE_IDLE;
+            engine->request[i] = -1; // Consumes in the next round
+        }
+    }
+
+    for (int r = 0; r < engine->resource_count; r++) {
+        engine->low_reported[r] &= (amounts[r] < engine->recover_mark[r]);
+    }
+}
+
+/**
+ * Consumes the input of every idle system and starts its conversion.
+ *
+ * A system without an input starts right away. A system whose input is short is
+ * reported like `system_run` does and blocks until the input covers its recipe.
+ *
+ * @param[in,out] engine  Pointer to the `Engine`.
+ * @param[in]     now     Current virtual time in milliseconds.
+ */
+static void engine_consume(Engine *engine, unsigned long long now) {
+    int *total = engine->total;
+    int *amounts = engine->amounts;
+
+    for (int r = 0; r < engine->resource_count; r++) {
+        total[r] = 0;
+    }
+    for (int i = 0; i < engine->count; i++) {
+        if (engine->state[i] == ENGINE_IDLE && engine->request[i] > 0) {
+            total[engine->input[i]] += engine->request[i];
+        }
+    }
+
+    // Resources that cover every request give them all, `total` keeps the amount before for the low check
+    for (int r = 0; r < engine->resource_count; r++) {
+        int fits = (total[r] <= amounts[r]);
+        int before = amounts[r];
+        amounts[r] -= fits ? total[r] : 0;
+        total[r] = fits ? before : -1;
+    }
+
+    for (int i = 0; i < engine->count; i++) {
+        int r = engine->input[i];
+        if (engine->state[i] != ENGINE_IDLE || engine->request[i] < 0 || engine->status[i] == TERMINATE) {
+            continue;
+        }
+
+        if (r >= 0 && total[r] < 0) {
+            if (amounts[r] < engine->input_amount[i]) {
+                engine->state[i] = ENGINE_WAIT_INPUT;
+                engine_report(engine, i, r, (amounts[r] == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT, PRIORITY_HIGH);
+                continue;
+            }
+            amounts[r] -= engine->input_amount[i];
+        }
+
+        // The first consumer to take the resource below its low mark reports it, once per drop
+        int time = engine->processing_time[i];
+        int before = (r >= 0 && total[r] < 0) ? amounts[r] + engine->input_amount[i] : (r >= 0) ? total[r] : 0;
+        if (r >= 0 && !engine->low_reported[r] && before >= engine->low_mark[r] && amounts[r] < engine->low_mark[r]) {
+            engine->low_reported[r] = 1;
+            engine_report(engine, i, r, STATUS_LOW, PRIORITY_MED);
+        }
+        engine->state[i] = ENGINE_PROCESSING;
+        engine->done[i] = now + (unsigned long long)((engine->status[i] == SLOW) ? time * 2
+                                                     : (engine->status[i] == FAST) ? time / 2 : time);
+        STATS_COUNT(STATS_CONVERSIONS);
+    }
+}
+
+/**
+ * Pushes an event about a resource on behalf of a system.
+ *
+ * @param[in,out] engine    Pointer to the `Engine`.
+ * @param[in]     system    Index of the reporting system.
+ * @param[in]     resource  Index of the resource the event is about.
+ * @param[in]     status    Status code to report.
+ * @param[in]     priority  Priority of the event.
+ */
+static void engine_report(Engine *engine, int system, int resource, int status, int priority) {
+    Event event;
+
+    STATS_STATUS(status);
+    event_init(&event, engine->systems[system], engine->resources[resource], status, priority, engine->amounts[resource]);
+    event_queue_push(engine->systems[system]->event_queue, &event);
+}
@@ -1,11 +1,27 @@
 #include "defs.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <sched.h>
+#include <time.h>
+
+// Helper functions just used by this C file
+static void event_pool_grow(EventQueue *queue);
+static int event_bucket_index(int priority);
+static void event_bucket_append(EventQueue *queue, const Event *event);
+static int event_bucket_take(EventQueue *queue, Event *event);
+static EventNode **event_index_slot(EventQueue *queue, const Event *event);
+static int event_same_key(const Event *a, const Event *b);
+static int event_queue_has_events(EventQueue *queue);
+static void event_queue_notify(EventQueue *queue);
+#ifdef EVENT_QUEUE_MPSC
+static void event_ring_drain(EventQueue *queue);
+#endif
 
 /**
  * Initializes an `Event` structure.
  *
- * Sets up an `Event` with the provided system, resource, status, priority, and amount.
+ * Sets up an `Event` with the provided system, resource, status, priority, and amount,
+ * counting a single occurrence.
  *
  * @param[out] event     Pointer to the `Event` to initialize.
  * @param[in]  system    Pointer to the `System` that generated the event.
@@ -20,35 +36,75 @@ void event_init(Event *event, System *system, Resource *resource, int status, in
     event->status = status;
     event->priority = priority;
     event->amount = amount;
+    event->count = 1;
+    STATS_START(event->created);
 }
 
 /**
  * Initializes the `EventQueue`.
  *
- * Sets up the queue for use, initializing any necessary data.
+ * Sets up one empty bucket per priority level and preallocates the first
+ * block of nodes so that pushing does not need to allocate until more keys
+ * are pending than the pool holds (see `event_pool_grow`). In MPSC mode the
+ * ring is allocated as well, otherwise the queue mutex is initialized. The
+ * condition variable the consumer sleeps on is set up in both modes.
  *
  * @param[out] queue  Pointer to the `EventQueue` to initialize.
  */
 void event_queue_init(EventQueue *queue) {
-    queue->head = NULL;
+    for (int i = 0; i < PRIORITY_LEVELS; i++) {
+        queue->buckets[i].head = NULL;
+        queue->buckets[i].tail = NULL;
+    }
+    for (int i = 0; i < EVENT_INDEX_SIZE; i++) {
+        queue->index[i] = NULL;
+    }
+    queue->free_list = NULL;
+    queue->blocks = NULL;
     queue->size = 0;
+    queue->clock = NULL;
+    event_pool_grow(queue);
+
+#ifdef EVENT_QUEUE_MPSC
+    queue->ring = malloc(sizeof(EventSlot) * EVENT_RING_SIZE);
+    if (queue->ring == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for EventQueue ring.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < EVENT_RING_SIZE; i++) {
+        atomic_init(&queue->ring[i].sequence, i);
+    }
+    queue->ring_head = 0;
+    atomic_init(&queue->ring_tail, 0);
+#else
     //Check if its null
     if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
         fprintf(stderr, "Error: Failed to initialize mutex for EventQueue.\n");
         exit(EXIT_FAILURE);
     }
+#endif
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // Timeouts are monotonic
+    atomic_init(&queue->consumer_waiting, 0);
+    if (pthread_mutex_init(&queue->wait_mutex, NULL) != 0 || pthread_cond_init(&queue->wait_cond, &attr) != 0) {
+        fprintf(stderr, "Error: Failed to initialize the wait condition for EventQueue.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_condattr_destroy(&attr);
 }
 
 /**
  * Cleans up the `EventQueue`.
  *
- * Frees all memory associated with the queue, including all nodes.
+ * Frees every pool block, which releases all nodes whether they are queued or free.
  *
  * @param[in,out] queue  Pointer to the `EventQueue` to clean.
  */
 void event_queue_clean(EventQueue *queue) {
-    EventNode *current = queue->head;
-    EventNode *next;
+    EventPoolBlock *current = queue->blocks;
+    EventPoolBlock *next;
 
     while (current != NULL) {
         next = current->next;
@@ -56,47 +112,102 @@ void event_queue_clean(EventQueue *queue) {
         current = next;
     }
 
-    queue->head = NULL;
+    for (int i = 0; i < PRIORITY_LEVELS; i++) {
+        queue->buckets[i].head = NULL;
+        queue->buckets[i].tail = NULL;
+    }
+    for (int i = 0; i < EVENT_INDEX_SIZE; i++) {
+        queue->index[i] = NULL;
+    }
+    queue->free_list = NULL;
+    queue->blocks = NULL;
     queue->size = 0;
 
+#ifdef EVENT_QUEUE_MPSC
+    free(queue->ring);
+    queue->ring = NULL;
+#else
     pthread_mutex_destroy(&queue->mutex);  // Destroy the mutex, ensure no memory leak
+#endif
+    pthread_cond_destroy(&queue->wait_cond);
+    pthread_mutex_destroy(&queue->wait_mutex);
 }
 
 
 /**
  * Pushes an `Event` onto the `EventQueue`.
  *
- * Adds the event to the queue in priority order (highest priority first).
+ * Events of equal priority keep their arrival order. An event with the same
+ * system, resource and status as one still pending is folded into it rather
+ * than queued again. In the mutex build the event goes straight into the
+ * bucket of its priority. In MPSC mode the producer first tries to fold the
+ * event into the one its system has marked in the ring, with a single
+ * compare-and-swap on `System.ring_marked` and without taking a slot; only
+ * another key, or a marked event the manager already drained, takes a slot.
+ * A slot is reserved with an atomic increment and published; if the ring is
+ * full the producer yields until the manager frees one. Either way a consumer
+ * sleeping in `event_queue_wait` is woken. In MPSC mode all events of a system
+ * must be pushed by one thread at a time, as its steps are.
  *
  * @param[in,out] queue  Pointer to the `EventQueue`.
  * @param[in]     event  Pointer to the `Event` to push onto the queue.
  */
 void event_queue_push(EventQueue *queue, const Event *event) {
-    pthread_mutex_lock(&queue->mutex);  // Lock the mutex
-    EventNode *new_node = malloc(sizeof(EventNode));
-    if (new_node == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed for EventNode.\n");
-        pthread_mutex_unlock(&queue->mutex);  // Unlock before exiting
-        exit(EXIT_FAILURE);
+#ifdef EVENT_QUEUE_MPSC
+    EventSlot *slot;
+    System *system = event->system;
+    int marked = atomic_load_explicit(&system->ring_marked, memory_order_acquire);
+
+    // A repeat of the marked event only bumps its count, until the manager drains it and clears the mark
+    while (marked > 0 && system->ring_resource == event->resource && system->ring_status == event->status) {
+        atomic_store_explicit(&system->ring_amount, event->amount, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&system->ring_marked, &marked, marked + event->count,
+                                                  memory_order_release, memory_order_acquire)) {
+            STATS_COUNT(STATS_EVENTS_PUSHED);
+            return;
+        }
+    }
+    int mark = (marked == 0);
+    if (mark) {
+        system->ring_resource = event->resource;
+        system->ring_status = event->status;
+        atomic_store_explicit(&system->ring_marked, 1, memory_order_relaxed); // Published with the slot
     }
 
-    new_node->event = *event;
-    new_node->next = NULL;
+    size_t pos = atomic_load_explicit(&queue->ring_tail, memory_order_relaxed);
 
-    if (queue->head == NULL || queue->head->event.priority < event->priority) {
-        new_node->next = queue->head;
-        queue->head = new_node;
-    } else {
-        EventNode *current = queue->head;
-        while (current->next != NULL && current->next->event.priority >= event->priority) {
-            current = current->next;
+    while (1) {
+        slot = &queue->ring[pos & (EVENT_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+        if (diff == 0) {
+            // Slot is free for this position, try to claim it
+            if (atomic_compare_exchange_weak_explicit(&queue->ring_tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Ring is full, let the manager catch up
+            sched_yield();
+            pos = atomic_load_explicit(&queue->ring_tail, memory_order_relaxed);
+        } else {
+            // Another producer claimed this position first
+            pos = atomic_load_explicit(&queue->ring_tail, memory_order_relaxed);
         }
-        new_node->next = current->next;
-        current->next = new_node;
     }
 
-    queue->size++;
+    slot->event = *event;
+    slot->marked = mark;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+#else
+    STATS_LOCK(&queue->mutex, STATS_HIST_QUEUE_LOCK);  // Lock the mutex
+    event_bucket_append(queue, event);
     pthread_mutex_unlock(&queue->mutex);  // Unlock the mutex
+#endif
+
+    STATS_COUNT(STATS_EVENTS_PUSHED);
+    event_queue_notify(queue);
 }
 
 
@@ -104,26 +215,316 @@ void event_queue_push(EventQueue *queue, const Event *event) {
 /**
  * Pops an `Event` from the `EventQueue`.
  *
- * Removes the highest priority event from the queue.
+ * Removes the oldest event of the highest non-empty priority. In MPSC mode
+ * everything published to the ring is first drained into the buckets, so
+ * priority ordering and coalescing are applied on the consumer side; only one
+ * thread may pop.
  *
  * @param[in,out] queue  Pointer to the `EventQueue`.
  * @param[out]    event  Pointer to the `Event` structure to store the popped event.
  * @return               Non-zero if an event was successfully popped; zero otherwise.
  */
 int event_queue_pop(EventQueue *queue, Event *event) {
-    pthread_mutex_lock(&queue->mutex);  // Lock the mutex
-    if (queue->head == NULL) {
-        pthread_mutex_unlock(&queue->mutex);  // Unlock before returning
-        return 0; // Queue is empty
-    }
+    int popped;
 
-    EventNode *node_to_remove = queue->head;
-    *event = node_to_remove->event;
+#ifdef EVENT_QUEUE_MPSC
+    event_ring_drain(queue);
+    popped = event_bucket_take(queue, event);
+#else
+    STATS_LOCK(&queue->mutex, STATS_HIST_QUEUE_LOCK);  // Lock the mutex
+    popped = event_bucket_take(queue, event);
+    pthread_mutex_unlock(&queue->mutex);  // Unlock the mutex
+#endif
 
-    queue->head = queue->head->next;
-    free(node_to_remove);
-    queue->size--;
+    return popped;
+}
 
+/**
+ * Pops up to `max` events from the `EventQueue` in one pass.
+ *
+ * Events come out in the same order repeated `event_queue_pop` calls would
+ * return them, but the queue mutex is taken only once for the whole batch,
+ * so the caller can handle them outside the critical section.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ * @param[out]    out    Array receiving the events.
+ * @param[in]     max    Capacity of `out`.
+ * @return               Number of events stored in `out` (0 if the queue was empty).
+ */
+int event_queue_pop_batch(EventQueue *queue, Event *out, int max) {
+    int popped = 0;
+
+#ifdef EVENT_QUEUE_MPSC
+    event_ring_drain(queue);
+    while (popped < max && event_bucket_take(queue, &out[popped])) {
+        popped++;
+    }
+#else
+    STATS_LOCK(&queue->mutex, STATS_HIST_QUEUE_LOCK);  // Lock the mutex once for the whole batch
+    while (popped < max && event_bucket_take(queue, &out[popped])) {
+        popped++;
+    }
     pthread_mutex_unlock(&queue->mutex);  // Unlock the mutex
-    return 1;
-}
\ No newline at end of file
+#endif
+
+    return popped;
+}
+
+/**
+ * Blocks the consumer until an event may be pending or `timeout_ms` has passed.
+ *
+ * Returns at once if events are already pending. The consumer announces itself in
+ * `consumer_waiting` before its final check and producers read it after publishing,
+ * so a push either is seen by the check or signals the consumer; no wakeup is lost
+ * and producers skip the signal entirely while the consumer is busy.
+ *
+ * @param[in,out] queue       Pointer to the `EventQueue`; only its single consumer may wait.
+ * @param[in]     timeout_ms  Longest time to sleep in milliseconds, 0 or less to only check.
+ */
+void event_queue_wait(EventQueue *queue, int timeout_ms) {
+    struct timespec deadline;
+
+    if (timeout_ms <= 0) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&queue->wait_mutex);
+    atomic_store(&queue->consumer_waiting, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!event_queue_has_events(queue)) {
+        // One wait is enough, a spurious wakeup just costs the caller an empty drain
+        pthread_cond_timedwait(&queue->wait_cond, &queue->wait_mutex, &deadline);
+    }
+    atomic_store(&queue->consumer_waiting, 0);
+    pthread_mutex_unlock(&queue->wait_mutex);
+}
+
+/**
+ * Tells whether the queue holds anything for the consumer.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ * @return               Non-zero if an event is in the buckets (or published to the ring).
+ */
+static int event_queue_has_events(EventQueue *queue) {
+    int has_events;
+
+#ifdef EVENT_QUEUE_MPSC
+    EventSlot *slot = &queue->ring[queue->ring_head & (EVENT_RING_SIZE - 1)];
+    has_events = queue->size > 0 ||
+                 atomic_load_explicit(&slot->sequence, memory_order_acquire) == queue->ring_head + 1;
+#else
+    STATS_LOCK(&queue->mutex, STATS_HIST_QUEUE_LOCK);
+    has_events = queue->size > 0;
+    pthread_mutex_unlock(&queue->mutex);
+#endif
+
+    return has_events;
+}
+
+/**
+ * Wakes the consumer if it sleeps in `event_queue_wait`; called after an event is published.
+ *
+ * Costs a fence and a load when the consumer is awake.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ */
+static void event_queue_notify(EventQueue *queue) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&queue->consumer_waiting, memory_order_relaxed)) {
+        pthread_mutex_lock(&queue->wait_mutex);
+        pthread_cond_signal(&queue->wait_cond);
+        pthread_mutex_unlock(&queue->wait_mutex);
+    }
+}
+
+/**
+ * Appends an `Event` to the bucket of its priority using a node from the free-list,
+ * or folds it into the pending event with the same key.
+ *
+ * Caller must own the buckets (hold the queue mutex, or be the MPSC consumer).
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ * @param[in]     event  Pointer to the `Event` to copy into the bucket.
+ */
+static void event_bucket_append(EventQueue *queue, const Event *event) {
+    EventNode **slot = event_index_slot(queue, event);
+
+    // Coalesce with a pending event of the same key, which keeps its place in line
+    for (EventNode *node = *slot; node != NULL; node = node->index_next) {
+        if (event_same_key(&node->event, event)) {
+            node->event.count += event->count;
+            node->event.amount = event->amount;
+            return;
+        }
+    }
+
+    if (queue->free_list == NULL) {
+        event_pool_grow(queue);
+    }
+
+    EventNode *new_node = queue->free_list;
+    queue->free_list = new_node->next;
+
+    new_node->event = *event;
+    new_node->next = NULL;
+    new_node->index_next = *slot;
+    *slot = new_node;
+
+    EventBucket *bucket = &queue->buckets[event_bucket_index(event->priority)];
+    if (bucket->tail == NULL) {
+        bucket->head = new_node;
+    } else {
+        bucket->tail->next = new_node;
+    }
+    bucket->tail = new_node;
+
+    queue->size++;
+}
+
+/**
+ * Removes the oldest event of the highest non-empty bucket and recycles its node.
+ *
+ * Caller must own the buckets (hold the queue mutex, or be the MPSC consumer).
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ * @param[out]    event  Pointer to the `Event` structure to store the removed event.
+ * @return               Non-zero if an event was removed; zero if all buckets are empty.
+ */
+static int event_bucket_take(EventQueue *queue, Event *event) {
+    for (int i = PRIORITY_LEVELS - 1; i >= 0; i--) {
+        EventBucket *bucket = &queue->buckets[i];
+        if (bucket->head == NULL) {
+            continue;
+        }
+
+        EventNode *node_to_remove = bucket->head;
+        *event = node_to_remove->event;
+
+        bucket->head = node_to_remove->next;
+        if (bucket->head == NULL) {
+            bucket->tail = NULL;
+        }
+
+        EventNode **link = event_index_slot(queue, &node_to_remove->event);
+        while (*link != node_to_remove) {
+            link = &(*link)->index_next;
+        }
+        *link = node_to_remove->index_next;
+        node_to_remove->next = queue->free_list;
+        queue->free_list = node_to_remove;
+        queue->size--;
+        return 1;
+    }
+
+    return 0;
+}
+
+#ifdef EVENT_QUEUE_MPSC
+/**
+ * Moves every published ring slot into the priority buckets in one pass.
+ *
+ * A marked event takes the repeats folded into it and clears its system's mark,
+ * so the next repeat is published again. Must only be called by the single consumer of the queue.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue` to drain.
+ */
+static void event_ring_drain(EventQueue *queue) {
+    while (1) {
+        size_t pos = queue->ring_head;
+        EventSlot *slot = &queue->ring[pos & (EVENT_RING_SIZE - 1)];
+
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != pos + 1) {
+            return; // Nothing (more) published
+        }
+
+        if (slot->marked) {
+            System *system = slot->event.system;
+            int folded = atomic_exchange_explicit(&system->ring_marked, 0, memory_order_acq_rel) - 1;
+            if (folded > 0) {
+                slot->event.count += folded;
+                slot->event.amount = atomic_load_explicit(&system->ring_amount, memory_order_relaxed);
+            }
+        }
+        event_bucket_append(queue, &slot->event);
+        atomic_store_explicit(&slot->sequence, pos + EVENT_RING_SIZE, memory_order_release);
+        queue->ring_head = pos + 1;
+    }
+}
+#endif
+
+/**
+ * Adds a block of `EVENT_POOL_BLOCK` nodes to the queue's free-list.
+ *
+ * Besides `event_queue_init`, this is only reached when more distinct keys are
+ * pending than the pool has ever held. It is the deliberate exception to pushes
+ * never allocating: growing keeps an event from being lost, and the pool is sized
+ * by the high-water mark of pending keys, so it happens a few times per run at most.
+ *
+ * Caller must own the buckets (hold the queue mutex, or be the MPSC consumer).
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue` whose pool is grown.
+ */
+static void event_pool_grow(EventQueue *queue) {
+    EventPoolBlock *block = malloc(sizeof(EventPoolBlock));
+    if (block == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for EventNode pool.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < EVENT_POOL_BLOCK - 1; i++) {
+        block->nodes[i].next = &block->nodes[i + 1];
+    }
+    block->nodes[EVENT_POOL_BLOCK - 1].next = queue->free_list;
+    queue->free_list = &block->nodes[0];
+
+    block->next = queue->blocks;
+    queue->blocks = block;
+}
+
+/**
+ * Finds the `EventQueue.index` chain for the key of an event.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ * @param[in]     event  Event whose system, resource and status are hashed.
+ * @return               Address of the head of the chain.
+ */
+static EventNode **event_index_slot(EventQueue *queue, const Event *event) {
+    size_t hash = ((size_t)event->system >> 4) * 31 + ((size_t)event->resource >> 4) * 17 + (size_t)(event->status + 1);
+    return &queue->index[hash & (EVENT_INDEX_SIZE - 1)];
+}
+
+/**
+ * Tells whether two events report the same condition.
+ *
+ * @param[in] a  First event.
+ * @param[in] b  Second event.
+ * @return       Non-zero if system, resource and status all match.
+ */
+static int event_same_key(const Event *a, const Event *b) {
+    return a->system == b->system && a->resource == b->resource && a->status == b->status;
+}
+
+/**
+ * Maps a priority to its bucket, clamping values outside `PRIORITY_LOW`..`PRIORITY_HIGH`.
+ *
+ * @param[in] priority  Priority of the event.
+ * @return              Index into `EventQueue.buckets`.
+ */
+static int event_bucket_index(int priority) {
+    int index = priority - PRIORITY_LOW;
+    if (index < 0) {
+        return 0;
+    }
+    if (index >= PRIORITY_LEVELS) {
+        return PRIORITY_LEVELS - 1;
+    }
+    return index;
+}
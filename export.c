@@ -0,0 +1,350 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+// Helper functions just used by this C file to clean up our code
+static void export_open_ring(Exporter *exporter, const ResourceArray *resources, const SystemArray *systems);
+static void export_open_statsd(Exporter *exporter);
+static void export_publish(Exporter *exporter, Manager *manager, SnapshotFrame *frame);
+static void export_write_slot(Exporter *exporter, Manager *manager, const SnapshotFrame *frame);
+static void export_send_metrics(Exporter *exporter, Manager *manager, const SnapshotFrame *frame);
+static void export_metric(Exporter *exporter, const char *group, const char *name, const char *suffix,
+                          unsigned long long value, const char *type);
+static void export_flush(Exporter *exporter);
+
+/**
+ * Initializes an `Exporter` that publishes nothing.
+ *
+ * Set `shm_name` and/or `statsd` before `manager_run` to publish.
+ *
+ * @param[out] exporter  Pointer to the `Exporter` to initialize.
+ */
+void export_init(Exporter *exporter) {
+    exporter->shm_name = NULL;
+    exporter->statsd = NULL;
+    exporter->interval = MANAGER_DISPLAY_INTERVAL;
+    exporter->next_due = 0;
+    exporter->ring = NULL;
+    exporter->ring_size = 0;
+    exporter->socket = -1;
+    exporter->packet_length = 0;
+    memset(exporter->sent, 0, sizeof(exporter->sent));
+    exporter->frames = 0;
+    exporter->dropped = 0;
+}
+
+/**
+ * Opens the shared-memory ring and the StatsD socket an `Exporter` is configured for.
+ *
+ * Does nothing if neither is configured. Everything a frame needs is set up here,
+ * so publishing afterwards makes at most one non-blocking `send` per datagram.
+ *
+ * @param[in,out] exporter   Pointer to the `Exporter`.
+ * @param[in]     resources  Resources every frame reports, in this order.
+ * @param[in]     systems    Systems every frame reports, in this order.
+ */
+void export_start(Exporter *exporter, const ResourceArray *resources, const SystemArray *systems) {
+    exporter->next_due = 0;
+    exporter->frames = 0;
+    exporter->dropped = 0;
+    exporter->packet_length = 0;
+    memset(exporter->sent, 0, sizeof(exporter->sent));
+
+    if (exporter->shm_name != NULL) {
+        export_open_ring(exporter, resources, systems);
+    }
+    if (exporter->statsd != NULL) {
+        export_open_statsd(exporter);
+    }
+}
+
+/**
+ * Publishes a frame if one is due, every `interval` milliseconds of simulation time.
+ *
+ * Only the manager thread may call this. The frame is copied from the manager's
+ * snapshot, so the systems are never waited for, and the ring and the socket
+ * never make the manager wait either.
+ *
+ * @param[in,out] exporter  Pointer to the `Exporter`.
+ * @param[in]     manager   Manager whose snapshot and event counts are published.
+ * @param[out]    frame     Scratch copy of the frame.
+ * @param[in]     now       Current simulation time in milliseconds.
+ */
+void export_poll(Exporter *exporter, Manager *manager, SnapshotFrame *frame, unsigned long long now) {
+    if ((exporter->ring == NULL && exporter->socket < 0) || now < exporter->next_due) {
+        return;
+    }
+    exporter->next_due = now + exporter->interval;
+    export_publish(exporter, manager, frame);
+}
+
+/**
+ * Publishes the final frame and closes the StatsD socket and the mapping.
+ *
+ * The shared-memory object itself is left in place, so dashboards can still read
+ * the end of the run; its last frame has `running` cleared.
+ *
+ * @param[in,out] exporter  Pointer to the `Exporter`.
+ * @param[in]     manager   Manager whose snapshot and event counts are published.
+ * @param[out]    frame     Scratch copy of the frame.
+ */
+void export_stop(Exporter *exporter, Manager *manager, SnapshotFrame *frame) {
+    if (exporter->ring == NULL && exporter->socket < 0) {
+        return;
+    }
+
+    export_publish(exporter, manager, frame);
+    if (exporter->dropped > 0 && !manager->quiet) {
+        log_printf(LOG_LEVEL_INFO, "Telemetry export: %llu frames, %llu datagrams dropped.\n",
+                   exporter->frames, exporter->dropped);
+    }
+    if (exporter->socket >= 0) {
+        close(exporter->socket);
+        exporter->socket = -1;
+    }
+    if (exporter->ring != NULL) {
+        munmap(exporter->ring, exporter->ring_size);
+        exporter->ring = NULL;
+    }
+}
+
+/**
+ * Creates the shared-memory ring and writes everything in it that does not change during the run.
+ *
+ * @param[in,out] exporter   Pointer to the `Exporter` with `shm_name` set.
+ * @param[in]     resources  Resources every frame reports.
+ * @param[in]     systems    Systems every frame reports.
+ */
+static void export_open_ring(Exporter *exporter, const ResourceArray *resources, const SystemArray *systems) {
+    size_t string_size = 0;
+    for (int i = 0; i < resources->size; i++) {
+        string_size += strlen(resources->resources[i]->name) + 1;
+    }
+    for (int i = 0; i < systems->size; i++) {
+        string_size += strlen(systems->systems[i]->name) + 1;
+    }
+
+    size_t values = (size_t)resources->size + systems->size;
+    size_t slot_size = (sizeof(ExportSlot) + sizeof(atomic_int) * values + CACHE_LINE_SIZE - 1) &
+                       ~(size_t)(CACHE_LINE_SIZE - 1);
+    size_t capacity_offset = sizeof(ExportHeader);
+    size_t string_offset = capacity_offset + sizeof(int32_t) * resources->size;
+    size_t slot_offset = (string_offset + string_size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    size_t size = slot_offset + slot_size * EXPORT_SLOTS;
+
+    int fd = shm_open(exporter->shm_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+        fprintf(stderr, "Error: Cannot create shared memory %s: %s.\n", exporter->shm_name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map shared memory %s.\n", exporter->shm_name);
+        exit(EXIT_FAILURE);
+    }
+
+    // ftruncate zeroed the object, so every slot starts with sequence 0 and head is 0
+    ExportHeader *header = (ExportHeader *)base;
+    memcpy(header->magic, EXPORT_MAGIC, sizeof(header->magic));
+    header->version = EXPORT_VERSION;
+    header->resource_count = (uint32_t)resources->size;
+    header->system_count = (uint32_t)systems->size;
+    header->slot_count = EXPORT_SLOTS;
+    header->slot_size = (uint32_t)slot_size;
+    header->interval = (uint32_t)exporter->interval;
+    header->capacity_offset = capacity_offset;
+    header->string_offset = string_offset;
+    header->slot_offset = slot_offset;
+
+    int32_t *capacities = (int32_t *)(base + capacity_offset);
+    char *strings = base + string_offset;
+    for (int i = 0; i < resources->size; i++) {
+        capacities[i] = resources->resources[i]->max_capacity;
+        size_t length = strlen(resources->resources[i]->name) + 1;
+        memcpy(strings, resources->resources[i]->name, length);
+        strings += length;
+    }
+    for (int i = 0; i < systems->size; i++) {
+        size_t length = strlen(systems->systems[i]->name) + 1;
+        memcpy(strings, systems->systems[i]->name, length);
+        strings += length;
+    }
+
+    exporter->ring = header;
+    exporter->ring_size = size;
+}
+
+/**
+ * Opens a non-blocking UDP socket connected to the StatsD sink in `statsd`.
+ *
+ * @param[in,out] exporter  Pointer to the `Exporter` with `statsd` set as HOST:PORT.
+ */
+static void export_open_statsd(Exporter *exporter) {
+    char host[256];
+    const char *colon = strrchr(exporter->statsd, ':');
+    struct addrinfo hints;
+    struct addrinfo *address;
+
+    if (colon == NULL || colon == exporter->statsd || (size_t)(colon - exporter->statsd) >= sizeof(host)) {
+        fprintf(stderr, "Error: StatsD sink %s is not HOST:PORT.\n", exporter->statsd);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(host, exporter->statsd, colon - exporter->statsd);
+    host[colon - exporter->statsd] = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, colon + 1, &hints, &address) != 0) {
+        fprintf(stderr, "Error: Cannot resolve StatsD sink %s.\n", exporter->statsd);
+        exit(EXIT_FAILURE);
+    }
+    exporter->socket = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK, address->ai_protocol);
+    if (exporter->socket < 0 || connect(exporter->socket, address->ai_addr, address->ai_addrlen) != 0) {
+        fprintf(stderr, "Error: Cannot open StatsD sink %s: %s.\n", exporter->statsd, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    freeaddrinfo(address);
+}
+
+/**
+ * Copies the latest snapshot frame and publishes it to every configured sink.
+ *
+ * @param[in,out] exporter  Pointer to the `Exporter`.
+ * @param[in]     manager   Manager whose snapshot and event counts are published.
+ * @param[out]    frame     Scratch copy of the frame.
+ */
+static void export_publish(Exporter *exporter, Manager *manager, SnapshotFrame *frame) {
+    if (!snapshot_read(&manager->snapshot, frame)) {
+        return;
+    }
+
+    exporter->frames++;
+    if (exporter->ring != NULL) {
+        export_write_slot(exporter, manager, frame);
+    }
+    if (exporter->socket >= 0) {
+        export_send_metrics(exporter, manager, frame);
+    }
+}
+
+/**
+ * Writes a frame into the next slot of the shared-memory ring.
+ *
+ * The slot's `sequence` is odd while its values change, as in `snapshot_publish`,
+ * and `head` only moves on once the slot is complete. A reader lags behind only if
+ * `EXPORT_SLOTS` frames are written while it copies one.
+ *
+ * @param[in,out] exporter  Pointer to the `Exporter` with a ring.
+ * @param[in]     manager   Manager whose event counts are published.
+ * @param[in]     frame     The frame.
+ */
+static void export_write_slot(Exporter *exporter, Manager *manager, const SnapshotFrame *frame) {
+    ExportHeader *header = exporter->ring;
+    unsigned long long head = atomic_load_explicit(&header->head, memory_order_relaxed);
+    ExportSlot *slot = (ExportSlot *)((char *)header + header->slot_offset + header->slot_size * (head % header->slot_count));
+    unsigned int sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->running, frame->running, memory_order_relaxed);
+    atomic_store_explicit(&slot->frame, exporter->frames, memory_order_relaxed);
+    atomic_store_explicit(&slot->time, frame->time, memory_order_relaxed);
+    atomic_store_explicit(&slot->events_handled, manager->events_handled, memory_order_relaxed);
+    for (int s = 0; s < EXPORT_STATUSES; s++) {
+        atomic_store_explicit(&slot->events[s], manager->events_by_status[s], memory_order_relaxed);
+    }
+    for (int i = 0; i < frame->resource_count; i++) {
+        atomic_store_explicit(&slot->values[i], frame->amounts[i], memory_order_relaxed);
+    }
+    for (int i = 0; i < frame->system_count; i++) {
+        int status = frame->running ? frame->statuses[i] : TERMINATE;
+        atomic_store_explicit(&slot->values[frame->resource_count + i], status, memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&header->head, head + 1, memory_order_release);
+}
+
+/**
+ * Sends a frame to the StatsD sink as gauges and counters, batched into as few datagrams as fit.
+ *
+ * Amounts and statuses are gauges, events are counters of the increase since the
+ * last frame. Names become `cuinspace.resource.<name>`, `cuinspace.system.<name>.status`
+ * and `cuinspace.events.<status>`, with anything but letters, digits, `-` and `_` replaced by `_`.
+ *
+ * @param[in,out] exporter  Pointer to the `Exporter` with a socket.
+ * @param[in]     manager   Manager whose systems, resources and event counts are published.
+ * @param[in]     frame     The frame.
+ */
+static void export_send_metrics(Exporter *exporter, Manager *manager, const SnapshotFrame *frame) {
+    static const char *status_names[EXPORT_STATUSES] = {"empty", "low", "insufficient", "capacity"};
+
+    for (int i = 0; i < frame->resource_count && i < manager->resource_array.size; i++) {
+        export_metric(exporter, "resource", manager->resource_array.resources[i]->name, "",
+                      (unsigned long long)frame->amounts[i], "g");
+    }
+    for (int i = 0; i < frame->system_count && i < manager->system_array.size; i++) {
+        int status = frame->running ? frame->statuses[i] : TERMINATE;
+        export_metric(exporter, "system", manager->system_array.systems[i]->name, ".status",
+                      (unsigned long long)status, "g");
+    }
+    for (int s = 0; s < EXPORT_STATUSES; s++) {
+        export_metric(exporter, "events", status_names[s], "", manager->events_by_status[s] - exporter->sent[s], "c");
+        exporter->sent[s] = manager->events_by_status[s];
+    }
+    export_flush(exporter);
+}
+
+/**
+ * Appends one StatsD line to the pending datagram, sending the datagram first if the line does not fit.
+ *
+ * @param[in,out] exporter  Pointer to the `Exporter` with a socket.
+ * @param[in]     group     `resource`, `system` or `events`.
+ * @param[in]     name      Name of the resource, system or status.
+ * @param[in]     suffix    Appended to the name, may be empty.
+ * @param[in]     value     Value of the metric.
+ * @param[in]     type      StatsD type, `g` or `c`.
+ */
+static void export_metric(Exporter *exporter, const char *group, const char *name, const char *suffix,
+                          unsigned long long value, const char *type) {
+    char line[LOG_LINE_SIZE];
+    int length = snprintf(line, sizeof(line), "cuinspace.%s.", group);
+
+    for (const char *c = name; *c != '\0' && length < (int)sizeof(line) - 64; c++) {
+        int plain = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') ||
+                    *c == '-' || *c == '_';
+        line[length++] = plain ? *c : '_';
+    }
+    length += snprintf(line + length, sizeof(line) - length, "%s:%llu|%s\n", suffix, value, type);
+
+    if (exporter->packet_length + length > EXPORT_PACKET_SIZE) {
+        export_flush(exporter);
+    }
+    memcpy(exporter->packet + exporter->packet_length, line, length);
+    exporter->packet_length += length;
+}
+
+/**
+ * Sends the pending datagram without blocking; a datagram the kernel cannot take is dropped and counted.
+ *
+ * @param[in,out] exporter  Pointer to the `Exporter` with a socket.
+ */
+static void export_flush(Exporter *exporter) {
+    if (exporter->packet_length == 0) {
+        return;
+    }
+    if (send(exporter->socket, exporter->packet, exporter->packet_length, MSG_DONTWAIT) < 0) {
+        exporter->dropped++;
+    }
+    exporter->packet_length = 0;
+}
@@ -0,0 +1,358 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+// Process-wide console logger, like stdout itself there is exactly one
+static Logger logger;
+static atomic_int logger_started;       // Non-zero between log_start and log_stop
+
+// Helper functions just used by this C file to clean up our code
+static void *logger_thread_func(void *arg);
+static int logger_drain(Logger *log, int *flush);
+static void logger_append(Logger *log, const char *text, size_t length);
+static void logger_write(Logger *log);
+static void logger_wait(Logger *log, int timeout_ms);
+static void logger_push(int level, int flush, const char *text, int length);
+static unsigned long long logger_now_ms(void);
+static void log_stop_at_exit(void);
+
+/**
+ * Starts the logger thread; until then, and after `log_stop`, messages go straight to stdout.
+ *
+ * Pending messages are also written if the program ends through `exit`.
+ *
+ * @param[in] fd      Descriptor the logger writes to.
+ * @param[in] policy  `LOG_POLICY_BLOCK` or `LOG_POLICY_DROP`, used when the ring is full.
+ */
+void log_start(int fd, int policy) {
+    static atomic_int at_exit_registered;
+
+    logger.ring = malloc(sizeof(LogSlot) * LOG_RING_SIZE);
+    logger.buffer = malloc(LOG_BUFFER_SIZE);
+    if (logger.ring == NULL || logger.buffer == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the logger.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+        atomic_init(&logger.ring[i].sequence, i);
+    }
+    logger.ring_head = 0;
+    atomic_init(&logger.ring_tail, 0);
+    logger.fd = fd;
+    logger.used = 0;
+    atomic_init(&logger.policy, policy);
+    atomic_init(&logger.dropped, 0);
+    logger.reported = 0;
+    atomic_init(&logger.running, 1);
+    atomic_init(&logger.consumer_waiting, 0);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // Timeouts are monotonic
+    pthread_mutex_init(&logger.wait_mutex, NULL);
+    pthread_cond_init(&logger.wait_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    fflush(stdout); // Anything printed directly so far comes first
+    if (pthread_create(&logger.thread, NULL, logger_thread_func, &logger) != 0) {
+        fprintf(stderr, "Error: Failed to create the logger thread.\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_store(&logger_started, 1);
+
+    if (!atomic_exchange(&at_exit_registered, 1)) {
+        atexit(log_stop_at_exit);
+    }
+}
+
+/**
+ * Stops the logger thread after it has written every message already logged.
+ *
+ * No other thread may be logging any more, as at the end of `main`.
+ */
+void log_stop(void) {
+    if (!atomic_exchange(&logger_started, 0)) {
+        return;
+    }
+
+    atomic_store(&logger.running, 0);
+    pthread_mutex_lock(&logger.wait_mutex);
+    pthread_cond_signal(&logger.wait_cond);
+    pthread_mutex_unlock(&logger.wait_mutex);
+    pthread_join(logger.thread, NULL);
+
+    pthread_cond_destroy(&logger.wait_cond);
+    pthread_mutex_destroy(&logger.wait_mutex);
+    free(logger.ring);
+    free(logger.buffer);
+    logger.ring = NULL;
+    logger.buffer = NULL;
+}
+
+/**
+ * Changes what happens to messages logged while the ring is full.
+ *
+ * @param[in] policy  `LOG_POLICY_BLOCK` to wait for the logger thread, `LOG_POLICY_DROP`
+ *                    to drop (and count) everything below `LOG_LEVEL_CRITICAL`.
+ */
+void log_set_policy(int policy) {
+    atomic_store(&logger.policy, policy);
+}
+
+/**
+ * Logs a formatted message.
+ *
+ * The calling thread only formats the message and copies it into a ring slot;
+ * the logger thread does the writing. Messages longer than `LOG_LINE_SIZE` bytes are truncated. Critical
+ * messages are never dropped and are written out at once.
+ *
+ * @param[in] level   `LOG_LEVEL_DEBUG`, `LOG_LEVEL_INFO` or `LOG_LEVEL_CRITICAL`.
+ * @param[in] format  printf-style format.
+ */
+void log_printf(int level, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    if (atomic_load_explicit(&logger_started, memory_order_acquire)) {
+        char text[LOG_LINE_SIZE];
+        int length = vsnprintf(text, sizeof(text), format, args);
+        length = (length < 0) ? 0 : (length >= LOG_LINE_SIZE ? LOG_LINE_SIZE - 1 : length);
+        logger_push(level, level == LOG_LEVEL_CRITICAL, text, length);
+    } else {
+        vprintf(format, args);
+    }
+    va_end(args);
+}
+
+/**
+ * Marks the end of a group of messages, such as one display frame or one batch of events.
+ *
+ * The logger thread writes everything up to the mark with a single `write`
+ * instead of waiting for more messages to gather.
+ */
+void log_flush(void) {
+    if (atomic_load_explicit(&logger_started, memory_order_acquire)) {
+        logger_push(LOG_LEVEL_INFO, 1, "", 0); // An empty message carrying the flush mark
+    } else {
+        fflush(stdout);
+    }
+}
+
+/**
+ * Copies a formatted message into the next free ring slot, applying the drop policy when the ring is full.
+ *
+ * Slots are claimed like the MPSC event ring: a CAS on `ring_tail`, then the
+ * sequence of the slot is released to the consumer.
+ *
+ * @param[in] level   Level of the message.
+ * @param[in] flush   Non-zero to have the logger write out right after this message.
+ * @param[in] text    The message.
+ * @param[in] length  Bytes of the message, less than `LOG_LINE_SIZE`.
+ */
+static void logger_push(int level, int flush, const char *text, int length) {
+    LogSlot *slot;
+    size_t pos = atomic_load_explicit(&logger.ring_tail, memory_order_relaxed);
+
+    while (1) {
+        slot = &logger.ring[pos & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logger.ring_tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Ring is full: drop unless the policy or the level says to wait
+            if (level < LOG_LEVEL_CRITICAL && atomic_load_explicit(&logger.policy, memory_order_relaxed) == LOG_POLICY_DROP) {
+                atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+                return;
+            }
+            sched_yield();
+            pos = atomic_load_explicit(&logger.ring_tail, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&logger.ring_tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(slot->text, text, (size_t)length);
+    slot->length = length;
+    slot->flush = flush;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+    // Wake the logger thread if it sleeps, see logger_wait
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&logger.consumer_waiting, memory_order_relaxed)) {
+        pthread_mutex_lock(&logger.wait_mutex);
+        pthread_cond_signal(&logger.wait_cond);
+        pthread_mutex_unlock(&logger.wait_mutex);
+    }
+}
+
+/**
+ * Thread function of the logger.
+ *
+ * Gathers messages into one large buffer and writes it out when a flush mark
+ * arrives, the buffer fills up, or its oldest message is `LOG_FLUSH_INTERVAL` ms old.
+ *
+ * @param[in] arg  Pointer to the `Logger`.
+ * @return         NULL.
+ */
+static void *logger_thread_func(void *arg) {
+    Logger *log = (Logger *)arg;
+    unsigned long long pending_since = 0;   // When the buffer last went from empty to non-empty
+
+    while (1) {
+        int flush = 0;
+        int running = atomic_load(&log->running);
+        int was_empty = (log->used == 0);
+        int drained = logger_drain(log, &flush);
+        unsigned long long now = logger_now_ms();
+
+        if (was_empty && log->used > 0) {
+            pending_since = now;
+        }
+
+        unsigned long long dropped = atomic_load_explicit(&log->dropped, memory_order_relaxed);
+        if (dropped != log->reported) {
+            char note[64];
+            int length = snprintf(note, sizeof(note), "[log] %llu messages dropped\n", dropped - log->reported);
+            logger_append(log, note, (size_t)length);
+            log->reported = dropped;
+            flush = 1;
+        }
+
+        if (flush || (log->used > 0 && now - pending_since >= LOG_FLUSH_INTERVAL)) {
+            logger_write(log);
+        }
+        if (!running && drained == 0) {
+            logger_write(log);
+            break;
+        }
+        if (drained == 0) {
+            int timeout = LOG_FLUSH_INTERVAL;
+            if (log->used > 0) {
+                timeout = (int)(pending_since + LOG_FLUSH_INTERVAL - now);
+            }
+            logger_wait(log, timeout);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Moves every published message from the ring into the write buffer.
+ *
+ * @param[in,out] log    Pointer to the `Logger`.
+ * @param[out]    flush  Set to non-zero if a drained message carried a flush mark.
+ * @return               Number of messages drained.
+ */
+static int logger_drain(Logger *log, int *flush) {
+    int drained = 0;
+
+    while (1) {
+        size_t pos = log->ring_head;
+        LogSlot *slot = &log->ring[pos & (LOG_RING_SIZE - 1)];
+
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != pos + 1) {
+            return drained;
+        }
+
+        logger_append(log, slot->text, (size_t)slot->length);
+        *flush |= slot->flush;
+        atomic_store_explicit(&slot->sequence, pos + LOG_RING_SIZE, memory_order_release);
+        log->ring_head = pos + 1;
+        drained++;
+    }
+}
+
+/**
+ * Copies text into the write buffer, writing the buffer out first if it would overflow.
+ *
+ * @param[in,out] log     Pointer to the `Logger`.
+ * @param[in]     text    Text to append.
+ * @param[in]     length  Bytes of text, at most `LOG_LINE_SIZE`.
+ */
+static void logger_append(Logger *log, const char *text, size_t length) {
+    if (log->used + length > LOG_BUFFER_SIZE) {
+        logger_write(log);
+    }
+    memcpy(log->buffer + log->used, text, length);
+    log->used += length;
+}
+
+/**
+ * Writes the whole buffer with as few `write` calls as the descriptor allows, normally one.
+ *
+ * @param[in,out] log  Pointer to the `Logger`.
+ */
+static void logger_write(Logger *log) {
+    size_t written = 0;
+
+    while (written < log->used) {
+        ssize_t result = write(log->fd, log->buffer + written, log->used - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // Nowhere to report it, the console itself is gone
+        }
+        written += (size_t)result;
+    }
+    log->used = 0;
+}
+
+/**
+ * Sleeps until a message is published, the logger is stopped, or `timeout_ms` passes.
+ *
+ * Same handshake as `event_queue_wait`: announce, fence, re-check, then sleep.
+ *
+ * @param[in,out] log         Pointer to the `Logger`.
+ * @param[in]     timeout_ms  Longest time to sleep in milliseconds.
+ */
+static void logger_wait(Logger *log, int timeout_ms) {
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += (long)timeout_ms * 1000000L;
+    while (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&log->wait_mutex);
+    atomic_store(&log->consumer_waiting, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    LogSlot *slot = &log->ring[log->ring_head & (LOG_RING_SIZE - 1)];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != log->ring_head + 1 && atomic_load(&log->running)) {
+        pthread_cond_timedwait(&log->wait_cond, &log->wait_mutex, &deadline);
+    }
+    atomic_store(&log->consumer_waiting, 0);
+    pthread_mutex_unlock(&log->wait_mutex);
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Milliseconds since an arbitrary fixed point.
+ */
+static unsigned long long logger_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000ULL + (unsigned long long)now.tv_nsec / 1000000ULL;
+}
+
+/**
+ * `atexit` hook, writes out whatever was logged before an `exit` from anywhere in the program.
+ */
+static void log_stop_at_exit(void) {
+    log_stop();
+}
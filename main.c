@@ -3,36 +3,226 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
+
+// Command line options that are not settings of the Manager itself
+typedef struct Options {
+    const char *scenario_path;      // Scenario to load instead of the built-in data, or NULL
+    const char *compile_output;     // Compile the scenario to this file and exit, or NULL
+    int batch;                      // Missions of the scenario to run as a batch, 0 for one interactive run
+    double spread;                  // Variation of the batch missions, see scenario_jitter
+    unsigned long long seed;        // Seed of the batch variation
+    const char *restore_path;       // Checkpoint the run, or every mission of the batch, continues from, or NULL
+} Options;
 
 void load_data(Manager *manager);
+static void parse_args(Manager *manager, Options *options, int argc, char *argv[]);
+static void usage(const char *program);
 
 /**
  * Main entry point for the simulation.
  *
  * Initializes the manager, loads data, runs the simulation, and cleans up resources.
+ *
+ * Usage: cuinspace [--workers N] [--virtual] [--engine events|soa] [--event-interval MS]
+ *                  [--scenario FILE] [--telemetry FILE] [--trace FILE] [--log-policy block|drop] [--control]
+ *                  [--partition] [--export-shm NAME] [--export-statsd HOST:PORT] [--export-interval MS]
+ *                  [--checkpoint MS FILE] [--restore FILE]
+ *        cuinspace --scenario FILE --compile OUTPUT
+ *        cuinspace --scenario FILE --batch N [--spread F] [--seed S] [--workers N] [--control] [--engine events|soa]
+ *                  [--restore FILE]
  */
-int main(void) {
+int main(int argc, char *argv[]) {
     Manager manager;
+    Options options = {NULL, NULL, 0, 0.0, 1, NULL};
+    Scenario scenario;
+    Checkpoint checkpoint;
+
+    // Console output goes through the logger thread so systems never block on stdout
+    log_start(STDOUT_FILENO, LOG_POLICY_BLOCK);
+    STATS_INIT(); // SIGUSR1 prints the stats while running, in builds with make STATS=on
 
     // Step 1: Initialize the manager
-    printf("Debug: Initializing manager...\n");
+    LOG_DEBUG("Initializing manager...\n");
     manager_init(&manager);
+    parse_args(&manager, &options, argc, argv);
+
+    if (options.compile_output != NULL) {
+        scenario_load(&scenario, options.scenario_path);
+        scenario_write(&scenario, options.compile_output);
+        log_printf(LOG_LEVEL_INFO, "Compiled %s (%u resources, %u systems) into %s.\n", options.scenario_path,
+               scenario.header->resource_count, scenario.header->system_count, options.compile_output);
+        scenario_free(&scenario);
+        manager_clean(&manager);
+        log_stop();
+        return 0;
+    }
+
+    if (options.batch > 0) {
+        Batch batch;
+        scenario_load(&scenario, options.scenario_path);
+        batch_init(&batch, &scenario, options.batch);
+        batch.spread = options.spread;
+        batch.seed = options.seed;
+        batch.control = manager.controller.enabled;
+        batch.engine = manager.engine;
+        if (options.restore_path != NULL) {
+            checkpoint_load(&checkpoint, options.restore_path); // One read-only mapping shared by every mission
+            batch.checkpoint = &checkpoint;
+        }
+        batch_run(&batch, manager.worker_count);
+        batch_print(&batch);
+        batch_clean(&batch);
+        if (options.restore_path != NULL) {
+            checkpoint_free(&checkpoint);
+        }
+        scenario_free(&scenario);
+        manager_clean(&manager);
+        log_stop();
+        return 0;
+    }
 
     // Step 2: Load the data into the simulation
-    printf("Debug: Loading data into the manager...\n");
-    load_data(&manager);
+    LOG_DEBUG("Loading data into the manager...\n");
+    if (options.scenario_path != NULL) {
+        scenario_load(&scenario, options.scenario_path);
+        scenario_apply(&scenario, &manager);
+        scenario_free(&scenario);
+    } else {
+        load_data(&manager);
+    }
+    if (options.restore_path != NULL) {
+        checkpoint_load(&checkpoint, options.restore_path);
+        manager_restore(&manager, &checkpoint);
+    }
 
     // Step 3: Start and manage the simulation
-    printf("Debug: Starting simulation...\n");
+    LOG_DEBUG("Starting simulation...\n");
     manager_run(&manager);
+    STATS_DUMP(stderr);
+    if (options.restore_path != NULL) {
+        checkpoint_free(&checkpoint);
+    }
 
     // Step 4: Clean up resources and terminate
-    printf("Debug: Cleaning up resources...\n");
+    LOG_DEBUG("Cleaning up resources...\n");
     manager_clean(&manager);
+    log_stop();
 
     return 0;
 }
 
+/**
+ * Applies command line options to the manager.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to configure.
+ * @param[out]    options  Options handled by `main` itself.
+ * @param[in]     argc     Argument count from `main`.
+ * @param[in]     argv     Argument vector from `main`.
+ */
+static void parse_args(Manager *manager, Options *options, int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            manager->worker_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--virtual") == 0) {
+            manager_set_virtual_time(manager, 1);
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "events") == 0) {
+                manager->engine = MANAGER_ENGINE_EVENTS;
+            } else if (strcmp(argv[i], "soa") == 0) {
+                manager->engine = MANAGER_ENGINE_SOA;
+            } else {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--event-interval") == 0 && i + 1 < argc) {
+            manager->event_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            options->scenario_path = argv[++i];
+        } else if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc) {
+            options->compile_output = argv[++i];
+        } else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            manager->telemetry = fopen(argv[++i], "w");
+            if (manager->telemetry == NULL) {
+                fprintf(stderr, "Error: Cannot open telemetry file %s.\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            options->batch = atoi(argv[++i]);
+            if (options->batch < 1) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--spread") == 0 && i + 1 < argc) {
+            options->spread = atof(argv[++i]);
+            if (options->spread < 0.0 || options->spread > 1.0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options->seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--export-shm") == 0 && i + 1 < argc) {
+            manager->exporter.shm_name = argv[++i];
+        } else if (strcmp(argv[i], "--export-statsd") == 0 && i + 1 < argc) {
+            manager->exporter.statsd = argv[++i];
+        } else if (strcmp(argv[i], "--export-interval") == 0 && i + 1 < argc) {
+            manager->exporter.interval = atoi(argv[++i]);
+            if (manager->exporter.interval < 1) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 2 < argc) {
+            unsigned long long at = strtoull(argv[++i], NULL, 10);
+            manager_checkpoint(manager, at, argv[++i]);
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            options->restore_path = argv[++i];
+        } else if (strcmp(argv[i], "--partition") == 0) {
+            manager->partition = 1;
+        } else if (strcmp(argv[i], "--control") == 0) {
+            manager->controller.enabled = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            manager->trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--log-policy") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "block") == 0) {
+                log_set_policy(LOG_POLICY_BLOCK);
+            } else if (strcmp(argv[i], "drop") == 0) {
+                log_set_policy(LOG_POLICY_DROP);
+            } else {
+                usage(argv[0]);
+            }
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if ((options->compile_output != NULL || options->batch > 0) && options->scenario_path == NULL) {
+        usage(argv[0]);
+    }
+    // Checkpoints are taken and restored against the virtual clock only, batch missions always run on it
+    if ((manager->checkpoint_path != NULL && (options->batch > 0 || !manager->clock.is_virtual)) ||
+        (options->restore_path != NULL && options->batch == 0 && !manager->clock.is_virtual)) {
+        usage(argv[0]);
+    }
+    if (manager->worker_count < 1) {
+        manager->worker_count = 1;
+    }
+}
+
+/**
+ * Prints the command line usage and exits.
+ *
+ * @param[in] program  Name the program was started with.
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--workers N] [--virtual] [--engine events|soa] [--event-interval MS]\n"
+                    "       %*s [--scenario FILE] [--telemetry FILE] [--trace FILE] [--log-policy block|drop] [--control]\n"
+                    "       %*s [--partition] [--export-shm NAME] [--export-statsd HOST:PORT] [--export-interval MS]\n"
+                    "       %*s [--virtual --checkpoint MS FILE] [--virtual --restore FILE]\n", program, (int)strlen(program), "",
+                    (int)strlen(program), "", (int)strlen(program), "");
+    fprintf(stderr, "       %s --scenario FILE --compile OUTPUT\n", program);
+    fprintf(stderr, "       %s --scenario FILE --batch N [--spread F] [--seed S] [--workers N] [--control] [--engine events|soa]\n"
+                    "       %*s [--restore FILE]\n", program, (int)strlen(program), "");
+    exit(EXIT_FAILURE);
+}
+
 /**
  * Loads sample data for the simulation.
  *
@@ -43,23 +233,23 @@ int main(void) {
 void load_data(Manager *manager) {
     Resource *fuel, *oxygen, *energy, *distance;
 
-    printf("Debug: Creating resources...\n");
+    LOG_DEBUG("Creating resources...\n");
 
     // Create resources
-    resource_create(&fuel, "Fuel", 1000, 1000);
-    printf("Debug: Created resource Fuel\n");
+    resource_create(&fuel, &manager->arena, "Fuel", 1000, 1000, RESOURCE_FLAG_CRITICAL);
+    LOG_DEBUG("Created resource Fuel\n");
 
-    resource_create(&oxygen, "Oxygen", 20, 50);
-    printf("Debug: Created resource Oxygen\n");
+    resource_create(&oxygen, &manager->arena, "Oxygen", 20, 50, RESOURCE_FLAG_CRITICAL);
+    LOG_DEBUG("Created resource Oxygen\n");
 
-    resource_create(&energy, "Energy", 30, 50);
-    printf("Debug: Created resource Energy\n");
+    resource_create(&energy, &manager->arena, "Energy", 30, 50, 0);
+    LOG_DEBUG("Created resource Energy\n");
 
-    resource_create(&distance, "Distance", 0, 5000);
-    printf("Debug: Created resource Distance\n");
+    resource_create(&distance, &manager->arena, "Distance", 0, 5000, 0);
+    LOG_DEBUG("Created resource Distance\n");
 
     // Add resources to ResourceArray
-    printf("Debug: Adding resources to ResourceArray...\n");
+    LOG_DEBUG("Adding resources to ResourceArray...\n");
     resource_array_add(&manager->resource_array, fuel);
     resource_array_add(&manager->resource_array, oxygen);
     resource_array_add(&manager->resource_array, energy);
@@ -69,47 +259,47 @@ void load_data(Manager *manager) {
     System *propulsion, *life_support, *crew_capsule, *generator;
 
     ResourceAmount consume_fuel, produce_distance;
-    printf("Debug: Initializing ResourceAmount for propulsion...\n");
+    LOG_DEBUG("Initializing ResourceAmount for propulsion...\n");
     resource_amount_init(&consume_fuel, fuel, 5);
     resource_amount_init(&produce_distance, distance, 25);
-    system_create(&propulsion, "Propulsion", consume_fuel, produce_distance, 50, &manager->event_queue);
+    system_create(&propulsion, &manager->arena, "Propulsion", consume_fuel, produce_distance, 50, &manager->event_queue);
 
     ResourceAmount consume_energy, produce_oxygen;
-    printf("Debug: Initializing ResourceAmount for life support...\n");
+    LOG_DEBUG("Initializing ResourceAmount for life support...\n");
     resource_amount_init(&consume_energy, energy, 7);
     resource_amount_init(&produce_oxygen, oxygen, 4);
-    system_create(&life_support, "Life Support", consume_energy, produce_oxygen, 10, &manager->event_queue);
+    system_create(&life_support, &manager->arena, "Life Support", consume_energy, produce_oxygen, 10, &manager->event_queue);
 
     ResourceAmount consume_oxygen, produce_none;
-    printf("Debug: Initializing ResourceAmount for crew capsule...\n");
-    printf("Debug: Oxygen Resource Pointer: %p, Name: %s, Amount: %d, Max: %d\n", 
+    LOG_DEBUG("Initializing ResourceAmount for crew capsule...\n");
+    LOG_DEBUG("Oxygen Resource Pointer: %p, Name: %s, Amount: %d, Max: %d\n", 
         (void *)oxygen, oxygen ? oxygen->name : "NULL", 
-        oxygen ? oxygen->amount : -1, oxygen ? oxygen->max_capacity : -1);
+        oxygen ? resource_get_amount(oxygen) : -1, oxygen ? oxygen->max_capacity : -1);
 
     if (oxygen == NULL) {
         fprintf(stderr, "Error: Oxygen resource is NULL before initializing ResourceAmount for crew capsule.\n");
         exit(EXIT_FAILURE);
     }
-    printf("Debug: Passing to resource_amount_init: Resource Pointer: %p\n", (void *)oxygen);
+    LOG_DEBUG("Passing to resource_amount_init: Resource Pointer: %p\n", (void *)oxygen);
     resource_amount_init(&consume_oxygen, oxygen, 1);
 
     produce_none.resource = NULL;
     produce_none.amount = 0;
 
-    system_create(&crew_capsule, "Crew", consume_oxygen, produce_none, 2, &manager->event_queue);
+    system_create(&crew_capsule, &manager->arena, "Crew", consume_oxygen, produce_none, 2, &manager->event_queue);
 
     ResourceAmount consume_fuel_energy, produce_energy;
-    printf("Debug: Initializing ResourceAmount for generator...\n");
+    LOG_DEBUG("Initializing ResourceAmount for generator...\n");
     resource_amount_init(&consume_fuel_energy, fuel, 5);
     resource_amount_init(&produce_energy, energy, 10);
-    system_create(&generator, "Generator", consume_fuel_energy, produce_energy, 20, &manager->event_queue);
+    system_create(&generator, &manager->arena, "Generator", consume_fuel_energy, produce_energy, 20, &manager->event_queue);
 
     // Add systems to the manager's system array
-    printf("Debug: Adding systems to SystemArray...\n");
+    LOG_DEBUG("Adding systems to SystemArray...\n");
     system_array_add(&manager->system_array, propulsion);
     system_array_add(&manager->system_array, life_support);
     system_array_add(&manager->system_array, crew_capsule);
     system_array_add(&manager->system_array, generator);
 
-    printf("Debug: Finished loading data into the manager.\n");
+    LOG_DEBUG("Finished loading data into the manager.\n");
 }
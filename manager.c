@@ -1,15 +1,33 @@
 #include "defs.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
 #include <unistd.h>
-#include <string.h>
+#include <time.h>
+
+// Static functions to display the simulation state
+static void display_simulation_state(Manager *manager, SnapshotFrame *frame);
+static void print_simulation_state(Manager *manager, const SnapshotFrame *frame);
+static void manager_publish(Manager *manager);
+static void manager_write_telemetry(Manager *manager, SnapshotFrame *frame);
 
-// Static function to display the simulation state
-static void display_simulation_state(Manager *manager);
+// Run queue of the virtual-time loop, each system is in it at most once
+typedef struct VirtualRunQueue {
+    System **systems;   // Circular buffer with room for every system
+    int capacity;
+    int head;
+    int count;
+} VirtualRunQueue;
 
-// Thread function for running a single system
-static void *system_thread_func(void *arg);
+// Static functions driving the simulation
+static void manager_run_virtual(Manager *manager);
+static void manager_run_engine(Manager *manager);
+static void manager_virtual_tick(Manager *manager, SnapshotFrame *frame, unsigned long long *next_telemetry);
+static void manager_finish_virtual(Manager *manager, SnapshotFrame *frame, const struct timespec *wall_start);
+static void virtual_run_queue_wake(System *system, void *context);
+static void manager_process_events(Manager *manager);
+static void manager_write_checkpoint(Manager *manager, TimerWheel *wheel);
 
 /**
  * Initializes the `Manager`.
@@ -17,30 +35,110 @@ static void *system_thread_func(void *arg);
  * Prepares the manager by initializing all arrays and the event queue.
  */
 void manager_init(Manager *manager) {
-    manager->simulation_running = 1; // Set simulation as running
+    atomic_init(&manager->simulation_running, 1); // Set simulation as running
+    manager->worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN); // One worker per core by default
+    if (manager->worker_count < 1) {
+        manager->worker_count = 1;
+    }
+    sim_clock_init(&manager->clock, 0); // Real time unless switched with manager_set_virtual_time
+    manager->event_interval = 0;
     system_array_init(&manager->system_array);
     resource_array_init(&manager->resource_array);
     event_queue_init(&manager->event_queue);
+    arena_init(&manager->arena, ARENA_BLOCK_SIZE);
+    snapshot_init(&manager->snapshot, 0, 0); // Resized by manager_run once the systems are known
+    manager->telemetry = NULL;
+    export_init(&manager->exporter);
+    manager->trace_path = NULL;
+    trace_init(&manager->trace);
+    controller_init(&manager->controller);
+    manager->engine = MANAGER_ENGINE_EVENTS;
+    manager->partition = 0;
+    manager->quiet = 0;
+    manager->events_handled = 0;
+    for (int s = 0; s < EXPORT_STATUSES; s++) {
+        manager->events_by_status[s] = 0;
+    }
+    manager->depleted = NULL;
+    manager->checkpoint_path = NULL;
+    manager->checkpoint_at = 0;
+    manager->restore = NULL;
+    manager->event_queue.clock = &manager->clock;
+}
+
+/**
+ * Switches the `Manager` between real time and the virtual clock.
+ *
+ * Must be called before `manager_run`.
+ *
+ * @param[in,out] manager     Pointer to the `Manager`.
+ * @param[in]     is_virtual  Non-zero to run as fast as possible against a virtual clock.
+ */
+void manager_set_virtual_time(Manager *manager, int is_virtual) {
+    sim_clock_init(&manager->clock, is_virtual);
+}
+
+/**
+ * Asks the next virtual-time run to write a checkpoint of itself.
+ *
+ * The image is written at the first point from `at` on where no system is halfway
+ * through a step, and the run goes on unchanged. Must be called before `manager_run`.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     at       Virtual time in milliseconds.
+ * @param[in]     path     Path of the checkpoint file; must outlive the run.
+ */
+void manager_checkpoint(Manager *manager, unsigned long long at, const char *path) {
+    manager->checkpoint_at = at;
+    manager->checkpoint_path = path;
+}
+
+/**
+ * Continues the next virtual-time run from a checkpoint instead of from the start.
+ *
+ * The manager must hold the scenario the checkpoint was taken from, as loaded
+ * before its run, and must not have run yet. Restoring only reads the image, so
+ * any number of managers may restore from one `Checkpoint` at the same time.
+ *
+ * @param[in,out] manager     Pointer to the virtual-time `Manager`.
+ * @param[in]     checkpoint  Pointer to the loaded `Checkpoint`; must outlive the run.
+ */
+void manager_restore(Manager *manager, const Checkpoint *checkpoint) {
+    checkpoint_apply(checkpoint, manager);
+    manager->restore = checkpoint;
 }
 
 /**
  * Cleans up the `Manager`.
  *
- * Frees resources, systems, and events.
+ * Frees resources, systems, and events. Systems and resources are destroyed first,
+ * then all of their memory goes back in one sweep over the arena.
  */
 void manager_clean(Manager *manager) {
     system_array_clean(&manager->system_array);
     resource_array_clean(&manager->resource_array);
     event_queue_clean(&manager->event_queue);
+    snapshot_clean(&manager->snapshot);
+    controller_clean(&manager->controller);
+    arena_clean(&manager->arena);
+    if (manager->telemetry != NULL) {
+        fclose(manager->telemetry);
+        manager->telemetry = NULL;
+    }
 }
 
 /**
  * Runs the simulation manager loop.
  *
- * Handles threads, processes events, and terminates the simulation if critical resources are depleted.
+ * Runs the systems on the scheduler's worker pool, processes events, and terminates
+ * the simulation if critical resources are depleted. With a virtual clock the
+ * simulation is run as a discrete-event loop on the calling thread instead, or by
+ * the tick engine with `MANAGER_ENGINE_SOA` when every system is simple and no
+ * trace, checkpoint or event rate limit is asked for.
  */
 void manager_run(Manager *manager) {
-    pthread_t threads[manager->system_array.size];
+    Scheduler scheduler;
+    SnapshotFrame frame;
 
     // Validate systems
     if (manager->system_array.size == 0) {
@@ -48,127 +146,514 @@ void manager_run(Manager *manager) {
         manager->simulation_running = 0;
         return;
     }
-// Create threads for each system
+
     for (int i = 0; i < manager->system_array.size; i++) {
-        System *system = manager->system_array.systems[i];
-        if (system == NULL) {
-            fprintf(stderr, "Error: System at index %d is NULL.\n", i);
-            continue; // Skip this system and proceed with the next
+        if (manager->system_array.systems[i] != NULL) {
+            manager->system_array.systems[i]->event_interval = manager->event_interval;
         }
+    }
+
+    snapshot_clean(&manager->snapshot);
+    snapshot_init(&manager->snapshot, manager->resource_array.size, manager->system_array.size);
+    export_start(&manager->exporter, &manager->resource_array, &manager->system_array);
 
-        if (pthread_create(&threads[i], NULL, system_thread_func, system) != 0) {
-            fprintf(stderr, "Error: Failed to create thread for system: %s.\n", system->name);
-            exit(EXIT_FAILURE);
+    controller_start(&manager->controller, manager->resource_array.size);
+    if (manager->trace_path != NULL) {
+        trace_start(&manager->trace, manager->trace_path, &manager->clock,
+                    &manager->resource_array, &manager->system_array);
+    }
+
+    if (manager->clock.is_virtual && manager->engine == MANAGER_ENGINE_SOA) {
+        if (manager->trace_path == NULL && manager->checkpoint_path == NULL && manager->restore == NULL &&
+            manager->event_interval == 0 && engine_supports(&manager->system_array)) {
+            manager_run_engine(manager);
+            return;
+        }
+        if (!manager->quiet) {
+            log_printf(LOG_LEVEL_INFO, "The tick engine needs simple, unsharded systems and no trace, checkpoint or event interval, using the event engine.\n");
         }
     }
-    
+    if (manager->clock.is_virtual) {
+        manager_run_virtual(manager);
+        trace_stop(&manager->trace);
+        return;
+    }
+    snapshot_frame_init(&frame, &manager->snapshot);
 
+    // Keep systems that share resources on one worker, so only truly shared amounts cross cores
+    if (manager->partition) {
+        int parts = (manager->worker_count < manager->system_array.size) ? manager->worker_count : manager->system_array.size;
+        int components = partition_systems(&manager->system_array, manager->resource_array.size, parts);
+        LOG_DEBUG("Partitioned %d systems (%d connected groups) over %d pinned workers, %d resources shared across workers.\n",
+                  manager->system_array.size, components, parts,
+                  partition_shared(&manager->system_array, manager->resource_array.size));
+        (void)components; // Only the debug build reports the partition
+    }
+
+    // Hand the systems to a fixed pool of worker threads
+    scheduler_start(&scheduler, &manager->system_array, manager->worker_count, &manager->simulation_running,
+                    manager->partition);
 
-    // Main manager loop
+    // Main manager loop, sleeps until an event arrives or the display or the controller is due
+    unsigned long long next_display = sim_clock_now(&manager->clock);
     while (manager->simulation_running) {
-        Event event;
-
-        // Process events if any exist
-        while (event_queue_pop(&manager->event_queue, &event)) {
-            printf("Event: [%s] Resource [%s] Status [%d] Priority [%d]\n",
-                   event.system->name,
-                   event.resource->name,
-                   event.status,
-                   event.priority);
-
-            // Critical condition: stop simulation if oxygen or fuel is empty
-            if (event.status == STATUS_EMPTY && 
-               (strcmp(event.resource->name, "Oxygen") == 0 || strcmp(event.resource->name, "Fuel") == 0)) {
-                printf("Critical resource [%s] depleted by system [%s].\n", event.resource->name, event.system->name);
-                manager->simulation_running = 0;
+        manager_process_events(manager);
+        manager_publish(manager);
+        STATS_POLL(stderr);
 
-               // Set all systems to TERMINATE
-               for (int i = 0; i < manager->system_array.size; i++) {
-                    System *system = manager->system_array.systems[i];
-                    if (system != NULL) {
-                        pthread_mutex_lock(&system->mutex); // Lock before writing
-                        system->status = TERMINATE;
-                        pthread_mutex_unlock(&system->mutex); // Unlock after writing
-                        printf("Debug: System %s status set to TERMINATE.\n", system->name);
-                    }
-                }
+        // Display simulation state periodically
+        unsigned long long now = sim_clock_now(&manager->clock);
+        controller_update(&manager->controller, &manager->system_array, now);
+        if (now >= next_display) {
+            display_simulation_state(manager, &frame);
+            next_display = now + MANAGER_DISPLAY_INTERVAL;
+            now = sim_clock_now(&manager->clock);
+        }
+        export_poll(&manager->exporter, manager, &frame, now);
 
+        unsigned long long wake = next_display;
+        if (manager->controller.enabled && manager->controller.next_update < wake) {
+            wake = manager->controller.next_update;
+        }
+        if ((manager->exporter.ring != NULL || manager->exporter.socket >= 0) && manager->exporter.next_due < wake) {
+            wake = manager->exporter.next_due;
+        }
+        if (manager->simulation_running && now < wake) {
+            event_queue_wait(&manager->event_queue, (int)(wake - now));
+        }
+    }
+
+    // Wait for the workers to finish their current steps
+    scheduler_stop(&scheduler);
+    trace_stop(&manager->trace);
+    manager_publish(manager);
+    manager_write_telemetry(manager, &frame);
+    export_stop(&manager->exporter, manager, &frame);
+    snapshot_frame_clean(&frame);
+}
+
+/**
+ * Runs the simulation against the virtual clock.
+ *
+ * Every system step runs on the calling thread. Instead of sleeping, the clock
+ * jumps straight to the next deadline on a timer wheel, so processing times, the
+ * `SYSTEM_WAIT_TIME` backoff and the `MANAGER_WAIT_TIME` poll cost no real time.
+ * Systems due on the same tick run in a fixed order, which makes runs deterministic.
+ * A run restored from a checkpoint starts from its timers and wait lists instead of
+ * with every system runnable, and a requested checkpoint is written between ticks.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to run.
+ */
+static void manager_run_virtual(Manager *manager) {
+    TimerWheel wheel;
+    TimerNode manager_tick;
+    SystemArray *systems = &manager->system_array;
+    VirtualRunQueue runnable;
+    SnapshotFrame frame;
+    struct timespec wall_start;
+    unsigned long long next_telemetry = 0;
+
+    runnable.systems = malloc(sizeof(System *) * systems->size);
+    if (runnable.systems == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the virtual run queue.\n");
+        exit(EXIT_FAILURE);
+    }
+    runnable.capacity = systems->size;
+    runnable.head = 0;
+    runnable.count = 0;
+    snapshot_frame_init(&frame, &manager->snapshot);
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    timer_wheel_init(&wheel, sim_clock_now(&manager->clock));
+    timer_node_init(&manager_tick, NULL); // The manager's poll is the only timer without an owner
+    for (int i = 0; i < systems->size; i++) {
+        if (systems->systems[i] != NULL) {
+            systems->systems[i]->wake = virtual_run_queue_wake;
+            systems->systems[i]->wake_context = &runnable;
+            if (manager->restore == NULL) {
+                virtual_run_queue_wake(systems->systems[i], &runnable);
+            }
+        }
+    }
+    if (manager->restore != NULL) {
+        checkpoint_schedule(manager->restore, manager, &wheel, &manager_tick);
+        manager->restore = NULL;
+    } else {
+        timer_wheel_add(&wheel, &manager_tick, wheel.now + MANAGER_WAIT_TIME);
+    }
+
+    while (manager->simulation_running) {
+        // Run every system that is due at the current tick, in FIFO order
+        while (runnable.count > 0 && manager->simulation_running) {
+            System *system = runnable.systems[runnable.head];
+            runnable.head = (runnable.head + 1) % runnable.capacity;
+            runnable.count--;
+
+            if (system_get_status(system) == TERMINATE) {
+                continue;
+            }
+
+            int delay = system_run(system);
+            if (delay == 0) {
+                virtual_run_queue_wake(system, &runnable);
+            } else if (delay > 0) {
+                timer_wheel_add(&wheel, &system->timer, wheel.now + delay);
+            }
+        }
+
+        // Only the manager's poll left: every system is blocked on a resource for good
+        if (wheel.count == 1 && runnable.count == 0 && manager->simulation_running) {
+            manager_process_events(manager);
+            if (runnable.count == 0 && manager->simulation_running) {
+                if (!manager->quiet) {
+                    log_printf(LOG_LEVEL_INFO, "All systems are blocked on resources, stopping the simulation.\n");
+                }
+                manager->simulation_running = 0;
                 break;
             }
         }
 
-        // Display simulation state periodically
-        display_simulation_state(manager);
-        usleep(MANAGER_WAIT_TIME * 1000);
+        // Between ticks no system is halfway through a step, the state is complete
+        if (manager->checkpoint_path != NULL && wheel.now >= manager->checkpoint_at &&
+            runnable.count == 0 && manager->simulation_running) {
+            manager_write_checkpoint(manager, &wheel);
+        }
+
+        // Jump to the next deadline
+        unsigned long long next = timer_wheel_next_expiry(&wheel);
+        if (next == TIMER_NEVER) {
+            break;
+        }
+        TimerNode *expired = timer_wheel_advance(&wheel, next);
+        sim_clock_set(&manager->clock, wheel.now);
+
+        while (expired != NULL) {
+            TimerNode *node = expired;
+            expired = expired->next;
+
+            if (node->owner == NULL) {
+                manager_virtual_tick(manager, &frame, &next_telemetry);
+                timer_wheel_add(&wheel, &manager_tick, wheel.now + MANAGER_WAIT_TIME);
+            } else {
+                virtual_run_queue_wake((System *)node->owner, &runnable);
+            }
+        }
     }
 
-    // Wait for threads to finish
-    for (int i = 0; i < manager->system_array.size; i++) {
-        pthread_join(threads[i], NULL);
+    free(runnable.systems);
+    manager_finish_virtual(manager, &frame, &wall_start);
+}
+
+/**
+ * Runs the simulation against the virtual clock with the struct-of-arrays tick engine.
+ *
+ * All systems are copied into an `Engine` and advanced together: every tick moves
+ * each system that is due, then the clock jumps to the next finished conversion or
+ * the manager's poll, whichever comes first. Passes over contiguous arrays replace
+ * the per-system steps of `manager_run_virtual`, which pays off with tens of
+ * thousands of systems. Shared resources are handed out in system order, so runs
+ * are deterministic, though not identical to the event engine's.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to run.
+ */
+static void manager_run_engine(Manager *manager) {
+    Engine engine;
+    SnapshotFrame frame;
+    struct timespec wall_start;
+    unsigned long long next_telemetry = 0;
+    unsigned long long now = sim_clock_now(&manager->clock);
+    unsigned long long next_tick = now + MANAGER_WAIT_TIME;
+
+    snapshot_frame_init(&frame, &manager->snapshot);
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    engine_init(&engine, &manager->resource_array, &manager->system_array);
+
+    while (manager->simulation_running) {
+        engine_step(&engine, now);
+
+        // Nothing is processing: every system is blocked on a resource for good
+        unsigned long long next = engine_next(&engine);
+        if (next == TIMER_NEVER) {
+            engine_sync(&engine);
+            manager_process_events(manager);
+            if (manager->simulation_running) {
+                if (!manager->quiet) {
+                    log_printf(LOG_LEVEL_INFO, "All systems are blocked on resources, stopping the simulation.\n");
+                }
+                manager->simulation_running = 0;
+            }
+            break;
+        }
+
+        // Jump to the next deadline, the manager's poll sees the amounts of the engine
+        if (next < next_tick) {
+            now = next;
+            sim_clock_set(&manager->clock, now);
+            continue;
+        }
+        now = next_tick;
+        sim_clock_set(&manager->clock, now);
+        engine_sync(&engine);
+        manager_virtual_tick(manager, &frame, &next_telemetry);
+        engine_sync(&engine);
+        next_tick = now + MANAGER_WAIT_TIME;
     }
+
+    engine_sync(&engine);
+    engine_clean(&engine);
+    manager_finish_virtual(manager, &frame, &wall_start);
 }
 
+/**
+ * Handles the manager's poll in virtual time: events, the controller, the snapshot and telemetry.
+ *
+ * @param[in,out] manager         Pointer to the `Manager`.
+ * @param[out]    frame           Scratch copy of the frame.
+ * @param[in,out] next_telemetry  Virtual time the next telemetry line is due.
+ */
+static void manager_virtual_tick(Manager *manager, SnapshotFrame *frame, unsigned long long *next_telemetry) {
+    unsigned long long now = sim_clock_now(&manager->clock);
+
+    manager_process_events(manager);
+    controller_update(&manager->controller, &manager->system_array, now);
+    manager_publish(manager);
+    STATS_POLL(stderr);
+    if (manager->telemetry != NULL && now >= *next_telemetry) {
+        manager_write_telemetry(manager, frame);
+        *next_telemetry = now + MANAGER_DISPLAY_INTERVAL;
+    }
+    export_poll(&manager->exporter, manager, frame, now);
+}
 
 /**
- * Thread function to run individual systems.
+ * Publishes the end of a virtual-time run and prints the final state and mission time.
  *
- * @param[in] arg  Pointer to the `System` to run.
- * @return         NULL.
+ * @param[in,out] manager     Pointer to the `Manager`.
+ * @param[in,out] frame       Scratch copy of the frame, cleaned here.
+ * @param[in]     wall_start  Wall clock at the start of the run.
  */
-static void *system_thread_func(void *arg) {
-    System *system = (System *)arg;
+static void manager_finish_virtual(Manager *manager, SnapshotFrame *frame, const struct timespec *wall_start) {
+    struct timespec wall_end;
 
-    while (1) {
-        pthread_mutex_lock(&system->mutex); // Lock before reading the status
-        if (system->status == TERMINATE) {
-            pthread_mutex_unlock(&system->mutex); // Unlock before breaking
-            break;
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    manager_publish(manager);
+    manager_write_telemetry(manager, frame);
+    export_stop(&manager->exporter, manager, frame);
+    if (!manager->quiet) {
+        snapshot_read(&manager->snapshot, frame);
+        print_simulation_state(manager, frame);
+        log_printf(LOG_LEVEL_INFO, "Virtual mission time: %llu ms (%.3f s wall clock)\n",
+               sim_clock_now(&manager->clock),
+               (double)(wall_end.tv_sec - wall_start->tv_sec) + (wall_end.tv_nsec - wall_start->tv_nsec) / 1e9);
+    }
+    snapshot_frame_clean(frame);
+}
+
+/**
+ * Wake hook used in virtual mode, appends the system to the run queue of the current tick.
+ *
+ * @param[in,out] system   The `System` that can run again.
+ * @param[in]     context  Pointer to the `VirtualRunQueue`.
+ */
+static void virtual_run_queue_wake(System *system, void *context) {
+    VirtualRunQueue *queue = (VirtualRunQueue *)context;
+
+    queue->systems[(queue->head + queue->count) % queue->capacity] = system;
+    queue->count++;
+}
+
+/**
+ * Writes the requested checkpoint of a virtual-time run and lets the run go on.
+ *
+ * The wheel is drained to list its timers in expiry order and the queue to list its
+ * events in handling order; both are put back in that same order, the order a
+ * restored run rebuilds them in, so the two runs continue alike.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`, between two ticks.
+ * @param[in,out] wheel    The run's timer wheel.
+ */
+static void manager_write_checkpoint(Manager *manager, TimerWheel *wheel) {
+    unsigned long long now = wheel->now;
+    int capacity = MANAGER_EVENT_BATCH;
+    int count = 0;
+    int popped;
+    Event *events = malloc(sizeof(Event) * capacity);
+
+    if (events == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the checkpoint events.\n");
+        exit(EXIT_FAILURE);
+    }
+    while ((popped = event_queue_pop_batch(&manager->event_queue, events + count, capacity - count)) > 0) {
+        count += popped;
+        if (count == capacity) {
+            Event *grown = malloc(sizeof(Event) * capacity * 2);
+            if (grown == NULL) {
+                fprintf(stderr, "Error: Memory allocation failed for the checkpoint events.\n");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(grown, events, sizeof(Event) * count);
+            free(events);
+            events = grown;
+            capacity *= 2;
         }
-        pthread_mutex_unlock(&system->mutex); // Unlock after reading
+    }
+    TimerNode *timers = timer_wheel_advance(wheel, TIMER_NEVER);
 
-        system_run(system); // Continue running the system
+    checkpoint_write(manager->checkpoint_path, manager, timers, events, count);
+    if (!manager->quiet) {
+        log_printf(LOG_LEVEL_INFO, "Checkpoint written to %s at %llu ms.\n", manager->checkpoint_path, now);
     }
+    manager->checkpoint_path = NULL;
 
-    return NULL;
+    timer_wheel_init(wheel, now);
+    while (timers != NULL) {
+        TimerNode *node = timers;
+        timers = timers->next;
+        timer_wheel_add(wheel, node, node->expiry);
+    }
+    for (int e = 0; e < count; e++) {
+        event_queue_push(&manager->event_queue, &events[e]);
+    }
+    free(events);
 }
 
 /**
- * Displays the current simulation state.
+ * Handles every pending event.
+ *
+ * Prints each event, unless the manager is quiet, and stops the simulation when a
+ * critical resource is depleted. Once a critical resource is depleted, the remaining
+ * events are not handled. The lines of all handled batches are flushed to the console together.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` whose event queue is drained.
+ */
+static void manager_process_events(Manager *manager) {
+    Event events[MANAGER_EVENT_BATCH];
+    int count;
+
+    // Move pending events out in batches and handle them outside the queue lock
+    while (manager->simulation_running &&
+           (count = event_queue_pop_batch(&manager->event_queue, events, MANAGER_EVENT_BATCH)) > 0) {
+        for (int e = 0; e < count; e++) {
+            Event event = events[e];
+            STATS_COUNT(STATS_EVENTS_HANDLED);
+            STATS_RECORD(STATS_HIST_EVENT_LATENCY, event.created);
+            controller_observe(&manager->controller, &event);
+            manager->events_handled++;
+            if (event.status >= STATUS_EMPTY && event.status < EXPORT_STATUSES) {
+                manager->events_by_status[event.status] += (event.count > 0) ? event.count : 1;
+            }
+
+            if (!manager->quiet) {
+                if (event.count > 1) {
+                    log_printf(LOG_LEVEL_INFO, "Event: [%s] Resource [%s] Status [%d] Priority [%d] Count [%d]\n",
+                               event.system->name, event.resource->name, event.status, event.priority, event.count);
+                } else {
+                    log_printf(LOG_LEVEL_INFO, "Event: [%s] Resource [%s] Status [%d] Priority [%d]\n",
+                               event.system->name, event.resource->name, event.status, event.priority);
+                }
+            }
+
+            // Policy of the resource: a critical one running out stops the simulation
+            if (event.status == STATUS_LOW && (event.resource->flags & RESOURCE_FLAG_ALARM_LOW) && !manager->quiet) {
+                log_printf(LOG_LEVEL_CRITICAL, "Alarm: resource [%s] is low (%d / %d).\n",
+                           event.resource->name, event.amount, event.resource->max_capacity);
+            }
+            if (event.status == STATUS_EMPTY && (event.resource->flags & RESOURCE_FLAG_CRITICAL)) {
+                manager->depleted = event.resource;
+
+                // A single release store terminates every system before its next step
+                atomic_store_explicit(&manager->simulation_running, 0, memory_order_release);
+                if (!manager->quiet) {
+                    log_printf(LOG_LEVEL_CRITICAL, "Critical resource [%s] depleted by system [%s].\n",
+                               event.resource->name, event.system->name);
+                    LOG_DEBUG("Termination broadcast to all systems.\n");
+                }
+
+                break;
+            }
+        }
+    }
+    if (!manager->quiet) {
+        log_flush();
+    }
+}
+
+/**
+ * Publishes the current amounts and statuses to the manager's snapshot.
+ *
+ * Sharded resources are reconciled first, so the snapshot and the low reports
+ * follow them at the rate the manager polls.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+static void manager_publish(Manager *manager) {
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        resource_reconcile(manager->resource_array.resources[i]);
+    }
+    snapshot_publish(&manager->snapshot, &manager->resource_array, &manager->system_array,
+                     sim_clock_now(&manager->clock), atomic_load(&manager->simulation_running));
+}
+
+/**
+ * Writes the latest snapshot frame to the telemetry stream, if there is one.
  *
- * Outputs the statuses of all resources and systems to the console.
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[out]    frame    Scratch copy of the frame.
  */
-static void display_simulation_state(Manager *manager) {
-    static const int display_interval = 1;
-    static time_t last_display_time = 0;
+static void manager_write_telemetry(Manager *manager, SnapshotFrame *frame) {
+    if (manager->telemetry != NULL && snapshot_read(&manager->snapshot, frame)) {
+        snapshot_write_json(frame, &manager->resource_array, &manager->system_array, manager->telemetry);
+    }
+}
 
-    time_t current_time = time(NULL);
-    if (difftime(current_time, last_display_time) < display_interval) {
+/**
+ * Displays the current simulation state.
+ *
+ * Clears the console and outputs the latest snapshot frame, which is also written
+ * to the telemetry stream; the manager loop calls it every `MANAGER_DISPLAY_INTERVAL`
+ * milliseconds. Reading the snapshot never blocks a system.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[out]    frame    Scratch copy of the frame.
+ */
+static void display_simulation_state(Manager *manager, SnapshotFrame *frame) {
+    if (!snapshot_read(&manager->snapshot, frame)) {
         return;
     }
 
-    printf(ANSI_CLEAR ANSI_MV_TL);
-    printf("Current Resource Amounts:\n");
-    printf("-------------------------\n");
+    log_printf(LOG_LEVEL_INFO, ANSI_CLEAR ANSI_MV_TL);
+    print_simulation_state(manager, frame);
+    if (manager->telemetry != NULL) {
+        snapshot_write_json(frame, &manager->resource_array, &manager->system_array, manager->telemetry);
+    }
+}
 
-    for (int i = 0; i < manager->resource_array.size; i++) {
+/**
+ * Prints the statuses of all resources and systems of a snapshot frame to the console.
+ *
+ * All values come from the same frame, so they describe one moment of the simulation.
+ *
+ * @param[in] manager  Pointer to the `Manager`, for names and capacities.
+ * @param[in] frame    The frame to print.
+ */
+static void print_simulation_state(Manager *manager, const SnapshotFrame *frame) {
+    log_printf(LOG_LEVEL_INFO, "Current Resource Amounts:\n");
+    log_printf(LOG_LEVEL_INFO, "-------------------------\n");
+
+    for (int i = 0; i < frame->resource_count; i++) {
         Resource *resource = manager->resource_array.resources[i];
-        pthread_mutex_lock(&resource->mutex);
-        printf("%s: %d / %d\n", resource->name, resource->amount, resource->max_capacity);
-        pthread_mutex_unlock(&resource->mutex);
+        log_printf(LOG_LEVEL_INFO, "%s: %d / %d\n", resource->name, frame->amounts[i], resource->max_capacity);
     }
 
-    printf("\nSystem Statuses:\n");
-    printf("---------------\n");
+    log_printf(LOG_LEVEL_INFO, "\nSystem Statuses:\n");
+    log_printf(LOG_LEVEL_INFO, "---------------\n");
 
-    for (int i = 0; i < manager->system_array.size; i++) {
+    for (int i = 0; i < frame->system_count; i++) {
         System *system = manager->system_array.systems[i];
-        printf("%s: %s\n", system->name,
-               (system->status == TERMINATE) ? "TERMINATE" : "ACTIVE");
+        int terminated = !frame->running || frame->statuses[i] == TERMINATE;
+        log_printf(LOG_LEVEL_INFO, "%s: %s\n", system->name, terminated ? "TERMINATE" : "ACTIVE");
     }
 
-    printf("\n");
-    fflush(stdout);
-
-    last_display_time = current_time;
+    log_printf(LOG_LEVEL_INFO, "\n");
+    log_flush();
 }
-
@@ -0,0 +1,215 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// A connected group of systems and the resources they share
+typedef struct PartitionComponent {
+    int size;                   // Systems in it
+    int first;                  // Index of its first system in the search order
+} PartitionComponent;
+
+// Helper functions just used by this C file to clean up our code
+static int partition_compare(const void *a, const void *b);
+static int partition_lightest(const int *load, int parts);
+static const ResourceAmount *partition_term(const System *system, int term);
+
+/**
+ * Assigns every system a home worker so that systems sharing resources run on the same one.
+ *
+ * Systems only interact through the resources of their recipes, so the systems and
+ * resources form a graph whose connected components never touch each other's
+ * `Resource.amount`. The components are found with a breadth-first search over that
+ * graph, then placed largest first on the least loaded of `parts` workers. Hubs,
+ * resources with more users than an even share of the systems, cannot stay on one
+ * worker anyway and are not followed, so they do not glue every cluster into one.
+ * A component still larger than a share is cut into runs of one share each; the
+ * search lists neighbours next to each other, so the cuts fall between groups that
+ * share little.
+ *
+ * @param[in,out] systems         Systems whose `home` is set, in [0, parts).
+ * @param[in]     resource_count  Number of resources, ids must be below it.
+ * @param[in]     parts           Number of workers, at least 1.
+ * @return                        Number of connected components.
+ */
+int partition_systems(SystemArray *systems, int resource_count, int parts) {
+    int count = systems->size;
+    int share = (count + parts - 1) / parts;
+    int term_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        term_count += systems->systems[i]->consumed_count + systems->systems[i]->produced_count;
+    }
+
+    int *offsets = calloc(resource_count + 2, sizeof(int)); // Users of resource r are users[offsets[r]..offsets[r + 1])
+    int *users = malloc(sizeof(int) * (term_count + 1));
+    int *followed = calloc(resource_count + 1, sizeof(int)); // Non-zero once a resource was followed or is a hub
+    int *visited = calloc(count + 1, sizeof(int));
+    int *members = malloc(sizeof(int) * (count + 1));       // Systems in search order, grouped by component
+    int *load = calloc(parts + 1, sizeof(int));
+    PartitionComponent *components = malloc(sizeof(PartitionComponent) * (count + 1));
+
+    if (offsets == NULL || users == NULL || followed == NULL || visited == NULL || members == NULL ||
+        load == NULL || components == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the partition.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Users of every resource, counted then filled in place
+    for (int i = 0; i < count; i++) {
+        System *system = systems->systems[i];
+        for (int t = 0; t < system->consumed_count + system->produced_count; t++) {
+            offsets[partition_term(system, t)->resource->id + 2]++;
+        }
+    }
+    for (int r = 0; r < resource_count; r++) {
+        followed[r] = (offsets[r + 2] > share);
+        offsets[r + 2] += offsets[r + 1];
+    }
+    for (int i = 0; i < count; i++) {
+        System *system = systems->systems[i];
+        for (int t = 0; t < system->consumed_count + system->produced_count; t++) {
+            users[offsets[partition_term(system, t)->resource->id + 1]++] = i;
+        }
+    }
+
+    // Breadth-first search from every system not reached yet, `members` doubles as the queue
+    int component_count = 0;
+    int tail = 0;
+    for (int start = 0; start < count; start++) {
+        if (visited[start]) {
+            continue;
+        }
+        components[component_count].first = tail;
+        visited[start] = 1;
+        members[tail++] = start;
+        for (int head = components[component_count].first; head < tail; head++) {
+            System *system = systems->systems[members[head]];
+            for (int t = 0; t < system->consumed_count + system->produced_count; t++) {
+                int r = partition_term(system, t)->resource->id;
+                if (followed[r]) {
+                    continue;
+                }
+                followed[r] = 1;
+                for (int u = offsets[r]; u < offsets[r + 1]; u++) {
+                    if (!visited[users[u]]) {
+                        visited[users[u]] = 1;
+                        members[tail++] = users[u];
+                    }
+                }
+            }
+        }
+        components[component_count].size = tail - components[component_count].first;
+        component_count++;
+    }
+
+    // Largest components first, each onto the lightest worker; oversized ones in share-sized runs
+    qsort(components, component_count, sizeof(PartitionComponent), partition_compare);
+    for (int c = 0; c < component_count; c++) {
+        int worker = partition_lightest(load, parts);
+        int run = 0;
+        for (int m = 0; m < components[c].size; m++) {
+            if (components[c].size > share && run == share) {
+                worker = partition_lightest(load, parts);
+                run = 0;
+            }
+            systems->systems[members[components[c].first + m]]->home = worker;
+            load[worker]++;
+            run++;
+        }
+    }
+
+    free(offsets);
+    free(users);
+    free(followed);
+    free(visited);
+    free(members);
+    free(load);
+    free(components);
+    return component_count;
+}
+
+/**
+ * Counts the resources that systems on more than one worker use.
+ *
+ * @param[in] systems         Systems with their `home` set.
+ * @param[in] resource_count  Number of resources, ids must be below it.
+ * @return                    Number of resources shared across workers.
+ */
+int partition_shared(const SystemArray *systems, int resource_count) {
+    int *home = malloc(sizeof(int) * (resource_count + 1));
+    int shared = 0;
+
+    if (home == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the partition.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int r = 0; r < resource_count; r++) {
+        home[r] = -1;
+    }
+
+    // -2 marks a resource already counted as shared
+    for (int i = 0; i < systems->size; i++) {
+        const System *system = systems->systems[i];
+        for (int t = 0; t < system->consumed_count + system->produced_count; t++) {
+            int r = partition_term(system, t)->resource->id;
+            if (home[r] == -1) {
+                home[r] = system->home;
+            } else if (home[r] >= 0 && home[r] != system->home) {
+                home[r] = -2;
+                shared++;
+            }
+        }
+    }
+
+    free(home);
+    return shared;
+}
+
+/**
+ * Orders components by size, largest first, ties by their first system.
+ *
+ * @param[in] a  First `PartitionComponent`.
+ * @param[in] b  Second `PartitionComponent`.
+ * @return       Negative, zero or positive like `strcmp`.
+ */
+static int partition_compare(const void *a, const void *b) {
+    const PartitionComponent *left = (const PartitionComponent *)a;
+    const PartitionComponent *right = (const PartitionComponent *)b;
+
+    if (left->size != right->size) {
+        return (left->size > right->size) ? -1 : 1;
+    }
+    return (left->first > right->first) - (left->first < right->first);
+}
+
+/**
+ * Finds the worker with the fewest systems so far.
+ *
+ * @param[in] load   Systems per worker.
+ * @param[in] parts  Number of workers.
+ * @return           Index of the first least loaded worker.
+ */
+static int partition_lightest(const int *load, int parts) {
+    int lightest = 0;
+
+    for (int w = 1; w < parts; w++) {
+        if (load[w] < load[lightest]) {
+            lightest = w;
+        }
+    }
+    return lightest;
+}
+
+/**
+ * Returns a term of a system's recipe, inputs first, then outputs.
+ *
+ * @param[in] system  The `System`.
+ * @param[in] term    Index below `consumed_count + produced_count`.
+ * @return            The input or output.
+ */
+static const ResourceAmount *partition_term(const System *system, int term) {
+    if (term < system->consumed_count) {
+        return &system->consumed[term];
+    }
+    return &system->produced[term - system->consumed_count];
+}
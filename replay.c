@@ -0,0 +1,209 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REPLAY_OUTPUT_BUFFER (1 << 20)   // Bytes of stdout buffering, the timeline is written in large chunks
+
+// A mapped trace file and views of its tables
+typedef struct TraceFile {
+    void *base;
+    size_t size;
+    const TraceHeader *header;
+    const TraceResource *resources;
+    const uint32_t *system_names;     // Name offset per system
+    const char *strings;
+    const TraceRecord *records;
+} TraceFile;
+
+// Position of a record in the timeline
+typedef struct ReplayEntry {
+    uint64_t time;
+    uint64_t index;                   // Position in the file, keeps each system's records in order
+} ReplayEntry;
+
+static void replay_open(TraceFile *trace, const char *path);
+static int replay_compare(const void *a, const void *b);
+static void usage(const char *program);
+
+/**
+ * Entry point of the trace replay tool.
+ *
+ * Maps a trace recorded with `cuinspace --trace`, puts the records of all systems
+ * back into time order and replays them, rebuilding every resource amount from the
+ * amounts at the start of recording. Prints the timeline, or with `--summary` only
+ * the final amounts and record counts.
+ *
+ * Usage: cuinspace_replay [--summary] TRACE
+ */
+int main(int argc, char *argv[]) {
+    TraceFile trace;
+    const char *path = NULL;
+    int summary = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--summary") == 0) {
+            summary = 1;
+        } else if (path == NULL && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (path == NULL) {
+        usage(argv[0]);
+    }
+
+    replay_open(&trace, path);
+    const TraceHeader *header = trace.header;
+    uint64_t count = header->record_count;
+
+    // Systems flush their buffers independently, sort by time keeping each system's order
+    ReplayEntry *timeline = malloc(sizeof(ReplayEntry) * (count + 1));
+    int *amounts = malloc(sizeof(int) * (header->resource_count + 1));
+    if (timeline == NULL || amounts == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for the replay.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        timeline[i].time = trace.records[i].time;
+        timeline[i].index = i;
+    }
+    qsort(timeline, count, sizeof(ReplayEntry), replay_compare);
+    for (uint32_t i = 0; i < header->resource_count; i++) {
+        amounts[i] = trace.resources[i].amount;
+    }
+
+    setvbuf(stdout, NULL, _IOFBF, REPLAY_OUTPUT_BUFFER);
+    uint64_t events = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        const TraceRecord *record = &trace.records[timeline[i].index];
+        const char *system = trace.strings + trace.system_names[record->system];
+        const char *resource = trace.strings + trace.resources[record->resource].name_offset;
+
+        if (record->type == TRACE_EVENT) {
+            events++;
+            if (!summary) {
+                printf("%8llu ms  Event: [%s] Resource [%s] Status [%d] Priority [%d] Amount [%d]\n",
+                       (unsigned long long)record->time, system, resource,
+                       record->status, record->priority, record->amount);
+            }
+        } else {
+            amounts[record->resource] += record->amount;
+            if (!summary) {
+                printf("%8llu ms  [%s] %s %+d -> %d / %d\n", (unsigned long long)record->time, system, resource,
+                       record->amount, amounts[record->resource], trace.resources[record->resource].max_capacity);
+            }
+        }
+    }
+
+    printf("%llu records (%llu events, %llu amount changes), last at %llu ms\n",
+           (unsigned long long)count, (unsigned long long)events, (unsigned long long)(count - events),
+           (unsigned long long)((count > 0) ? timeline[count - 1].time : 0));
+    printf("Final resource amounts:\n");
+    for (uint32_t i = 0; i < header->resource_count; i++) {
+        printf("%s: %d / %d\n", trace.strings + trace.resources[i].name_offset, amounts[i], trace.resources[i].max_capacity);
+    }
+
+    free(timeline);
+    free(amounts);
+    munmap(trace.base, trace.size);
+    return 0;
+}
+
+/**
+ * Maps a trace file and checks that every table, offset and id stays in bounds.
+ *
+ * @param[out] trace  Pointer to the `TraceFile` to fill.
+ * @param[in]  path   Path of the trace file.
+ */
+static void replay_open(TraceFile *trace, const char *path) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error: Cannot open trace file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    trace->size = (size_t)info.st_size;
+    if (trace->size < sizeof(TraceHeader)) {
+        fprintf(stderr, "Error: %s is not a trace file.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    trace->base = mmap(NULL, trace->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (trace->base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map trace file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    const TraceHeader *header = (const TraceHeader *)trace->base;
+    size_t tables = sizeof(TraceHeader) + sizeof(TraceResource) * (size_t)header->resource_count
+                  + sizeof(uint32_t) * (size_t)header->system_count;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION ||
+        header->record_offset % 8 != 0 || header->record_offset < tables + header->string_size ||
+        header->record_offset > trace->size ||
+        header->record_count > (trace->size - header->record_offset) / sizeof(TraceRecord) ||
+        header->string_size == 0 || ((const char *)trace->base)[tables + header->string_size - 1] != '\0') {
+        fprintf(stderr, "Error: Trace file %s is corrupt, unfinished or from another version.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    trace->header = header;
+    trace->resources = (const TraceResource *)((const char *)trace->base + sizeof(TraceHeader));
+    trace->system_names = (const uint32_t *)(trace->resources + header->resource_count);
+    trace->strings = (const char *)trace->base + tables;
+    trace->records = (const TraceRecord *)((const char *)trace->base + header->record_offset);
+
+    for (uint32_t i = 0; i < header->resource_count; i++) {
+        if (trace->resources[i].name_offset >= header->string_size) {
+            fprintf(stderr, "Error: Trace file %s has a bad resource record %u.\n", path, i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (uint32_t i = 0; i < header->system_count; i++) {
+        if (trace->system_names[i] >= header->string_size) {
+            fprintf(stderr, "Error: Trace file %s has a bad system record %u.\n", path, i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (uint64_t i = 0; i < header->record_count; i++) {
+        const TraceRecord *record = &trace->records[i];
+        if (record->system >= header->system_count || record->resource >= header->resource_count ||
+            record->type > TRACE_AMOUNT) {
+            fprintf(stderr, "Error: Trace file %s has a bad record %llu.\n", path, (unsigned long long)i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Orders timeline entries by time, then by position in the file.
+ *
+ * @param[in] a  First `ReplayEntry`.
+ * @param[in] b  Second `ReplayEntry`.
+ * @return       Negative, zero or positive like `strcmp`.
+ */
+static int replay_compare(const void *a, const void *b) {
+    const ReplayEntry *left = (const ReplayEntry *)a;
+    const ReplayEntry *right = (const ReplayEntry *)b;
+
+    if (left->time != right->time) {
+        return (left->time < right->time) ? -1 : 1;
+    }
+    return (left->index < right->index) ? -1 : (left->index > right->index);
+}
+
+/**
+ * Prints the command line usage and exits.
+ *
+ * @param[in] program  Name the program was started with.
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--summary] TRACE\n", program);
+    exit(EXIT_FAILURE);
+}
@@ -4,43 +4,99 @@
 #include <string.h>
 #include <pthread.h>
 
+// Helper functions just used by this C file to clean up our code
+static int resource_wait(Resource *resource, ResourceWaitList *list, System *system, int need, int is_space);
+static void resource_wake(Resource *resource);
+static int resource_free_space(Resource *resource);
+static int resource_dropped(Resource *resource, int before, int after);
+static void resource_rose(Resource *resource, int before, int after);
+static void wait_list_append(ResourceWaitList *list, System *system);
+static int resource_units(Resource *resource);
+static ResourceShard *resource_shard(Resource *resource);
+static int resource_shard_take(Resource *resource, int amount, int *seen);
+static int resource_shard_fill(Resource *resource, int amount);
+static int resource_shard_low(Resource *resource);
+
+// Shard the current thread uses first in every sharded resource, -1 until its first use
+static __thread int resource_shard_index = -1;
+static atomic_int resource_shard_next;
+
 /* Resource functions */
 
 /**
  * Creates a new `Resource` object.
  *
- * Allocates memory for a new `Resource` and initializes its fields.
- * The `name` is dynamically allocated, and a mutex is initialized for thread safety.
+ * Allocates the `Resource` from `arena` and initializes it with `resource_init`.
  *
  * @param[out] resource      Pointer to the `Resource*` to be allocated and initialized.
- * @param[in]  name          Name of the resource (the string is copied).
+ * @param[in,out] arena      Arena that owns the resource's memory.
+ * @param[in]  name          Name of the resource (interned in `arena`).
  * @param[in]  amount        Initial amount of the resource.
  * @param[in]  max_capacity  Maximum capacity of the resource.
+ * @param[in]  flags         `RESOURCE_FLAG_*` bits, see `resource_init`.
  */
-void resource_create(Resource **resource, const char *name, int amount, int max_capacity) {
-    *resource = malloc(sizeof(Resource));
-    if (*resource == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed for Resource.\n");
-        exit(EXIT_FAILURE);
-    }
+void resource_create(Resource **resource, Arena *arena, const char *name, int amount, int max_capacity, int flags) {
+    *resource = arena_alloc(arena, sizeof(Resource), _Alignof(Resource));
+    resource_init(*resource, arena, name, amount, max_capacity, flags);
+}
 
-    (*resource)->name = strdup(name);  // Duplicate the resource name
-    if ((*resource)->name == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed for Resource name.\n");
-        free(*resource);
-        exit(EXIT_FAILURE);
-    }
+/**
+ * Initializes a `Resource` in memory the caller provides, such as one slot of a block of resources.
+ *
+ * Interns its `name` in `arena` and initializes its fields.
+ * A mutex is initialized for thread safety.
+ *
+ * @param[out] resource      Pointer to the zeroed `Resource` to initialize.
+ * @param[in,out] arena      Arena that owns the resource's name and shards.
+ * @param[in]  name          Name of the resource (interned in `arena`).
+ * @param[in]  amount        Initial amount of the resource.
+ * @param[in]  max_capacity  Maximum capacity of the resource.
+ * @param[in]  flags         `RESOURCE_FLAG_*` bits, 0 for an ordinary resource; with
+ *                           `RESOURCE_FLAG_SHARDED` the units are split over `RESOURCE_SHARDS` shards.
+ */
+void resource_init(Resource *resource, Arena *arena, const char *name, int amount, int max_capacity, int flags) {
+    resource->name = arena_intern(arena, name);
 
-    (*resource)->amount = amount;
-    (*resource)->max_capacity = max_capacity;
+    atomic_init(&resource->amount, amount);
+    resource->max_capacity = max_capacity;
+    resource->id = 0;
+    resource->flags = flags;
+    resource->low_mark = (int)(max_capacity * THRESHOLD_RESOURCE_LOW);
+    resource->recover_mark = (int)(max_capacity * THRESHOLD_RESOURCE_RECOVER);
 
+#ifndef RESOURCE_ATOMIC
     // Initialize the mutex
-    if (pthread_mutex_init(&(*resource)->mutex, NULL) != 0) {
+    if (pthread_mutex_init(&resource->mutex, NULL) != 0) {
         fprintf(stderr, "Error: Failed to initialize mutex for Resource.\n");
-        free((*resource)->name);
-        free(*resource);
         exit(EXIT_FAILURE);
     }
+#endif
+
+    atomic_init(&resource->waiters, 0);
+    atomic_init(&resource->low_state, RESOURCE_LOW_ARMED);
+#ifdef RESOURCE_ATOMIC
+    atomic_init(&resource->held, 0);
+#endif
+    resource->consumers.head = resource->consumers.tail = NULL;
+    resource->producers.head = resource->producers.tail = NULL;
+    if (pthread_mutex_init(&resource->wait_mutex, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to initialize wait mutex for Resource.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Everything starts in the first shard, the others fill as threads consume and store
+    resource->shards = NULL;
+    if (flags & RESOURCE_FLAG_SHARDED) {
+        resource->shards = arena_alloc(arena, sizeof(ResourceShard) * RESOURCE_SHARDS, _Alignof(ResourceShard));
+        for (int i = 0; i < RESOURCE_SHARDS; i++) {
+            atomic_init(&resource->shards[i].units, (i == 0) ? amount : 0);
+            atomic_init(&resource->shards[i].space, (i == 0) ? max_capacity - amount : 0);
+        }
+        if (pthread_mutex_init(&resource->shard_mutex, NULL) != 0) {
+            fprintf(stderr, "Error: Failed to initialize shard mutex for Resource.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 }
 
 /**
@@ -61,7 +117,7 @@ void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, i
         // Allow NULL resource for scenarios like "produce_none"
         resource_amount->resource = NULL;
         resource_amount->amount = 0;
-        printf("Debug: Resource is NULL in resource_amount_init. Allowed for cases like 'produce_none'.\n");
+        LOG_DEBUG("Resource is NULL in resource_amount_init. Allowed for cases like 'produce_none'.\n");
         return;
     }
     resource_amount->resource = resource;
@@ -73,7 +129,7 @@ void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, i
 /**
  * Destroys a `Resource` object.
  *
- * Frees all memory associated with the `Resource`, including the mutex.
+ * Destroys the mutexes of the `Resource`; its memory is released with the arena it was created in.
  *
  * @param[in,out] resource  Pointer to the `Resource` to be destroyed.
  */
@@ -82,10 +138,672 @@ void resource_destroy(Resource *resource) {
         return;
     }
 
+#ifndef RESOURCE_ATOMIC
     // Destroy the mutex
     pthread_mutex_destroy(&resource->mutex);
-    free(resource->name);
-    free(resource);
+#endif
+    pthread_mutex_destroy(&resource->wait_mutex);
+    if (resource->shards != NULL) {
+        pthread_mutex_destroy(&resource->shard_mutex);
+    }
+}
+
+/**
+ * Consumes `amount` units of a `Resource` if enough are available.
+ *
+ * Nothing is taken unless the full amount is available. In the atomic build
+ * this is a compare-and-swap loop instead of a critical section. A sharded
+ * resource is taken from the thread's own shard, or another one when that runs
+ * dry, and the freed space is credited to the own shard. Producers waiting for
+ * free capacity are woken once space has been freed.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` to consume from.
+ * @param[in]     amount    Number of units required.
+ * @return                  `STATUS_OK` if consumed, `STATUS_LOW` if consumed and the resource just
+ *                          dropped below its low mark (claim it with `resource_claim_low`),
+ *                          `STATUS_EMPTY` if the resource is at zero, or `STATUS_INSUFFICIENT`
+ *                          if there is some but not enough.
+ */
+int resource_consume(Resource *resource, int amount) {
+    int current;
+    int low;
+
+    if (resource->shards != NULL) {
+        int taken = resource_shard_take(resource, amount, &current);
+        if (taken) {
+            atomic_fetch_add_explicit(&resource_shard(resource)->space, amount, memory_order_acq_rel);
+        }
+        resource_wake(resource);
+        if (!taken) {
+            return (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+        }
+        return resource_shard_low(resource) ? STATUS_LOW : STATUS_OK;
+    }
+
+#ifdef RESOURCE_ATOMIC
+    current = atomic_load_explicit(&resource->amount, memory_order_relaxed);
+    while (current >= amount) {
+        if (atomic_compare_exchange_weak_explicit(&resource->amount, &current, current - amount,
+                                                  memory_order_acq_rel, memory_order_relaxed)) {
+            low = resource_dropped(resource, current, current - amount);
+            resource_wake(resource);
+            return low ? STATUS_LOW : STATUS_OK;
+        }
+    }
+#else
+    STATS_LOCK(&resource->mutex, STATS_HIST_RESOURCE_LOCK);
+    current = atomic_load_explicit(&resource->amount, memory_order_relaxed);
+    if (current >= amount) {
+        atomic_store_explicit(&resource->amount, current - amount, memory_order_relaxed);
+        low = resource_dropped(resource, current, current - amount);
+        pthread_mutex_unlock(&resource->mutex);
+        resource_wake(resource);
+        return low ? STATUS_LOW : STATUS_OK;
+    }
+    pthread_mutex_unlock(&resource->mutex);
+#endif
+
+    return (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+}
+
+/**
+ * Consumes every term of a recipe, or nothing at all.
+ *
+ * `amounts` must be in lock order without repeated resources, as `system_create_recipe`
+ * leaves them. With mutexes, every resource is locked in that global order, so two
+ * recipes sharing resources cannot deadlock and recipes sharing none never contend.
+ * In the atomic build each term is taken with its own compare-and-swap and taken terms
+ * are handed back if a later one falls short. While taken, a term also counts in `held`,
+ * which `resource_store` treats as occupied, so a producer can never fill the space
+ * that a hand-back needs. Sharded terms take no lock in either build: they are taken
+ * from the shards like `resource_consume` does, and their space is only credited once
+ * the whole recipe is taken, which keeps the space a hand-back needs just the same.
+ *
+ * @param[in]  amounts  Recipe inputs.
+ * @param[in]  count    Number of inputs.
+ * @param[out] failed   On failure, index of the input that could not be covered.
+ * @return              `STATUS_OK` if everything was consumed, `STATUS_LOW` if everything was
+ *                      consumed and at least one input dropped below its low mark, otherwise
+ *                      the status `resource_consume` would give for the failed input.
+ */
+int resource_consume_all(const ResourceAmount *amounts, int count, int *failed) {
+    int status = STATUS_OK;
+    int current = 0;
+    int low = 0;
+    int taken;
+
+    if (count == 1) {
+        *failed = 0;
+        return resource_consume(amounts[0].resource, amounts[0].amount);
+    }
+
+#ifdef RESOURCE_ATOMIC
+    for (taken = 0; taken < count; taken++) {
+        Resource *resource = amounts[taken].resource;
+        int amount = amounts[taken].amount;
+
+        if (resource->shards != NULL) {
+            if (!resource_shard_take(resource, amount, &current)) {
+                resource_wake(resource);
+                status = (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+                break;
+            }
+            low |= resource_shard_low(resource);
+            continue;
+        }
+
+        // Raise `held` first, producers must not see the units leave `amount` as free space
+        atomic_fetch_add(&resource->held, amount);
+        current = atomic_load_explicit(&resource->amount, memory_order_relaxed);
+        while (current >= amount &&
+               !atomic_compare_exchange_weak_explicit(&resource->amount, &current, current - amount,
+                                                      memory_order_acq_rel, memory_order_relaxed)) {
+        }
+        if (current < amount) {
+            atomic_fetch_sub(&resource->held, amount);
+            resource_wake(resource);
+            status = (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+            break;
+        }
+        low |= resource_dropped(resource, current, current - amount);
+    }
+
+    for (int i = 0; i < taken; i++) {
+        Resource *resource = amounts[i].resource;
+        if (resource->shards != NULL) {
+            ResourceShard *shard = resource_shard(resource);
+            atomic_fetch_add_explicit((status == STATUS_OK) ? &shard->space : &shard->units, amounts[i].amount,
+                                      memory_order_acq_rel);
+            resource_wake(resource);
+            continue;
+        }
+        if (status != STATUS_OK) {
+            // Handing back also cancels a low report the take made pending
+            int before = atomic_fetch_add_explicit(&resource->amount, amounts[i].amount, memory_order_acq_rel);
+            resource_rose(resource, before, before + amounts[i].amount);
+        }
+        atomic_fetch_sub(&resource->held, amounts[i].amount);
+        resource_wake(resource);
+    }
+#else
+    int sharded = 0;
+    for (int i = 0; i < count; i++) {
+        if (amounts[i].resource->shards != NULL) {
+            sharded = 1;
+        } else {
+            STATS_LOCK(&amounts[i].resource->mutex, STATS_HIST_RESOURCE_LOCK);
+        }
+    }
+    for (taken = 0; taken < count; taken++) {
+        if (amounts[taken].resource->shards != NULL) {
+            continue;
+        }
+        current = atomic_load_explicit(&amounts[taken].resource->amount, memory_order_relaxed);
+        if (current < amounts[taken].amount) {
+            status = (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+            break;
+        }
+    }
+
+    // Every locked term is covered, the sharded ones are taken now, in order, and handed back on a shortfall
+    if (status == STATUS_OK && sharded) {
+        for (taken = 0; taken < count; taken++) {
+            Resource *resource = amounts[taken].resource;
+            if (resource->shards != NULL && !resource_shard_take(resource, amounts[taken].amount, &current)) {
+                status = (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+                break;
+            }
+        }
+        for (int i = 0; i < taken; i++) {
+            Resource *resource = amounts[i].resource;
+            if (resource->shards != NULL) {
+                ResourceShard *shard = resource_shard(resource);
+                atomic_fetch_add_explicit((status == STATUS_OK) ? &shard->space : &shard->units, amounts[i].amount,
+                                          memory_order_acq_rel);
+                low |= (status == STATUS_OK) && resource_shard_low(resource);
+            }
+        }
+        taken = (status == STATUS_OK) ? count : taken;
+    }
+    if (status == STATUS_OK) {
+        for (int i = 0; i < count; i++) {
+            Resource *resource = amounts[i].resource;
+            if (resource->shards == NULL) {
+                current = atomic_load_explicit(&resource->amount, memory_order_relaxed);
+                atomic_store_explicit(&resource->amount, current - amounts[i].amount, memory_order_relaxed);
+                low |= resource_dropped(resource, current, current - amounts[i].amount);
+            }
+        }
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        if (amounts[i].resource->shards == NULL) {
+            pthread_mutex_unlock(&amounts[i].resource->mutex);
+        }
+    }
+    if (status == STATUS_OK || sharded) {
+        for (int i = 0; i < count; i++) {
+            resource_wake(amounts[i].resource);
+        }
+    }
+#endif
+
+    *failed = taken;
+    return (status == STATUS_OK && low) ? STATUS_LOW : status;
+}
+
+/**
+ * Stores up to `amount` units into a `Resource` without exceeding its capacity.
+ *
+ * If there is not enough space, as much as fits is stored. In the atomic build
+ * this is a compare-and-swap loop instead of a critical section. Consumers
+ * whose requirement is now covered are woken, and a resource climbing back to
+ * its recover mark is re-armed for the next low report. A sharded resource takes
+ * the space from the thread's own shard first, and the capacity is never exceeded:
+ * only space a consume credited can be filled.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` to store into.
+ * @param[in]     amount    Number of units offered.
+ * @return                  Number of units actually stored (0 when the resource is full).
+ */
+int resource_store(Resource *resource, int amount) {
+    int current, available_space, amount_to_store;
+
+    if (resource->shards != NULL) {
+        amount_to_store = resource_shard_fill(resource, amount);
+        if (amount_to_store > 0) {
+            atomic_fetch_add_explicit(&resource_shard(resource)->units, amount_to_store, memory_order_acq_rel);
+        }
+        resource_wake(resource);
+        return amount_to_store;
+    }
+
+#ifdef RESOURCE_ATOMIC
+    // `held` is read after `amount` on every attempt, see resource_consume_all
+    current = atomic_load_explicit(&resource->amount, memory_order_acquire);
+    do {
+        available_space = resource->max_capacity - current - atomic_load_explicit(&resource->held, memory_order_acquire);
+        amount_to_store = (available_space >= amount) ? amount : available_space;
+        if (amount_to_store <= 0) {
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&resource->amount, &current, current + amount_to_store,
+                                                    memory_order_acq_rel, memory_order_acquire));
+    resource_rose(resource, current, current + amount_to_store);
+#else
+    STATS_LOCK(&resource->mutex, STATS_HIST_RESOURCE_LOCK);
+    current = atomic_load_explicit(&resource->amount, memory_order_relaxed);
+    available_space = resource->max_capacity - current;
+    amount_to_store = (available_space >= amount) ? amount : available_space;
+    if (amount_to_store > 0) {
+        atomic_store_explicit(&resource->amount, current + amount_to_store, memory_order_relaxed);
+        resource_rose(resource, current, current + amount_to_store);
+    } else {
+        amount_to_store = 0;
+    }
+    pthread_mutex_unlock(&resource->mutex);
+#endif
+
+    if (amount_to_store > 0) {
+        resource_wake(resource);
+    }
+    return amount_to_store;
+}
+
+/**
+ * Reads the current amount of a `Resource` without taking any lock.
+ *
+ * For a sharded resource this is the view of the last `resource_reconcile`.
+ *
+ * @param[in] resource  Pointer to the `Resource` to read.
+ * @return              The amount at the time of the call.
+ */
+int resource_get_amount(Resource *resource) {
+    return atomic_load_explicit(&resource->amount, memory_order_acquire);
+}
+
+/**
+ * Brings the global view of a sharded `Resource` up to date.
+ *
+ * Stores the sum of the shards into `amount` and applies the low mark to the change
+ * since the last reconciliation, so a drop below it is reported once, by the next
+ * consume, and a climb back re-arms it. The capacity itself needs no reconciling,
+ * stores can only fill space that a consume credited to a shard. Does nothing for
+ * an ordinary resource, whose `amount` is always exact. Only the manager thread may call this.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`.
+ */
+void resource_reconcile(Resource *resource) {
+    if (resource->shards == NULL) {
+        return;
+    }
+
+    int before = atomic_load_explicit(&resource->amount, memory_order_relaxed);
+    int after = resource_units(resource);
+    atomic_store_explicit(&resource->amount, after, memory_order_release);
+    if (after < before) {
+        resource_dropped(resource, before, after);
+    } else if (after > before) {
+        resource_rose(resource, before, after);
+    }
+}
+
+/**
+ * Claims the report of a `Resource` that dropped below its low mark.
+ *
+ * Every drop is claimed by exactly one caller, which should report `STATUS_LOW`.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` a consume reported `STATUS_LOW` for.
+ * @return                  Non-zero if the caller claimed a pending low report.
+ */
+int resource_claim_low(Resource *resource) {
+    int pending = RESOURCE_LOW_PENDING;
+    return atomic_compare_exchange_strong(&resource->low_state, &pending, RESOURCE_LOW_REPORTED);
+}
+
+/**
+ * Blocks a system until the `Resource` holds at least `amount` units.
+ *
+ * The system is put on the consumer wait list and later handed to its `wake`
+ * hook by whichever `resource_store` covers the requirement.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` the system consumes.
+ * @param[in,out] system    The waiting `System`; must have a `wake` hook.
+ * @param[in]     amount    Units the system needs.
+ * @return                  Non-zero if the system is now waiting, zero if the amount
+ *                          became available in the meantime and it should retry at once.
+ */
+int resource_wait_amount(Resource *resource, System *system, int amount) {
+    return resource_wait(resource, &resource->consumers, system, amount, 0);
+}
+
+/**
+ * Blocks a system until the `Resource` has free capacity.
+ *
+ * The system is put on the producer wait list and later handed to its `wake`
+ * hook by whichever `resource_consume` frees space.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` the system produces.
+ * @param[in,out] system    The waiting `System`; must have a `wake` hook.
+ * @return                  Non-zero if the system is now waiting, zero if space
+ *                          became available in the meantime and it should retry at once.
+ */
+int resource_wait_space(Resource *resource, System *system) {
+    return resource_wait(resource, &resource->producers, system, 1, 1);
+}
+
+/**
+ * Puts a system back at the tail of a wait list of a restored `Resource`.
+ *
+ * Unlike `resource_wait_amount` and `resource_wait_space` the condition is not
+ * checked: the system was waiting when the checkpoint was taken and stays in line
+ * until an update wakes it, as it would have in the checkpointed run.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`.
+ * @param[in,out] system    The waiting `System`; must have a `wake` hook.
+ * @param[in]     need      Units (or free space) the system waits for.
+ * @param[in]     is_space  Non-zero for the producer list, zero for the consumer list.
+ */
+void resource_wait_restore(Resource *resource, System *system, int need, int is_space) {
+    pthread_mutex_lock(&resource->wait_mutex);
+    atomic_fetch_add(&resource->waiters, 1);
+    system->wait_need = need;
+    wait_list_append(is_space ? &resource->producers : &resource->consumers, system);
+    pthread_mutex_unlock(&resource->wait_mutex);
+}
+
+/**
+ * Registers a waiter unless its condition already holds.
+ *
+ * `waiters` is raised before the condition is checked, and updates raise
+ * `amount` before reading `waiters`, so either the waiter sees the update or
+ * the update sees the waiter; a wakeup cannot be lost.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`.
+ * @param[in,out] list      Wait list to join.
+ * @param[in,out] system    The waiting `System`.
+ * @param[in]     need      Units (or free space) required.
+ * @param[in]     is_space  Non-zero to wait on free space rather than on the amount.
+ * @return                  Non-zero if the system was added to the list.
+ */
+static int resource_wait(Resource *resource, ResourceWaitList *list, System *system, int need, int is_space) {
+    pthread_mutex_lock(&resource->wait_mutex);
+    atomic_fetch_add(&resource->waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    int available = is_space ? resource_free_space(resource) : resource_units(resource);
+    if (available >= need) {
+        atomic_fetch_sub(&resource->waiters, 1);
+        pthread_mutex_unlock(&resource->wait_mutex);
+        return 0;
+    }
+
+    system->wait_need = need;
+    wait_list_append(list, system);
+    pthread_mutex_unlock(&resource->wait_mutex);
+    return 1;
+}
+
+/**
+ * Wakes the waiters of a `Resource` whose condition now holds.
+ *
+ * Consumers are woken in FIFO order for as long as the current amount covers
+ * them, producers for as long as there is free space, so a small refill does
+ * not wake every waiter. Costs a single atomic load when nobody waits.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` that just changed.
+ */
+static void resource_wake(Resource *resource) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&resource->waiters, memory_order_relaxed) == 0) {
+        return;
+    }
+
+    System *woken = NULL;
+    System **woken_tail = &woken;
+    pthread_mutex_lock(&resource->wait_mutex);
+    int amount = resource_units(resource);
+    int space = resource_free_space(resource);
+
+    while (resource->consumers.head != NULL && resource->consumers.head->wait_need <= amount) {
+        System *system = resource->consumers.head;
+        resource->consumers.head = system->wait_next;
+        amount -= system->wait_need;
+        system->wait_next = NULL;
+        *woken_tail = system;
+        woken_tail = &system->wait_next;
+        atomic_fetch_sub(&resource->waiters, 1);
+    }
+    if (resource->consumers.head == NULL) {
+        resource->consumers.tail = NULL;
+    }
+
+    while (resource->producers.head != NULL && space > 0) {
+        System *system = resource->producers.head;
+        resource->producers.head = system->wait_next;
+        space -= system->wait_need;
+        system->wait_next = NULL;
+        *woken_tail = system;
+        woken_tail = &system->wait_next;
+        atomic_fetch_sub(&resource->waiters, 1);
+    }
+    if (resource->producers.head == NULL) {
+        resource->producers.tail = NULL;
+    }
+    pthread_mutex_unlock(&resource->wait_mutex);
+
+    // Hooks run outside the lock, they may take scheduler locks
+    while (woken != NULL) {
+        System *system = woken;
+        woken = system->wait_next;
+        system->wait_next = NULL;
+        system->wake(system, system->wake_context);
+    }
+}
+
+/**
+ * Computes the capacity a producer could store into right now.
+ *
+ * @param[in] resource  Pointer to the `Resource`.
+ * @return              Free space, not counting units held by an unfinished `resource_consume_all`.
+ */
+static int resource_free_space(Resource *resource) {
+    if (resource->shards != NULL) {
+        int space = 0;
+        for (int i = 0; i < RESOURCE_SHARDS; i++) {
+            space += atomic_load_explicit(&resource->shards[i].space, memory_order_acquire);
+        }
+        return space;
+    }
+
+    int space = resource->max_capacity - resource_get_amount(resource);
+#ifdef RESOURCE_ATOMIC
+    space -= atomic_load_explicit(&resource->held, memory_order_acquire);
+#endif
+    return space;
+}
+
+/**
+ * Detects a drop of a `Resource` below its low mark and makes its report pending.
+ *
+ * The caller has just changed the amount from `before` to `after`. The common case
+ * costs two comparisons; the state is only touched on the drop itself, and only
+ * one drop is reported until `resource_rose` re-arms the resource.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`.
+ * @param[in]     before    Amount before the consume.
+ * @param[in]     after     Amount after the consume.
+ * @return                  Non-zero if a low report became pending.
+ */
+static int resource_dropped(Resource *resource, int before, int after) {
+    if (before < resource->low_mark || after >= resource->low_mark) {
+        return 0;
+    }
+
+    int armed = RESOURCE_LOW_ARMED;
+    return atomic_compare_exchange_strong(&resource->low_state, &armed, RESOURCE_LOW_PENDING);
+}
+
+/**
+ * Re-arms the low report of a `Resource` that climbed back.
+ *
+ * Back at the recover mark, the next drop is reported again; back at the low mark
+ * before anyone claimed the report, the pending report is dropped.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`.
+ * @param[in]     before    Amount before the store.
+ * @param[in]     after     Amount after the store.
+ */
+static void resource_rose(Resource *resource, int before, int after) {
+    if (before < resource->recover_mark && after >= resource->recover_mark) {
+        atomic_store(&resource->low_state, RESOURCE_LOW_ARMED);
+    } else if (before < resource->low_mark && after >= resource->low_mark) {
+        int pending = RESOURCE_LOW_PENDING;
+        atomic_compare_exchange_strong(&resource->low_state, &pending, RESOURCE_LOW_ARMED);
+    }
+}
+
+/**
+ * Appends a system at the tail of a wait list.
+ *
+ * @param[in,out] list    The `ResourceWaitList`.
+ * @param[in,out] system  The `System` to append.
+ */
+static void wait_list_append(ResourceWaitList *list, System *system) {
+    system->wait_next = NULL;
+    if (list->tail == NULL) {
+        list->head = system;
+    } else {
+        list->tail->wait_next = system;
+    }
+    list->tail = system;
+}
+
+/**
+ * Reads the exact amount of a `Resource`, summing the shards of a sharded one.
+ *
+ * @param[in] resource  Pointer to the `Resource`.
+ * @return              Units held, not counting units a sharded take has in flight.
+ */
+static int resource_units(Resource *resource) {
+    if (resource->shards == NULL) {
+        return resource_get_amount(resource);
+    }
+
+    int units = 0;
+    for (int i = 0; i < RESOURCE_SHARDS; i++) {
+        units += atomic_load_explicit(&resource->shards[i].units, memory_order_acquire);
+    }
+    return units;
+}
+
+/**
+ * Returns the shard of a sharded `Resource` the current thread uses first.
+ *
+ * Threads are given shard indices round-robin on first use, the same index in every resource.
+ *
+ * @param[in] resource  Pointer to the sharded `Resource`.
+ * @return              The shard.
+ */
+static ResourceShard *resource_shard(Resource *resource) {
+    if (resource_shard_index < 0) {
+        resource_shard_index = atomic_fetch_add(&resource_shard_next, 1) % RESOURCE_SHARDS;
+    }
+    return &resource->shards[resource_shard_index];
+}
+
+/**
+ * Takes `amount` units from the shards of a sharded `Resource`, or nothing.
+ *
+ * Tries the thread's own shard, then steals from the others in turn. When no single
+ * shard covers the amount, every shard is emptied under `shard_mutex` and what is
+ * left over goes to the own shard, so units split over several shards are still found.
+ * The units taken are in flight until the caller credits their space or hands them
+ * back; the caller must call `resource_wake` afterwards, a gather may have moved units.
+ *
+ * @param[in,out] resource  Pointer to the sharded `Resource`.
+ * @param[in]     amount    Units required.
+ * @param[out]    seen      On failure, the units that were found.
+ * @return                  Non-zero if the amount was taken.
+ */
+static int resource_shard_take(Resource *resource, int amount, int *seen) {
+    ResourceShard *own = resource_shard(resource);
+
+    for (int i = 0; i < RESOURCE_SHARDS; i++) {
+        ResourceShard *shard = &resource->shards[(own - resource->shards + i) % RESOURCE_SHARDS];
+        int current = atomic_load_explicit(&shard->units, memory_order_relaxed);
+        while (current >= amount) {
+            if (atomic_compare_exchange_weak_explicit(&shard->units, &current, current - amount,
+                                                      memory_order_acq_rel, memory_order_relaxed)) {
+                return 1;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&resource->shard_mutex);
+    int total = 0;
+    for (int i = 0; i < RESOURCE_SHARDS; i++) {
+        total += atomic_exchange_explicit(&resource->shards[i].units, 0, memory_order_acq_rel);
+    }
+    int taken = (total >= amount);
+    atomic_fetch_add_explicit(&own->units, taken ? total - amount : total, memory_order_acq_rel);
+    pthread_mutex_unlock(&resource->shard_mutex);
+
+    *seen = total;
+    return taken;
+}
+
+/**
+ * Claims free capacity in the shards of a sharded `Resource` for up to `amount` units.
+ *
+ * Takes what it can from the thread's own shard, then from the others; if that is
+ * still short, the free space of every shard is gathered under `shard_mutex` like
+ * `resource_shard_take` gathers units. The caller adds the claimed units to its shard.
+ *
+ * @param[in,out] resource  Pointer to the sharded `Resource`.
+ * @param[in]     amount    Units offered.
+ * @return                  Units of space claimed, at most `amount`.
+ */
+static int resource_shard_fill(Resource *resource, int amount) {
+    ResourceShard *own = resource_shard(resource);
+    int claimed = 0;
+
+    for (int i = 0; i < RESOURCE_SHARDS && claimed < amount; i++) {
+        ResourceShard *shard = &resource->shards[(own - resource->shards + i) % RESOURCE_SHARDS];
+        int current = atomic_load_explicit(&shard->space, memory_order_relaxed);
+        int part;
+        do {
+            part = (current < amount - claimed) ? current : amount - claimed;
+        } while (part > 0 && !atomic_compare_exchange_weak_explicit(&shard->space, &current, current - part,
+                                                                    memory_order_acq_rel, memory_order_relaxed));
+        claimed += (part > 0) ? part : 0;
+    }
+    if (claimed == amount) {
+        return claimed;
+    }
+
+    pthread_mutex_lock(&resource->shard_mutex);
+    int total = 0;
+    for (int i = 0; i < RESOURCE_SHARDS; i++) {
+        total += atomic_exchange_explicit(&resource->shards[i].space, 0, memory_order_acq_rel);
+    }
+    int part = (total < amount - claimed) ? total : amount - claimed;
+    atomic_fetch_add_explicit(&own->space, total - part, memory_order_acq_rel);
+    pthread_mutex_unlock(&resource->shard_mutex);
+
+    return claimed + part;
+}
+
+/**
+ * Tells whether a sharded `Resource` has a low report waiting to be claimed.
+ *
+ * Shards are not summed on every consume, `resource_reconcile` detects the drop
+ * and the next consume reports it.
+ *
+ * @param[in] resource  Pointer to the sharded `Resource`.
+ * @return              Non-zero if a low report is pending.
+ */
+static int resource_shard_low(Resource *resource) {
+    return atomic_load_explicit(&resource->low_state, memory_order_relaxed) == RESOURCE_LOW_PENDING;
 }
 
 /* ResourceArray functions */
@@ -109,9 +827,9 @@ void resource_array_init(ResourceArray *array) {
 }
 
 /**
- * Cleans up the `ResourceArray` by destroying all resources and freeing memory.
+ * Cleans up the `ResourceArray` by destroying all resources and freeing the array memory.
  *
- * Iterates through the array, destroys each `Resource`, and frees the array memory.
+ * The resources themselves stay allocated until their arena is cleaned.
  *
  * @param[in,out] array  Pointer to the `ResourceArray` to clean.
  */
@@ -126,34 +844,66 @@ void resource_array_clean(ResourceArray *array) {
     array->capacity = 0;
 }
 
+/**
+ * Grows the `ResourceArray` so it holds at least `capacity` resources without resizing.
+ *
+ * Use of realloc is NOT permitted, the pointers are copied into a new array.
+ *
+ * @param[in,out] array     Pointer to the `ResourceArray`.
+ * @param[in]     capacity  Number of resources to make room for.
+ */
+void resource_array_reserve(ResourceArray *array, int capacity) {
+    if (capacity <= array->capacity) {
+        return;
+    }
+
+    Resource **new_resources = malloc(sizeof(Resource *) * capacity);
+    if (new_resources == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for ResourceArray resizing.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(new_resources, array->resources, sizeof(Resource *) * array->size);
+
+    free(array->resources);
+    array->resources = new_resources;
+    array->capacity = capacity;
+}
+
 /**
  * Adds a `Resource` to the `ResourceArray`, resizing if necessary.
  *
- * Resizes the array when the capacity is reached and adds the new `Resource`.
- * Use of realloc is NOT permitted.
+ * Doubles the capacity when it is reached, so adding one by one costs amortized constant time.
  *
  * @param[in,out] array     Pointer to the `ResourceArray`.
  * @param[in]     resource  Pointer to the `Resource` to add.
  */
 void resource_array_add(ResourceArray *array, Resource *resource) {
     if (array->size == array->capacity) {
-        // Double the capacity
-        int new_capacity = array->capacity * 2;
-        Resource **new_resources = malloc(sizeof(Resource *) * new_capacity);
-        if (new_resources == NULL) {
-            fprintf(stderr, "Error: Memory allocation failed for ResourceArray resizing.\n");
-            exit(EXIT_FAILURE);
-        }
+        resource_array_reserve(array, array->capacity * 2);
+    }
 
-        // Copy old resources to the new array
-        for (int i = 0; i < array->size; i++) {
-            new_resources[i] = array->resources[i];
-        }
+    resource->id = array->size;
+    array->resources[array->size++] = resource;  // Add the new resource
+}
 
-        free(array->resources);
-        array->resources = new_resources;
-        array->capacity = new_capacity;
+/**
+ * Adds a contiguous block of resources to the `ResourceArray` with a single resize at most.
+ *
+ * The resources get consecutive ids, matching their slots in the block, and keep their
+ * addresses for as long as the arena holding the block lives.
+ *
+ * @param[in,out] array      Pointer to the `ResourceArray`.
+ * @param[in]     resources  First of `count` initialized resources, adjacent in memory.
+ * @param[in]     count      Number of resources in the block.
+ */
+void resource_array_add_block(ResourceArray *array, Resource *resources, int count) {
+    if (array->size + count > array->capacity) {
+        int doubled = array->capacity * 2;
+        resource_array_reserve(array, (array->size + count > doubled) ? array->size + count : doubled);
     }
 
-    array->resources[array->size++] = resource;  // Add the new resource
+    for (int i = 0; i < count; i++) {
+        resources[i].id = array->size;
+        array->resources[array->size++] = &resources[i];
+    }
 }
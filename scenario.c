@@ -0,0 +1,649 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Growable buffers used while a text scenario is parsed
+typedef struct ScenarioBuilder {
+    ScenarioResource *resources;
+    int resource_count;
+    int resource_capacity;
+    ScenarioSystem *systems;
+    int system_count;
+    int system_capacity;
+    ScenarioTerm *terms;
+    int term_count;
+    int term_capacity;
+    char *strings;
+    size_t string_size;
+    size_t string_capacity;
+} ScenarioBuilder;
+
+// Helper functions just used by this C file to clean up our code
+static void scenario_parse_text(Scenario *scenario, const char *path);
+static void scenario_map_binary(Scenario *scenario, const char *path, int fd, size_t size);
+static void scenario_set_view(Scenario *scenario, void *base, size_t size);
+static int scenario_tokenize(char *line, char **tokens, int max_tokens);
+static int scenario_find_resource(const ScenarioBuilder *builder, const char *name);
+static uint32_t scenario_parse_flags(char *list, const char *path, int line_number);
+static int scenario_parse_count(const char *token, const char *what, const char *path, int line_number);
+static unsigned int scenario_add_terms(ScenarioBuilder *builder, char *list, const char *path, int line_number);
+static void scenario_add_term(ScenarioBuilder *builder, int resource, int amount);
+static unsigned int scenario_add_string(ScenarioBuilder *builder, const char *string);
+static void *scenario_grow(void *array, int *capacity, size_t element_size);
+static int scenario_scale(int value, double spread, unsigned long long *state);
+
+/**
+ * Loads a scenario file.
+ *
+ * Compiled scenarios (recognized by `SCENARIO_MAGIC`) are memory-mapped and used
+ * in place; anything else is parsed as the text format and compiled in memory.
+ *
+ * Text format, one entry per line, `#` starts a comment, names may be quoted:
+ *     resource <name> <amount> <max_capacity> [flags]
+ *     system <name> <consumed|-> <amount> <produced|-> <amount> <processing_time>
+ *     system <name> <inputs|-> <outputs|-> <processing_time>
+ * where a recipe list is comma-separated `<resource>:<amount>` terms, e.g. `Fuel:5,Oxygen:2`,
+ * and flags are comma-separated `critical`, `alarm-low` and `sharded`. Amounts, capacities and
+ * processing times are non-negative integers, and no resource starts above its capacity.
+ *
+ * @param[out] scenario  Pointer to the `Scenario` to fill.
+ * @param[in]  path      Path of the text or compiled scenario file.
+ */
+void scenario_load(Scenario *scenario, const char *path) {
+    struct stat info;
+    char magic[sizeof(((ScenarioHeader *)0)->magic)];
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error: Cannot open scenario file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((size_t)info.st_size >= sizeof(ScenarioHeader) &&
+        read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic) &&
+        memcmp(magic, SCENARIO_MAGIC, sizeof(magic)) == 0) {
+        scenario_map_binary(scenario, path, fd, (size_t)info.st_size);
+    } else {
+        scenario_parse_text(scenario, path);
+    }
+    close(fd);
+}
+
+/**
+ * Writes a scenario in the compiled binary format.
+ *
+ * The image is written exactly as it is laid out in memory, so loading it is a single `mmap`.
+ *
+ * @param[in] scenario  Pointer to the loaded `Scenario`.
+ * @param[in] path      Path of the file to create.
+ */
+void scenario_write(const Scenario *scenario, const char *path) {
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL || fwrite(scenario->base, 1, scenario->size, file) != scenario->size || fclose(file) != 0) {
+        fprintf(stderr, "Error: Cannot write compiled scenario %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Creates every resource and system of a scenario in the `Manager`.
+ *
+ * Records are fixed-size and already resolved to resource indices, so this is
+ * one sequential pass over each table with no parsing or name lookups. The
+ * resources and the systems are each built in place in one contiguous block of
+ * the arena, in file order, and added to their arrays with a single resize;
+ * the intern table is sized for every name up front.
+ *
+ * @param[in]     scenario  Pointer to the loaded `Scenario`.
+ * @param[in,out] manager   Pointer to the `Manager` to populate.
+ */
+void scenario_apply(const Scenario *scenario, Manager *manager) {
+    const ScenarioHeader *header = scenario->header;
+    int first = manager->resource_array.size;
+    arena_reserve_strings(&manager->arena, header->resource_count + header->system_count);
+    Resource *resource_block = arena_alloc(&manager->arena, sizeof(Resource) * header->resource_count, _Alignof(Resource));
+
+    for (unsigned int i = 0; i < header->resource_count; i++) {
+        const ScenarioResource *record = &scenario->resources[i];
+
+        resource_init(&resource_block[i], &manager->arena, scenario->strings + record->name_offset, record->amount,
+                      record->max_capacity, (int)record->flags);
+    }
+    resource_array_add_block(&manager->resource_array, resource_block, (int)header->resource_count);
+
+    // Resolve every recipe term once, systems then point into this table
+    Resource **resources = manager->resource_array.resources + first;
+    ResourceAmount *terms = malloc(sizeof(ResourceAmount) * (header->term_count + 1));
+    if (terms == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Scenario recipes.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned int i = 0; i < header->term_count; i++) {
+        resource_amount_init(&terms[i], resources[scenario->terms[i].resource], scenario->terms[i].amount);
+    }
+
+    System *system_block = arena_alloc(&manager->arena, sizeof(System) * header->system_count, _Alignof(System));
+    for (unsigned int i = 0; i < header->system_count; i++) {
+        const ScenarioSystem *record = &scenario->systems[i];
+
+        system_init_recipe(&system_block[i], &manager->arena, scenario->strings + record->name_offset,
+                           &terms[record->first_term], (int)record->input_count,
+                           &terms[record->first_term + record->input_count], (int)record->output_count,
+                           record->processing_time, &manager->event_queue);
+    }
+    system_array_add_block(&manager->system_array, system_block, (int)header->system_count);
+    free(terms);
+}
+
+/**
+ * Copies a scenario with randomly varied amounts, capacities and processing times.
+ *
+ * Every capacity, initial amount and processing time is scaled by its own factor,
+ * drawn uniformly from [1 - spread, 1 + spread]; amounts stay within their capacity.
+ * The same seed always gives the same copy, and the original is only read, so many
+ * threads can vary one scenario at once.
+ *
+ * @param[in]  scenario  Pointer to the `Scenario` to copy.
+ * @param[out] copy      Receives the varied copy, released with `scenario_free`.
+ * @param[in]  spread    Largest relative change, 0 for an exact copy.
+ * @param[in]  seed      Seed of the random factors.
+ */
+void scenario_jitter(const Scenario *scenario, Scenario *copy, double spread, unsigned long long seed) {
+    char *base = malloc(scenario->size);
+    if (base == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Scenario.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(base, scenario->base, scenario->size);
+    copy->mapped = 0;
+    scenario_set_view(copy, base, scenario->size);
+
+    // The view is read-only, the copy is ours to change
+    ScenarioResource *resources = (ScenarioResource *)(base + sizeof(ScenarioHeader));
+    ScenarioSystem *systems = (ScenarioSystem *)(resources + copy->header->resource_count);
+    unsigned long long state = seed;
+
+    for (unsigned int i = 0; i < copy->header->resource_count; i++) {
+        int capacity = scenario_scale(resources[i].max_capacity, spread, &state);
+        int amount = scenario_scale(resources[i].amount, spread, &state);
+        resources[i].max_capacity = (resources[i].max_capacity > 0 && capacity < 1) ? 1 : capacity;
+        resources[i].amount = (amount > resources[i].max_capacity) ? resources[i].max_capacity : amount;
+    }
+    for (unsigned int i = 0; i < copy->header->system_count; i++) {
+        systems[i].processing_time = scenario_scale(systems[i].processing_time, spread, &state);
+    }
+}
+
+/**
+ * Releases a scenario, unmapping or freeing its image.
+ *
+ * @param[in,out] scenario  Pointer to the `Scenario` to release.
+ */
+void scenario_free(Scenario *scenario) {
+    if (scenario->mapped) {
+        munmap(scenario->base, scenario->size);
+    } else {
+        free(scenario->base);
+    }
+    scenario->base = NULL;
+    scenario->size = 0;
+}
+
+/**
+ * Maps a compiled scenario and checks that every offset and index stays in bounds.
+ *
+ * @param[out] scenario  Pointer to the `Scenario` to fill.
+ * @param[in]  path      Path of the file, for error messages.
+ * @param[in]  fd        Open descriptor of the file.
+ * @param[in]  size      Size of the file in bytes.
+ */
+static void scenario_map_binary(Scenario *scenario, const char *path, int fd, size_t size) {
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map compiled scenario %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    scenario->mapped = 1;
+
+    const ScenarioHeader *header = (const ScenarioHeader *)base;
+    size_t expected = sizeof(ScenarioHeader)
+                    + (size_t)header->resource_count * sizeof(ScenarioResource)
+                    + (size_t)header->system_count * sizeof(ScenarioSystem)
+                    + (size_t)header->term_count * sizeof(ScenarioTerm)
+                    + header->string_size;
+    if (header->version != SCENARIO_VERSION || expected != size ||
+        header->string_size == 0 || ((const char *)base)[size - 1] != '\0') {
+        fprintf(stderr, "Error: Compiled scenario %s is corrupt or from another version.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    scenario_set_view(scenario, base, size);
+
+    for (unsigned int i = 0; i < header->resource_count; i++) {
+        const ScenarioResource *record = &scenario->resources[i];
+        if (record->name_offset >= header->string_size || (record->flags & ~RESOURCE_FLAGS) != 0 ||
+            record->amount < 0 || record->max_capacity < 0 || record->amount > record->max_capacity) {
+            fprintf(stderr, "Error: Compiled scenario %s has a bad resource record %u.\n", path, i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (unsigned int i = 0; i < header->system_count; i++) {
+        const ScenarioSystem *record = &scenario->systems[i];
+        if (record->name_offset >= header->string_size || record->processing_time < 0 ||
+            (unsigned long long)record->first_term + record->input_count + record->output_count > header->term_count) {
+            fprintf(stderr, "Error: Compiled scenario %s has a bad system record %u.\n", path, i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (unsigned int i = 0; i < header->term_count; i++) {
+        if (scenario->terms[i].resource < 0 || scenario->terms[i].resource >= (int)header->resource_count ||
+            scenario->terms[i].amount < 0) {
+            fprintf(stderr, "Error: Compiled scenario %s has a bad recipe term %u.\n", path, i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Parses a text scenario and compiles it into an in-memory image.
+ *
+ * @param[out] scenario  Pointer to the `Scenario` to fill.
+ * @param[in]  path      Path of the text file.
+ */
+static void scenario_parse_text(Scenario *scenario, const char *path) {
+    ScenarioBuilder builder = {0};
+    FILE *file = fopen(path, "r");
+    char *line = NULL;
+    size_t line_capacity = 0;
+    int line_number = 0;
+
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open scenario file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    while (getline(&line, &line_capacity, file) != -1) {
+        char *tokens[8];
+        int count;
+
+        line_number++;
+        count = scenario_tokenize(line, tokens, 8);
+        if (count == 0) {
+            continue;
+        }
+
+        if (strcmp(tokens[0], "resource") == 0 && (count == 4 || count == 5)) {
+            if (scenario_find_resource(&builder, tokens[1]) >= 0) {
+                fprintf(stderr, "Error: %s:%d: resource %s is defined twice.\n", path, line_number, tokens[1]);
+                exit(EXIT_FAILURE);
+            }
+            if (builder.resource_count == builder.resource_capacity) {
+                builder.resources = scenario_grow(builder.resources, &builder.resource_capacity, sizeof(ScenarioResource));
+            }
+            ScenarioResource *record = &builder.resources[builder.resource_count++];
+            record->name_offset = scenario_add_string(&builder, tokens[1]);
+            record->amount = scenario_parse_count(tokens[2], "amount", path, line_number);
+            record->max_capacity = scenario_parse_count(tokens[3], "capacity", path, line_number);
+            record->flags = (count == 5) ? scenario_parse_flags(tokens[4], path, line_number) : 0;
+            if (record->amount > record->max_capacity) {
+                fprintf(stderr, "Error: %s:%d: resource %s starts with %d units, above its capacity %d.\n",
+                        path, line_number, tokens[1], record->amount, record->max_capacity);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(tokens[0], "system") == 0 && (count == 7 || count == 5)) {
+            if (builder.system_count == builder.system_capacity) {
+                builder.systems = scenario_grow(builder.systems, &builder.system_capacity, sizeof(ScenarioSystem));
+            }
+            ScenarioSystem *record = &builder.systems[builder.system_count++];
+            record->name_offset = scenario_add_string(&builder, tokens[1]);
+            record->first_term = (unsigned int)builder.term_count;
+
+            if (count == 7) {
+                // Single input and output: <consumed> <amount> <produced> <amount>
+                int consumed = (strcmp(tokens[2], "-") == 0) ? -1 : scenario_find_resource(&builder, tokens[2]);
+                int produced = (strcmp(tokens[4], "-") == 0) ? -1 : scenario_find_resource(&builder, tokens[4]);
+                if ((consumed < 0 && strcmp(tokens[2], "-") != 0) || (produced < 0 && strcmp(tokens[4], "-") != 0)) {
+                    fprintf(stderr, "Error: %s:%d: system %s uses an undefined resource.\n", path, line_number, tokens[1]);
+                    exit(EXIT_FAILURE);
+                }
+                record->input_count = (consumed < 0) ? 0 : 1;
+                if (consumed >= 0) {
+                    scenario_add_term(&builder, consumed, scenario_parse_count(tokens[3], "amount", path, line_number));
+                }
+                record->output_count = (produced < 0) ? 0 : 1;
+                if (produced >= 0) {
+                    scenario_add_term(&builder, produced, scenario_parse_count(tokens[5], "amount", path, line_number));
+                }
+                record->processing_time = scenario_parse_count(tokens[6], "processing time", path, line_number);
+            } else {
+                // Recipe: <inputs> <outputs>
+                record->input_count = scenario_add_terms(&builder, tokens[2], path, line_number);
+                record->output_count = scenario_add_terms(&builder, tokens[3], path, line_number);
+                record->processing_time = scenario_parse_count(tokens[4], "processing time", path, line_number);
+            }
+        } else {
+            fprintf(stderr, "Error: %s:%d: expected 'resource <name> <amount> <max> [flags]', "
+                            "'system <name> <consumed> <amount> <produced> <amount> <time>' or "
+                            "'system <name> <inputs> <outputs> <time>'.\n", path, line_number);
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(line);
+    fclose(file);
+
+    if (builder.string_size == 0) {
+        scenario_add_string(&builder, ""); // Keep the string table non-empty and NUL-terminated
+    }
+
+    // Lay the tables out exactly like the compiled format
+    size_t resources_size = (size_t)builder.resource_count * sizeof(ScenarioResource);
+    size_t systems_size = (size_t)builder.system_count * sizeof(ScenarioSystem);
+    size_t terms_size = (size_t)builder.term_count * sizeof(ScenarioTerm);
+    size_t size = sizeof(ScenarioHeader) + resources_size + systems_size + terms_size + builder.string_size;
+    char *base = malloc(size);
+    if (base == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Scenario.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ScenarioHeader *header = (ScenarioHeader *)base;
+    memcpy(header->magic, SCENARIO_MAGIC, sizeof(header->magic));
+    header->version = SCENARIO_VERSION;
+    header->resource_count = (unsigned int)builder.resource_count;
+    header->system_count = (unsigned int)builder.system_count;
+    header->term_count = (unsigned int)builder.term_count;
+    header->string_size = (unsigned int)builder.string_size;
+    char *cursor = base + sizeof(ScenarioHeader);
+    memcpy(cursor, builder.resources, resources_size);
+    cursor += resources_size;
+    memcpy(cursor, builder.systems, systems_size);
+    cursor += systems_size;
+    memcpy(cursor, builder.terms, terms_size);
+    cursor += terms_size;
+    memcpy(cursor, builder.strings, builder.string_size);
+    free(builder.resources);
+    free(builder.systems);
+    free(builder.terms);
+    free(builder.strings);
+
+    scenario->mapped = 0;
+    scenario_set_view(scenario, base, size);
+}
+
+/**
+ * Points the table views of a `Scenario` into its image.
+ *
+ * @param[out] scenario  Pointer to the `Scenario`.
+ * @param[in]  base      Start of the image (the header).
+ * @param[in]  size      Size of the image in bytes.
+ */
+static void scenario_set_view(Scenario *scenario, void *base, size_t size) {
+    const char *cursor = (const char *)base;
+
+    scenario->base = base;
+    scenario->size = size;
+    scenario->header = (const ScenarioHeader *)cursor;
+    cursor += sizeof(ScenarioHeader);
+    scenario->resources = (const ScenarioResource *)cursor;
+    cursor += (size_t)scenario->header->resource_count * sizeof(ScenarioResource);
+    scenario->systems = (const ScenarioSystem *)cursor;
+    cursor += (size_t)scenario->header->system_count * sizeof(ScenarioSystem);
+    scenario->terms = (const ScenarioTerm *)cursor;
+    cursor += (size_t)scenario->header->term_count * sizeof(ScenarioTerm);
+    scenario->strings = cursor;
+}
+
+/**
+ * Splits a line into whitespace-separated tokens in place.
+ *
+ * Double quotes group words into one token, `#` outside quotes ends the line.
+ *
+ * @param[in,out] line        Line to split; separators are overwritten with NUL.
+ * @param[out]    tokens      Receives pointers to the tokens.
+ * @param[in]     max_tokens  Capacity of `tokens`.
+ * @return                    Number of tokens, or `max_tokens + 1` if there were too many.
+ */
+static int scenario_tokenize(char *line, char **tokens, int max_tokens) {
+    int count = 0;
+    char *cursor = line;
+
+    while (*cursor != '\0') {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n') {
+            cursor++;
+        }
+        if (*cursor == '\0' || *cursor == '#') {
+            break;
+        }
+        if (count == max_tokens) {
+            return max_tokens + 1;
+        }
+
+        if (*cursor == '"') {
+            tokens[count++] = ++cursor;
+            while (*cursor != '\0' && *cursor != '"') {
+                cursor++;
+            }
+        } else {
+            tokens[count++] = cursor;
+            while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n') {
+                cursor++;
+            }
+        }
+        if (*cursor != '\0') {
+            *cursor++ = '\0';
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Looks up a resource defined earlier in the scenario by name.
+ *
+ * @param[in] builder  The scenario being parsed.
+ * @param[in] name     Resource name.
+ * @return             Index of the resource, or -1 if it is not defined.
+ */
+static int scenario_find_resource(const ScenarioBuilder *builder, const char *name) {
+    for (int i = 0; i < builder->resource_count; i++) {
+        if (strcmp(builder->strings + builder->resources[i].name_offset, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Parses a comma-separated resource flag list such as `critical,alarm-low`.
+ *
+ * @param[in,out] list         The list token; split in place.
+ * @param[in]     path         Path of the file, for error messages.
+ * @param[in]     line_number  Line of the list, for error messages.
+ * @return                     The `RESOURCE_FLAG_*` bits.
+ */
+static uint32_t scenario_parse_flags(char *list, const char *path, int line_number) {
+    uint32_t flags = 0;
+
+    while (list != NULL) {
+        char *next = strchr(list, ',');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+
+        if (strcmp(list, "critical") == 0) {
+            flags |= RESOURCE_FLAG_CRITICAL;
+        } else if (strcmp(list, "alarm-low") == 0) {
+            flags |= RESOURCE_FLAG_ALARM_LOW;
+        } else if (strcmp(list, "sharded") == 0) {
+            flags |= RESOURCE_FLAG_SHARDED;
+        } else {
+            fprintf(stderr, "Error: %s:%d: unknown resource flag '%s', expected critical, alarm-low or sharded.\n",
+                    path, line_number, list);
+            exit(EXIT_FAILURE);
+        }
+        list = next;
+    }
+
+    return flags;
+}
+
+/**
+ * Parses an amount, capacity or processing time.
+ *
+ * @param[in] token        The token, must be all decimal digits.
+ * @param[in] what         What the number is, for error messages.
+ * @param[in] path         Path of the file, for error messages.
+ * @param[in] line_number  Line of the token, for error messages.
+ * @return                 The value, in [0, INT_MAX].
+ */
+static int scenario_parse_count(const char *token, const char *what, const char *path, int line_number) {
+    char *end;
+    errno = 0;
+    long value = strtol(token, &end, 10);
+
+    if (end == token || *end != '\0' || errno != 0 || value < 0 || value > INT_MAX) {
+        fprintf(stderr, "Error: %s:%d: %s '%s' must be a non-negative integer.\n", path, line_number, what, token);
+        exit(EXIT_FAILURE);
+    }
+    return (int)value;
+}
+
+/**
+ * Parses a comma-separated recipe list such as `Fuel:5,Oxygen:2` and appends its terms.
+ *
+ * @param[in,out] builder      The scenario being parsed.
+ * @param[in,out] list         The list token, `-` for an empty list; split in place.
+ * @param[in]     path         Path of the file, for error messages.
+ * @param[in]     line_number  Line of the list, for error messages.
+ * @return                     Number of terms appended.
+ */
+static unsigned int scenario_add_terms(ScenarioBuilder *builder, char *list, const char *path, int line_number) {
+    unsigned int count = 0;
+
+    if (strcmp(list, "-") == 0) {
+        return 0;
+    }
+
+    while (list != NULL) {
+        char *next = strchr(list, ',');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+
+        // Split at the last colon, so resource names may contain colons
+        char *colon = strrchr(list, ':');
+        int resource = -1;
+        if (colon != NULL) {
+            *colon = '\0';
+            resource = scenario_find_resource(builder, list);
+        }
+        if (resource < 0) {
+            fprintf(stderr, "Error: %s:%d: bad recipe term '%s', expected a defined <resource>:<amount>.\n",
+                    path, line_number, list);
+            exit(EXIT_FAILURE);
+        }
+        scenario_add_term(builder, resource, scenario_parse_count(colon + 1, "amount", path, line_number));
+        count++;
+        list = next;
+    }
+
+    return count;
+}
+
+/**
+ * Appends one recipe term to the term table.
+ *
+ * @param[in,out] builder   The scenario being parsed.
+ * @param[in]     resource  Resource index.
+ * @param[in]     amount    Units consumed or produced.
+ */
+static void scenario_add_term(ScenarioBuilder *builder, int resource, int amount) {
+    if (builder->term_count == builder->term_capacity) {
+        builder->terms = scenario_grow(builder->terms, &builder->term_capacity, sizeof(ScenarioTerm));
+    }
+    builder->terms[builder->term_count].resource = resource;
+    builder->terms[builder->term_count].amount = amount;
+    builder->term_count++;
+}
+
+/**
+ * Appends a NUL-terminated string to the string table.
+ *
+ * @param[in,out] builder  The scenario being parsed.
+ * @param[in]     string   String to copy.
+ * @return                 Offset of the copy in the string table.
+ */
+static unsigned int scenario_add_string(ScenarioBuilder *builder, const char *string) {
+    size_t length = strlen(string) + 1;
+
+    while (builder->string_size + length > builder->string_capacity) {
+        size_t new_capacity = (builder->string_capacity == 0) ? 256 : builder->string_capacity * 2;
+        char *new_strings = malloc(new_capacity);
+        if (new_strings == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed for Scenario strings.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (builder->strings != NULL) {
+            memcpy(new_strings, builder->strings, builder->string_size);
+        }
+        free(builder->strings);
+        builder->strings = new_strings;
+        builder->string_capacity = new_capacity;
+    }
+
+    memcpy(builder->strings + builder->string_size, string, length);
+    builder->string_size += length;
+    return (unsigned int)(builder->string_size - length);
+}
+
+/**
+ * Doubles the capacity of a record array (starting at 16), copying the old contents.
+ *
+ * @param[in]     array         Current array, may be NULL.
+ * @param[in,out] capacity      Current capacity in elements, updated.
+ * @param[in]     element_size  Size of one element.
+ * @return                      The new array.
+ */
+static void *scenario_grow(void *array, int *capacity, size_t element_size) {
+    int new_capacity = (*capacity == 0) ? 16 : *capacity * 2;
+    void *new_array = malloc(element_size * new_capacity);
+
+    if (new_array == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Scenario records.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (array != NULL) {
+        memcpy(new_array, array, element_size * (*capacity));
+    }
+    free(array);
+    *capacity = new_capacity;
+    return new_array;
+}
+
+/**
+ * Scales a value by a random factor in [1 - spread, 1 + spread], rounding to the nearest integer.
+ *
+ * The factors come from a splitmix64 sequence, so they depend only on the seed.
+ *
+ * @param[in]     value   Value to scale.
+ * @param[in]     spread  Largest relative change.
+ * @param[in,out] state   State of the random sequence.
+ * @return                The scaled value, never negative.
+ */
+static int scenario_scale(int value, double spread, unsigned long long *state) {
+    unsigned long long random = (*state += 0x9E3779B97F4A7C15ULL);
+    random = (random ^ (random >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    random = (random ^ (random >> 27)) * 0x94D049BB133111EBULL;
+    random ^= random >> 31;
+
+    double factor = 1.0 + spread * (2.0 * (double)(random >> 11) / 9007199254740992.0 - 1.0);
+    double scaled = value * factor + 0.5;
+    return (scaled < 0.0) ? 0 : (int)scaled;
+}
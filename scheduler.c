@@ -0,0 +1,459 @@
+#define _GNU_SOURCE // pthread_setaffinity_np
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+// Helper functions just used by this C file to clean up our code
+static void *scheduler_worker_func(void *arg);
+static void *scheduler_timer_func(void *arg);
+static System *scheduler_take(Worker *worker);
+static void scheduler_enqueue(Scheduler *scheduler, Worker *worker, System *system);
+static void scheduler_idle(Scheduler *scheduler);
+static void scheduler_park(Scheduler *scheduler, System *system, unsigned long long deadline);
+static unsigned long long scheduler_now_ms(void);
+static void scheduler_wake(System *system, void *context);
+static Worker *scheduler_home(Scheduler *scheduler, System *system, Worker *fallback);
+static void scheduler_pin(Worker *worker);
+
+// Worker running on the current thread, NULL outside the pool
+static __thread Worker *current_worker = NULL;
+
+static void work_deque_init(WorkDeque *deque, int capacity);
+static void work_deque_clean(WorkDeque *deque);
+static void work_deque_push(WorkDeque *deque, System *system);
+static System *work_deque_pop(WorkDeque *deque);
+static System *work_deque_steal(WorkDeque *deque);
+
+/**
+ * Starts the scheduler.
+ *
+ * Spreads the systems over `worker_count` deques and starts one thread per
+ * worker plus the timer thread that drives the timer wheel and wakes parked
+ * systems once they are due. A system with a `home` always goes back onto the
+ * deque of that worker; idle workers may still steal it.
+ *
+ * @param[out] scheduler     Pointer to the `Scheduler` to start.
+ * @param[in]  systems       Systems to run; must not change while the scheduler runs.
+ * @param[in]  worker_count  Requested number of workers, clamped to [1, number of systems].
+ * @param[in]  simulation_running  Termination flag; once it reads zero no system starts another step.
+ * @param[in]  pin           Non-zero to pin worker `i` to core `i` (modulo the online cores).
+ */
+void scheduler_start(Scheduler *scheduler, SystemArray *systems, int worker_count, atomic_int *simulation_running, int pin) {
+    int capacity = (systems->size > 0) ? systems->size : 1;
+
+    if (worker_count < 1) {
+        worker_count = 1;
+    }
+    if (worker_count > capacity) {
+        worker_count = capacity;
+    }
+
+    scheduler->workers = malloc(sizeof(Worker) * worker_count);
+    if (scheduler->workers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Scheduler.\n");
+        exit(EXIT_FAILURE);
+    }
+    scheduler->worker_count = worker_count;
+    timer_wheel_init(&scheduler->timers, scheduler_now_ms());
+    scheduler->next_worker = 0;
+    scheduler->pinned = pin;
+    atomic_init(&scheduler->running, 1);
+    scheduler->simulation_running = simulation_running;
+    atomic_init(&scheduler->pending, 0);
+    atomic_init(&scheduler->idle_workers, 0);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // Deadlines are monotonic
+    pthread_mutex_init(&scheduler->idle_mutex, NULL);
+    pthread_cond_init(&scheduler->idle_cond, NULL);
+    pthread_mutex_init(&scheduler->timer_mutex, NULL);
+    pthread_cond_init(&scheduler->timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    for (int i = 0; i < worker_count; i++) {
+        scheduler->workers[i].index = i;
+        scheduler->workers[i].scheduler = scheduler;
+        work_deque_init(&scheduler->workers[i].deque, capacity);
+    }
+
+    // Every system starts out runnable, at home or distributed round-robin
+    for (int i = 0; i < systems->size; i++) {
+        if (systems->systems[i] == NULL) {
+            fprintf(stderr, "Error: System at index %d is NULL.\n", i);
+            continue; // Skip this system and proceed with the next
+        }
+        systems->systems[i]->wake = scheduler_wake;
+        systems->systems[i]->wake_context = scheduler;
+        atomic_fetch_add(&scheduler->pending, 1);
+        work_deque_push(&scheduler_home(scheduler, systems->systems[i], &scheduler->workers[i % worker_count])->deque,
+                        systems->systems[i]);
+    }
+
+    if (pthread_create(&scheduler->timer_thread, NULL, scheduler_timer_func, scheduler) != 0) {
+        fprintf(stderr, "Error: Failed to create scheduler timer thread.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&scheduler->workers[i].thread, NULL, scheduler_worker_func, &scheduler->workers[i]) != 0) {
+            fprintf(stderr, "Error: Failed to create scheduler worker thread %d.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Stops the scheduler.
+ *
+ * Workers finish the step they are running, then all threads are joined and
+ * the scheduler's memory is released. Parked systems are simply dropped.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler` to stop.
+ */
+void scheduler_stop(Scheduler *scheduler) {
+    atomic_store(&scheduler->running, 0);
+
+    pthread_mutex_lock(&scheduler->idle_mutex);
+    pthread_cond_broadcast(&scheduler->idle_cond);
+    pthread_mutex_unlock(&scheduler->idle_mutex);
+
+    pthread_mutex_lock(&scheduler->timer_mutex);
+    pthread_cond_signal(&scheduler->timer_cond);
+    pthread_mutex_unlock(&scheduler->timer_mutex);
+
+    for (int i = 0; i < scheduler->worker_count; i++) {
+        pthread_join(scheduler->workers[i].thread, NULL);
+        work_deque_clean(&scheduler->workers[i].deque);
+    }
+    pthread_join(scheduler->timer_thread, NULL);
+
+    pthread_mutex_destroy(&scheduler->idle_mutex);
+    pthread_cond_destroy(&scheduler->idle_cond);
+    pthread_mutex_destroy(&scheduler->timer_mutex);
+    pthread_cond_destroy(&scheduler->timer_cond);
+    free(scheduler->workers);
+    scheduler->workers = NULL;
+    scheduler->worker_count = 0;
+}
+
+/**
+ * Thread function of a worker.
+ *
+ * Runs one step of a runnable system at a time. Systems that want to run again
+ * immediately go back on the worker's deque, systems blocked on a resource are
+ * left to its wait list, and all others are parked on the timer.
+ *
+ * @param[in] arg  Pointer to the `Worker`.
+ * @return         NULL.
+ */
+static void *scheduler_worker_func(void *arg) {
+    Worker *worker = (Worker *)arg;
+    Scheduler *scheduler = worker->scheduler;
+
+    current_worker = worker;
+    if (scheduler->pinned) {
+        scheduler_pin(worker);
+    }
+    while (atomic_load(&scheduler->running)) {
+        System *system = scheduler_take(worker);
+        if (system == NULL) {
+            scheduler_idle(scheduler);
+            continue;
+        }
+
+        // A cleared simulation flag stops every system, TERMINATE stops just this one
+        if (!atomic_load_explicit(scheduler->simulation_running, memory_order_acquire) ||
+            system_get_status(system) == TERMINATE) {
+            continue; // Drop the system, it will not be scheduled again
+        }
+
+        int delay = system_run(system);
+        if (delay == SYSTEM_BLOCKED) {
+            continue; // The resource's wait list owns the system until scheduler_wake
+        } else if (delay <= 0) {
+            scheduler_enqueue(scheduler, worker, system);
+        } else {
+            scheduler_park(scheduler, system, scheduler_now_ms() + delay);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Thread function of the timer.
+ *
+ * Sleeps until the wheel's next expiry, advances it to the current time and
+ * hands every expired system back to a worker. The thread only wakes when a
+ * timer can actually be due, never on a fixed polling interval.
+ *
+ * @param[in] arg  Pointer to the `Scheduler`.
+ * @return         NULL.
+ */
+static void *scheduler_timer_func(void *arg) {
+    Scheduler *scheduler = (Scheduler *)arg;
+
+    pthread_mutex_lock(&scheduler->timer_mutex);
+    while (atomic_load(&scheduler->running)) {
+        TimerNode *expired = timer_wheel_advance(&scheduler->timers, scheduler_now_ms());
+
+        if (expired != NULL) {
+            pthread_mutex_unlock(&scheduler->timer_mutex);
+            while (expired != NULL) {
+                TimerNode *next = expired->next;
+                System *system = (System *)expired->owner;
+                Worker *worker = scheduler_home(scheduler, system, &scheduler->workers[scheduler->next_worker]);
+                if (system->home < 0) {
+                    scheduler->next_worker = (scheduler->next_worker + 1) % scheduler->worker_count;
+                }
+                scheduler_enqueue(scheduler, worker, system);
+                expired = next;
+            }
+            pthread_mutex_lock(&scheduler->timer_mutex);
+            continue;
+        }
+
+        unsigned long long deadline = timer_wheel_next_expiry(&scheduler->timers);
+        if (deadline == TIMER_NEVER) {
+            pthread_cond_wait(&scheduler->timer_cond, &scheduler->timer_mutex);
+            continue;
+        }
+
+        struct timespec wake;
+        wake.tv_sec = deadline / 1000;
+        wake.tv_nsec = (deadline % 1000) * 1000000L;
+        pthread_cond_timedwait(&scheduler->timer_cond, &scheduler->timer_mutex, &wake);
+    }
+    pthread_mutex_unlock(&scheduler->timer_mutex);
+
+    return NULL;
+}
+
+/**
+ * Takes the next system for a worker, from its own deque first, otherwise by stealing.
+ *
+ * @param[in,out] worker  Pointer to the `Worker` looking for work.
+ * @return                A runnable `System`, or NULL if every deque is empty.
+ */
+static System *scheduler_take(Worker *worker) {
+    Scheduler *scheduler = worker->scheduler;
+    System *system = work_deque_pop(&worker->deque);
+
+    for (int i = 1; system == NULL && i < scheduler->worker_count; i++) {
+        Worker *victim = &scheduler->workers[(worker->index + i) % scheduler->worker_count];
+        system = work_deque_steal(&victim->deque);
+    }
+
+    if (system != NULL) {
+        atomic_fetch_sub(&scheduler->pending, 1);
+    }
+    return system;
+}
+
+/**
+ * Makes a system runnable on the given worker and wakes an idle worker if there is one.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler`.
+ * @param[in,out] worker     Worker whose deque receives the system.
+ * @param[in]     system     The runnable `System`.
+ */
+static void scheduler_enqueue(Scheduler *scheduler, Worker *worker, System *system) {
+    // Count first so `pending` never drops below the number of queued systems
+    atomic_fetch_add(&scheduler->pending, 1);
+    work_deque_push(&worker->deque, system);
+
+    if (atomic_load(&scheduler->idle_workers) > 0) {
+        pthread_mutex_lock(&scheduler->idle_mutex);
+        pthread_cond_signal(&scheduler->idle_cond);
+        pthread_mutex_unlock(&scheduler->idle_mutex);
+    }
+}
+
+/**
+ * Blocks a worker until a system becomes runnable or the scheduler stops.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler`.
+ */
+static void scheduler_idle(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->idle_mutex);
+    atomic_fetch_add(&scheduler->idle_workers, 1);
+    while (atomic_load(&scheduler->running) && atomic_load(&scheduler->pending) == 0) {
+        pthread_cond_wait(&scheduler->idle_cond, &scheduler->idle_mutex);
+    }
+    atomic_fetch_sub(&scheduler->idle_workers, 1);
+    pthread_mutex_unlock(&scheduler->idle_mutex);
+}
+
+/**
+ * Parks a system on the timer wheel until `deadline`.
+ *
+ * The timer thread is woken if the new deadline comes before the one it sleeps towards.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler`.
+ * @param[in]     system     The `System` to park.
+ * @param[in]     deadline   Monotonic time in milliseconds at which it becomes runnable.
+ */
+static void scheduler_park(Scheduler *scheduler, System *system, unsigned long long deadline) {
+    pthread_mutex_lock(&scheduler->timer_mutex);
+    unsigned long long previous = timer_wheel_next_expiry(&scheduler->timers);
+    timer_wheel_add(&scheduler->timers, &system->timer, deadline);
+    if (deadline < previous) {
+        pthread_cond_signal(&scheduler->timer_cond);
+    }
+    pthread_mutex_unlock(&scheduler->timer_mutex);
+}
+
+/**
+ * Wake hook of every scheduled system, called when a resource it waits on can satisfy it.
+ *
+ * The system goes back to its home worker. Without a home it goes onto the deque
+ * of the worker that woke it, if any, since that is the thread that just touched the resource.
+ *
+ * @param[in,out] system   The `System` that can run again.
+ * @param[in]     context  Pointer to the `Scheduler`.
+ */
+static void scheduler_wake(System *system, void *context) {
+    Scheduler *scheduler = (Scheduler *)context;
+    Worker *worker = (current_worker != NULL) ? current_worker : &scheduler->workers[0];
+
+    scheduler_enqueue(scheduler, scheduler_home(scheduler, system, worker), system);
+}
+
+/**
+ * Picks the worker whose deque a system goes onto.
+ *
+ * @param[in] scheduler  Pointer to the `Scheduler`.
+ * @param[in] system     The `System`.
+ * @param[in] fallback   Worker used when the system has no home.
+ * @return               The system's home worker, or `fallback`.
+ */
+static Worker *scheduler_home(Scheduler *scheduler, System *system, Worker *fallback) {
+    if (system->home < 0) {
+        return fallback;
+    }
+    return &scheduler->workers[system->home % scheduler->worker_count];
+}
+
+/**
+ * Pins the calling worker thread to one core.
+ *
+ * A failure only costs the affinity, the worker runs on wherever the kernel puts it.
+ *
+ * @param[in] worker  The `Worker` running on the calling thread.
+ */
+static void scheduler_pin(Worker *worker) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET((int)(worker->index % ((cores > 0) ? cores : 1)), &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        LOG_DEBUG("Worker %d could not be pinned to a core.\n", worker->index);
+    }
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Milliseconds since an arbitrary fixed point.
+ */
+static unsigned long long scheduler_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000ULL + (unsigned long long)now.tv_nsec / 1000000ULL;
+}
+
+/* WorkDeque functions */
+
+/**
+ * Initializes a `WorkDeque` able to hold `capacity` systems.
+ *
+ * @param[out] deque     Pointer to the `WorkDeque` to initialize.
+ * @param[in]  capacity  Maximum number of entries.
+ */
+static void work_deque_init(WorkDeque *deque, int capacity) {
+    deque->items = malloc(sizeof(System *) * capacity);
+    if (deque->items == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for WorkDeque.\n");
+        exit(EXIT_FAILURE);
+    }
+    deque->capacity = capacity;
+    deque->head = 0;
+    deque->count = 0;
+    pthread_mutex_init(&deque->mutex, NULL);
+}
+
+/**
+ * Frees the memory of a `WorkDeque`.
+ *
+ * @param[in,out] deque  Pointer to the `WorkDeque` to clean.
+ */
+static void work_deque_clean(WorkDeque *deque) {
+    free(deque->items);
+    deque->items = NULL;
+    deque->count = 0;
+    pthread_mutex_destroy(&deque->mutex);
+}
+
+/**
+ * Adds a system at the tail of a `WorkDeque`.
+ *
+ * A system is only ever in one deque, so the capacity (the number of systems) is never exceeded.
+ *
+ * @param[in,out] deque   Pointer to the `WorkDeque`.
+ * @param[in]     system  The `System` to add.
+ */
+static void work_deque_push(WorkDeque *deque, System *system) {
+    pthread_mutex_lock(&deque->mutex);
+    deque->items[(deque->head + deque->count) % deque->capacity] = system;
+    deque->count++;
+    pthread_mutex_unlock(&deque->mutex);
+}
+
+/**
+ * Removes the system at the head of a `WorkDeque`, used by the owning worker.
+ *
+ * The owner runs its systems in FIFO order so a system that keeps asking to
+ * run immediately cannot starve the others.
+ *
+ * @param[in,out] deque  Pointer to the `WorkDeque`.
+ * @return               The oldest `System`, or NULL if empty.
+ */
+static System *work_deque_pop(WorkDeque *deque) {
+    System *system = NULL;
+
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        system = deque->items[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+
+    return system;
+}
+
+/**
+ * Removes the system at the tail of a `WorkDeque`, used by other workers.
+ *
+ * Thieves work the opposite end from the owner.
+ *
+ * @param[in,out] deque  Pointer to the `WorkDeque`.
+ * @return               The newest `System`, or NULL if empty.
+ */
+static System *work_deque_steal(WorkDeque *deque) {
+    System *system = NULL;
+
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count > 0) {
+        deque->count--;
+        system = deque->items[(deque->head + deque->count) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->mutex);
+
+    return system;
+}
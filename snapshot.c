@@ -0,0 +1,218 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// Helper functions just used by this C file to clean up our code
+static void snapshot_buffer_init(SnapshotBuffer *buffer, int resource_count, int system_count);
+static void snapshot_write_json_string(FILE *file, const char *string);
+
+/**
+ * Initializes a `Snapshot` sized for the given number of resources and systems.
+ *
+ * No frame is published until the first `snapshot_publish`.
+ *
+ * @param[out] snapshot        Pointer to the `Snapshot` to initialize.
+ * @param[in]  resource_count  Number of resources every frame holds.
+ * @param[in]  system_count    Number of systems every frame holds.
+ */
+void snapshot_init(Snapshot *snapshot, int resource_count, int system_count) {
+    atomic_init(&snapshot->sequence, 0);
+    snapshot->resource_count = resource_count;
+    snapshot->system_count = system_count;
+    snapshot_buffer_init(&snapshot->buffers[0], resource_count, system_count);
+    snapshot_buffer_init(&snapshot->buffers[1], resource_count, system_count);
+}
+
+/**
+ * Frees both buffers of a `Snapshot`.
+ *
+ * @param[in,out] snapshot  Pointer to the `Snapshot` to clean.
+ */
+void snapshot_clean(Snapshot *snapshot) {
+    for (int i = 0; i < 2; i++) {
+        free(snapshot->buffers[i].amounts);
+        free(snapshot->buffers[i].statuses);
+        snapshot->buffers[i].amounts = NULL;
+        snapshot->buffers[i].statuses = NULL;
+    }
+}
+
+/**
+ * Publishes a new frame with the current amount of every resource and status of every system.
+ *
+ * Only one thread may publish. The frame goes into the buffer readers are not
+ * using, so publishing never waits for a reader and costs one relaxed load and
+ * store per value plus two stores of `sequence`.
+ *
+ * @param[in,out] snapshot   Pointer to the `Snapshot`.
+ * @param[in]     resources  Resources, in the order the snapshot reports them.
+ * @param[in]     systems    Systems, in the order the snapshot reports them.
+ * @param[in]     now        Simulation time of the frame in milliseconds.
+ * @param[in]     running    Non-zero while the simulation runs.
+ */
+void snapshot_publish(Snapshot *snapshot, const ResourceArray *resources, const SystemArray *systems,
+                      unsigned long long now, int running) {
+    unsigned int sequence = atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+    SnapshotBuffer *buffer = &snapshot->buffers[(sequence / 2 + 1) % 2];
+
+    // Odd while writing, readers of the other buffer are unaffected
+    atomic_store_explicit(&snapshot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&buffer->time, now, memory_order_relaxed);
+    atomic_store_explicit(&buffer->running, running, memory_order_relaxed);
+    for (int i = 0; i < snapshot->resource_count && i < resources->size; i++) {
+        atomic_store_explicit(&buffer->amounts[i], resource_get_amount(resources->resources[i]), memory_order_relaxed);
+    }
+    for (int i = 0; i < snapshot->system_count && i < systems->size; i++) {
+        atomic_store_explicit(&buffer->statuses[i], system_get_status(systems->systems[i]), memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&snapshot->sequence, sequence + 2, memory_order_release);
+}
+
+/**
+ * Allocates a reader's private copy of a snapshot frame.
+ *
+ * @param[out] frame     Pointer to the `SnapshotFrame` to initialize.
+ * @param[in]  snapshot  Snapshot the frame will be read from.
+ */
+void snapshot_frame_init(SnapshotFrame *frame, const Snapshot *snapshot) {
+    frame->number = 0;
+    frame->time = 0;
+    frame->running = 0;
+    frame->resource_count = snapshot->resource_count;
+    frame->system_count = snapshot->system_count;
+    frame->amounts = calloc(snapshot->resource_count + 1, sizeof(int));
+    frame->statuses = calloc(snapshot->system_count + 1, sizeof(int));
+    if (frame->amounts == NULL || frame->statuses == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for SnapshotFrame.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Frees a reader's copy of a snapshot frame.
+ *
+ * @param[in,out] frame  Pointer to the `SnapshotFrame` to clean.
+ */
+void snapshot_frame_clean(SnapshotFrame *frame) {
+    free(frame->amounts);
+    free(frame->statuses);
+    frame->amounts = NULL;
+    frame->statuses = NULL;
+}
+
+/**
+ * Copies the latest complete frame of a `Snapshot`.
+ *
+ * Lock-free: the copy is retried only if the publisher lapped the reader and
+ * started rewriting the buffer being copied, which needs two publishes during one copy.
+ *
+ * @param[in]  snapshot  Pointer to the `Snapshot`.
+ * @param[out] frame     Receives the frame; allocated with `snapshot_frame_init`.
+ * @return               Non-zero if a frame was copied, zero if nothing was published yet.
+ */
+int snapshot_read(Snapshot *snapshot, SnapshotFrame *frame) {
+    while (1) {
+        unsigned int begin = atomic_load_explicit(&snapshot->sequence, memory_order_acquire);
+        unsigned int number = begin / 2;  // Last complete frame, also while the next one is written
+        if (number == 0) {
+            return 0;
+        }
+
+        const SnapshotBuffer *buffer = &snapshot->buffers[number % 2];
+        frame->number = number;
+        frame->time = atomic_load_explicit(&buffer->time, memory_order_relaxed);
+        frame->running = atomic_load_explicit(&buffer->running, memory_order_relaxed);
+        for (int i = 0; i < frame->resource_count; i++) {
+            frame->amounts[i] = atomic_load_explicit(&buffer->amounts[i], memory_order_relaxed);
+        }
+        for (int i = 0; i < frame->system_count; i++) {
+            frame->statuses[i] = atomic_load_explicit(&buffer->statuses[i], memory_order_relaxed);
+        }
+
+        // The buffer is rewritten once frame number + 2 starts, at sequence 2 * number + 3
+        atomic_thread_fence(memory_order_acquire);
+        unsigned int end = atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+        if (end - 2 * number < 3) {
+            return 1;
+        }
+    }
+}
+
+/**
+ * Writes a snapshot frame as one line of JSON.
+ *
+ * Format: {"frame":N,"time_ms":T,"running":B,"resources":{"Name":{"amount":A,"max":M},...},
+ *          "systems":{"Name":"STATUS",...}}
+ *
+ * @param[in] frame      The frame to write.
+ * @param[in] resources  Resources the frame was published from, for names and capacities.
+ * @param[in] systems    Systems the frame was published from, for names.
+ * @param[in] file       Stream to write to.
+ */
+void snapshot_write_json(const SnapshotFrame *frame, const ResourceArray *resources, const SystemArray *systems, FILE *file) {
+    static const char *status_names[] = {"TERMINATE", "DISABLED", "SLOW", "STANDARD", "FAST"};
+
+    fprintf(file, "{\"frame\":%u,\"time_ms\":%llu,\"running\":%s,\"resources\":{",
+            frame->number, frame->time, frame->running ? "true" : "false");
+    for (int i = 0; i < frame->resource_count && i < resources->size; i++) {
+        fprintf(file, "%s", (i > 0) ? "," : "");
+        snapshot_write_json_string(file, resources->resources[i]->name);
+        fprintf(file, ":{\"amount\":%d,\"max\":%d}", frame->amounts[i], resources->resources[i]->max_capacity);
+    }
+    fprintf(file, "},\"systems\":{");
+    for (int i = 0; i < frame->system_count && i < systems->size; i++) {
+        int status = frame->running ? frame->statuses[i] : TERMINATE;
+        fprintf(file, "%s", (i > 0) ? "," : "");
+        snapshot_write_json_string(file, systems->systems[i]->name);
+        fprintf(file, ":\"%s\"", (status >= TERMINATE && status <= FAST) ? status_names[status] : "UNKNOWN");
+    }
+    fprintf(file, "}}\n");
+    fflush(file);
+}
+
+/**
+ * Allocates the value arrays of one snapshot buffer.
+ *
+ * @param[out] buffer          Pointer to the `SnapshotBuffer`.
+ * @param[in]  resource_count  Number of resource amounts.
+ * @param[in]  system_count    Number of system statuses.
+ */
+static void snapshot_buffer_init(SnapshotBuffer *buffer, int resource_count, int system_count) {
+    atomic_init(&buffer->time, 0);
+    atomic_init(&buffer->running, 0);
+    buffer->amounts = malloc(sizeof(atomic_int) * (resource_count + 1));
+    buffer->statuses = malloc(sizeof(atomic_int) * (system_count + 1));
+    if (buffer->amounts == NULL || buffer->statuses == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Snapshot.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < resource_count; i++) {
+        atomic_init(&buffer->amounts[i], 0);
+    }
+    for (int i = 0; i < system_count; i++) {
+        atomic_init(&buffer->statuses[i], 0);
+    }
+}
+
+/**
+ * Writes a string as a JSON string literal, escaping quotes, backslashes and control characters.
+ *
+ * @param[in] file    Stream to write to.
+ * @param[in] string  String to write.
+ */
+static void snapshot_write_json_string(FILE *file, const char *string) {
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *)string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
@@ -0,0 +1,271 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+
+#ifdef SIM_STATS
+
+static _Atomic(StatsBlock *) stats_blocks;   // Every thread's block, pushed once and never removed
+static __thread StatsBlock *stats_local;     // Block of the current thread, NULL until its first update
+static atomic_int stats_requested;           // Set by SIGUSR1, cleared by stats_poll
+
+// Helper functions just used by this C file to clean up our code
+static StatsBlock *stats_block(void);
+static void stats_add(atomic_ullong *value, unsigned long long amount);
+static int stats_bucket(unsigned long long value);
+static unsigned long long stats_bucket_value(int bucket);
+static unsigned long long stats_percentile(const unsigned long long *buckets, unsigned long long count, double fraction);
+static void stats_signal_handler(int signal);
+
+/**
+ * Installs the SIGUSR1 handler that asks for a stats dump.
+ *
+ * The handler only sets a flag; the manager loop prints the dump the next time it
+ * calls `stats_poll`, which is at least once per display refresh.
+ */
+void stats_init(void) {
+    struct sigaction action;
+
+    action.sa_handler = stats_signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+/**
+ * Increments one of the current thread's counters.
+ *
+ * @param[in] counter  One of the `STATS_*` counter indices.
+ */
+void stats_count(int counter) {
+    stats_add(&stats_block()->counters[counter], 1);
+}
+
+/**
+ * Adds a value to one of the current thread's histograms.
+ *
+ * @param[in] histogram  One of the `STATS_HIST_*` indices.
+ * @param[in] value      Nanoseconds, clamped below 2^STATS_MAX_BITS.
+ */
+void stats_record(int histogram, unsigned long long value) {
+    StatsBlock *block = stats_block();
+
+    stats_add(&block->buckets[histogram][stats_bucket(value)], 1);
+    stats_add(&block->sums[histogram], value);
+    if (value > atomic_load_explicit(&block->maxima[histogram], memory_order_relaxed)) {
+        atomic_store_explicit(&block->maxima[histogram], value, memory_order_relaxed);
+    }
+}
+
+/**
+ * Locks a mutex and records how long that took.
+ *
+ * An uncontended lock is taken with a single `pthread_mutex_trylock` and recorded as 0,
+ * so only contended acquisitions read the clock.
+ *
+ * @param[in,out] mutex      The mutex to lock.
+ * @param[in]     histogram  `STATS_HIST_RESOURCE_LOCK` or `STATS_HIST_QUEUE_LOCK`.
+ */
+void stats_lock(pthread_mutex_t *mutex, int histogram) {
+    if (pthread_mutex_trylock(mutex) == 0) {
+        stats_record(histogram, 0);
+        return;
+    }
+
+    unsigned long long start = stats_now_ns();
+    pthread_mutex_lock(mutex);
+    stats_record(histogram, stats_now_ns() - start);
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Nanoseconds since an arbitrary fixed point.
+ */
+unsigned long long stats_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+/**
+ * Prints a stats dump if SIGUSR1 arrived since the last call.
+ *
+ * @param[in] file  Stream to print to.
+ */
+void stats_poll(FILE *file) {
+    if (atomic_exchange(&stats_requested, 0)) {
+        stats_dump(file);
+    }
+}
+
+/**
+ * Sums the blocks of every thread and prints the counters and histogram percentiles.
+ *
+ * Takes no lock: each value is read atomically while its thread may keep updating
+ * it, so a dump taken during the run is a close, not an exact, picture.
+ *
+ * @param[in] file  Stream to print to.
+ */
+void stats_dump(FILE *file) {
+    static const char *counter_names[STATS_COUNTERS] = {
+        "steps", "conversions", "status OK", "status EMPTY", "status LOW", "status INSUFFICIENT",
+        "status CAPACITY", "events pushed", "events handled"
+    };
+    static const char *histogram_names[STATS_HISTOGRAMS] = {
+        "resource lock", "event queue lock", "event latency", "processing"
+    };
+    unsigned long long counters[STATS_COUNTERS] = {0};
+    unsigned long long sums[STATS_HISTOGRAMS] = {0};
+    unsigned long long maxima[STATS_HISTOGRAMS] = {0};
+    unsigned long long buckets[STATS_HISTOGRAMS][STATS_BUCKETS] = {{0}}; // On the stack, the missions of a batch may dump at once
+    int threads = 0;
+
+    for (StatsBlock *block = atomic_load(&stats_blocks); block != NULL; block = block->next) {
+        threads++;
+        for (int c = 0; c < STATS_COUNTERS; c++) {
+            counters[c] += atomic_load_explicit(&block->counters[c], memory_order_relaxed);
+        }
+        for (int h = 0; h < STATS_HISTOGRAMS; h++) {
+            unsigned long long maximum = atomic_load_explicit(&block->maxima[h], memory_order_relaxed);
+            sums[h] += atomic_load_explicit(&block->sums[h], memory_order_relaxed);
+            maxima[h] = (maximum > maxima[h]) ? maximum : maxima[h];
+            for (int b = 0; b < STATS_BUCKETS; b++) {
+                buckets[h][b] += atomic_load_explicit(&block->buckets[h][b], memory_order_relaxed);
+            }
+        }
+    }
+
+    fprintf(file, "Stats (%d threads):\n", threads);
+    for (int c = 0; c < STATS_COUNTERS; c++) {
+        fprintf(file, "  %-20s %12llu\n", counter_names[c], counters[c]);
+    }
+    fprintf(file, "  %-20s %12s %10s %10s %10s %10s %12s\n", "ns", "count", "mean", "p50", "p90", "p99", "max");
+    for (int h = 0; h < STATS_HISTOGRAMS; h++) {
+        unsigned long long count = 0;
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            count += buckets[h][b];
+        }
+        fprintf(file, "  %-20s %12llu %10llu %10llu %10llu %10llu %12llu\n", histogram_names[h], count,
+                (count > 0) ? sums[h] / count : 0,
+                stats_percentile(buckets[h], count, 0.50), stats_percentile(buckets[h], count, 0.90),
+                stats_percentile(buckets[h], count, 0.99), maxima[h]);
+    }
+    fflush(file);
+}
+
+/**
+ * Returns the current thread's block, creating and publishing it on first use.
+ *
+ * @return  The block.
+ */
+static StatsBlock *stats_block(void) {
+    if (stats_local == NULL) {
+        StatsBlock *block = aligned_alloc(CACHE_LINE_SIZE, sizeof(StatsBlock));
+        if (block == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed for StatsBlock.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int c = 0; c < STATS_COUNTERS; c++) {
+            atomic_init(&block->counters[c], 0);
+        }
+        for (int h = 0; h < STATS_HISTOGRAMS; h++) {
+            atomic_init(&block->sums[h], 0);
+            atomic_init(&block->maxima[h], 0);
+            for (int b = 0; b < STATS_BUCKETS; b++) {
+                atomic_init(&block->buckets[h][b], 0);
+            }
+        }
+
+        block->next = atomic_load(&stats_blocks);
+        while (!atomic_compare_exchange_weak(&stats_blocks, &block->next, block)) {
+        }
+        stats_local = block;
+    }
+    return stats_local;
+}
+
+/**
+ * Adds to a value only the current thread writes.
+ *
+ * A relaxed load and store rather than a read-modify-write: there is no other
+ * writer, and readers still never see a torn value.
+ *
+ * @param[in,out] value   The value.
+ * @param[in]     amount  Amount to add.
+ */
+static void stats_add(atomic_ullong *value, unsigned long long amount) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+/**
+ * Maps a value to its histogram bucket.
+ *
+ * Values below 2^STATS_SUB_BITS get a bucket each; above, every power of two is
+ * split into 2^STATS_SUB_BITS equal buckets, like an HDR histogram.
+ *
+ * @param[in] value  The value.
+ * @return           Bucket index.
+ */
+static int stats_bucket(unsigned long long value) {
+    if (value >= (1ULL << STATS_MAX_BITS)) {
+        value = (1ULL << STATS_MAX_BITS) - 1;
+    }
+    if (value < (1ULL << STATS_SUB_BITS)) {
+        return (int)value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exponent - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1);
+    return ((exponent - STATS_SUB_BITS + 1) << STATS_SUB_BITS) + sub;
+}
+
+/**
+ * Returns the smallest value that maps to a bucket.
+ *
+ * @param[in] bucket  Bucket index.
+ * @return            Lower bound of the bucket.
+ */
+static unsigned long long stats_bucket_value(int bucket) {
+    if (bucket < (1 << STATS_SUB_BITS)) {
+        return (unsigned long long)bucket;
+    }
+
+    int exponent = (bucket >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+    unsigned long long sub = (unsigned long long)(bucket & ((1 << STATS_SUB_BITS) - 1));
+    return ((1ULL << STATS_SUB_BITS) + sub) << (exponent - STATS_SUB_BITS);
+}
+
+/**
+ * Finds a percentile of a histogram.
+ *
+ * @param[in] buckets   Bucket counts.
+ * @param[in] count     Sum of the bucket counts.
+ * @param[in] fraction  Percentile as a fraction, e.g. 0.99.
+ * @return              Lower bound of the bucket holding the percentile, 0 for an empty histogram.
+ */
+static unsigned long long stats_percentile(const unsigned long long *buckets, unsigned long long count, double fraction) {
+    unsigned long long target = (unsigned long long)(fraction * (double)count);
+    unsigned long long seen = 0;
+
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > target) {
+            return stats_bucket_value(b);
+        }
+    }
+    return 0;
+}
+
+/**
+ * SIGUSR1 handler, asks the manager loop for a dump.
+ *
+ * @param[in] signal  The signal number.
+ */
+static void stats_signal_handler(int signal) {
+    (void)signal;
+    atomic_store(&stats_requested, 1);
+}
+
+#endif
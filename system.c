@@ -1,145 +1,239 @@
 #include "defs.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <unistd.h>
 #include <string.h>
 
 // Helper functions just used by this C file to clean up our code
 // Using static means they can't get linked into other files
-static int system_convert(System *);
-static void system_simulate_process_time(System *);
-static int system_store_resources(System *);
+static int system_convert(System *, int *);
+static void system_finish_conversion(System *);
+static int system_process_time(System *);
+static int system_store_resources(System *, int *);
+static void system_report(System *, Resource *, int, int);
+static int recipe_copy(Arena *, const ResourceAmount *, int, ResourceAmount **, int);
 
 /**
- * Creates a new `System` object.
+ * Creates a new `System` object with a single input and a single output.
  *
- * Allocates memory for a new `System` and initializes its fields.
- * The `name` is dynamically allocated.
+ * Shorthand for `system_create_recipe`; a term whose resource is NULL is left out.
  *
  * @param[out] system          Pointer to the `System*` to be allocated and initialized.
- * @param[in]  name            Name of the system (the string is copied).
+ * @param[in,out] arena        Arena that owns the system's memory.
+ * @param[in]  name            Name of the system (interned in `arena`).
  * @param[in]  consumed        `ResourceAmount` representing the resource consumed.
  * @param[in]  produced        `ResourceAmount` representing the resource produced.
  * @param[in]  processing_time Processing time in milliseconds.
  * @param[in]  event_queue     Pointer to the `EventQueue` for event handling.
  */
-void system_create(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue) {
-    *system = malloc(sizeof(System));
-    if (*system == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed for System.\n");
-        exit(EXIT_FAILURE);
-    }
+void system_create(System **system, Arena *arena, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue) {
+    system_create_recipe(system, arena, name, &consumed, consumed.resource != NULL, &produced, produced.resource != NULL,
+                         processing_time, event_queue);
+}
 
-    (*system)->name = strdup(name);
-    if ((*system)->name == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed for System name.\n");
-        free(*system);
-        exit(EXIT_FAILURE);
-    }
+/**
+ * Creates a new `System` object that converts a recipe of several inputs into several outputs.
+ *
+ * Allocates the `System` from `arena` and initializes it with `system_init_recipe`.
+ *
+ * @param[out] system          Pointer to the `System*` to be allocated and initialized.
+ * @param[in,out] arena        Arena that owns the system's memory.
+ * @param[in]  name            Name of the system (interned in `arena`).
+ * @param[in]  consumed        Inputs, all consumed at once for each conversion.
+ * @param[in]  consumed_count  Number of inputs, may be 0.
+ * @param[in]  produced        Outputs, stored after the processing time.
+ * @param[in]  produced_count  Number of outputs, may be 0.
+ * @param[in]  processing_time Processing time in milliseconds.
+ * @param[in]  event_queue     Pointer to the `EventQueue` for event handling.
+ */
+void system_create_recipe(System **system, Arena *arena, const char *name, const ResourceAmount *consumed, int consumed_count,
+                          const ResourceAmount *produced, int produced_count, int processing_time, EventQueue *event_queue) {
+    *system = arena_alloc(arena, sizeof(System), _Alignof(System));
+    system_init_recipe(*system, arena, name, consumed, consumed_count, produced, produced_count, processing_time,
+                       event_queue);
+}
 
-    (*system)->consumed = consumed;
-    (*system)->produced = produced;
-    (*system)->amount_stored = 0;
-    (*system)->processing_time = processing_time;
-    (*system)->status = STANDARD;
-    (*system)->event_queue = event_queue;
-    pthread_mutex_init(&(*system)->mutex, NULL); // Initialize the mutex
+/**
+ * Initializes a `System` with a recipe in memory the caller provides, such as one slot of a block of systems.
+ *
+ * Allocates copies of both recipe lists from `arena`, interns its `name` there and
+ * initializes its fields. Inputs are sorted into lock order and terms on the same
+ * resource are merged, as `resource_consume_all` requires.
+ *
+ * @param[out] system          Pointer to the zeroed `System` to initialize.
+ * @param[in,out] arena        Arena that owns the system's name and recipe lists.
+ * @param[in]  name            Name of the system (interned in `arena`).
+ * @param[in]  consumed        Inputs, all consumed at once for each conversion.
+ * @param[in]  consumed_count  Number of inputs, may be 0.
+ * @param[in]  produced        Outputs, stored after the processing time.
+ * @param[in]  produced_count  Number of outputs, may be 0.
+ * @param[in]  processing_time Processing time in milliseconds.
+ * @param[in]  event_queue     Pointer to the `EventQueue` for event handling.
+ */
+void system_init_recipe(System *system, Arena *arena, const char *name, const ResourceAmount *consumed, int consumed_count,
+                        const ResourceAmount *produced, int produced_count, int processing_time, EventQueue *event_queue) {
+    system->name = arena_intern(arena, name);
+
+    system->consumed_count = recipe_copy(arena, consumed, consumed_count, &system->consumed, 1);
+    system->produced_count = recipe_copy(arena, produced, produced_count, &system->produced, 0);
+    system->pending = arena_alloc(arena, sizeof(int) * (system->produced_count + 1), _Alignof(int));
+    system->amount_stored = 0;
+    system->processing = 0;
+    system->processing_time = processing_time;
+    atomic_init(&system->status, STANDARD);
+    system->event_queue = event_queue;
+    timer_node_init(&system->timer, system);
+    system->wait_next = NULL;
+    system->wait_need = 0;
+    system->wake = NULL;
+    system->wake_context = NULL;
+    system->event_interval = 0;
+    system->last_event_time = 0;
+    system->last_event_resource = NULL;
+    system->last_event_status = STATUS_OK;
+    system->suppressed = 0;
+#ifdef EVENT_QUEUE_MPSC
+    atomic_init(&system->ring_marked, 0);
+    atomic_init(&system->ring_amount, 0);
+    system->ring_resource = NULL;
+    system->ring_status = STATUS_OK;
+#endif
+    system->id = 0;
+    system->home = -1;
+    system->trace = NULL;
+    system->trace_records = NULL;
+    system->trace_count = 0;
 }
 
 
 /**
  * Destroys a `System` object.
  *
- * Frees all memory associated with the `System`.
+ * A `System` owns no locks, so there is nothing to release; its memory is
+ * released with the arena it was created in.
  *
  * @param[in,out] system  Pointer to the `System` to be destroyed.
  */
 void system_destroy(System *system) {
     if (system != NULL) {
-        if (system->name != NULL) {
-            printf("Debug: Freeing system name: %s\n", system->name);
-            free(system->name); // Free dynamically allocated name
-        }
-        pthread_mutex_destroy(&system->mutex); // Destroy the mutex
-        free(system); // Free the System
+        LOG_DEBUG("Destroying system: %s\n", system->name);
     }
 }
 
 
 
 /**
- * Runs the main loop for a `System`.
+ * Reads the status of a `System` without taking any lock.
  *
- * This function manages the lifecycle of a system, including resource conversion,
- * processing time simulation, and resource storage. It generates events based on
- * the success or failure of these operations.
+ * @param[in] system  Pointer to the `System`.
+ * @return            `SLOW`, `STANDARD`, `FAST` or `TERMINATE`.
+ */
+int system_get_status(System *system) {
+    return atomic_load_explicit(&system->status, memory_order_acquire);
+}
+
+/**
+ * Changes the status of a `System`; it applies from the system's next step.
+ *
+ * @param[in,out] system  Pointer to the `System`.
+ * @param[in]     status  `SLOW`, `STANDARD`, `FAST` or `TERMINATE`.
+ */
+void system_set_status(System *system, int status) {
+    atomic_store_explicit(&system->status, status, memory_order_release);
+}
+
+/**
+ * Runs one step of a `System`.
+ *
+ * This function advances the lifecycle of a system, including resource conversion,
+ * processing time, and resource storage, without ever sleeping. It generates events
+ * based on the success or failure of these operations and tells the caller how long
+ * to park the system before running it again.
  *
  * @param[in,out] system  Pointer to the `System` to run.
+ * @return                Milliseconds until the system should run again (0 to run immediately),
+ *                        or `SYSTEM_BLOCKED` if it waits on a resource and will be woken through `wake`.
  */
-void system_run(System *system) {
-    Event event;
+int system_run(System *system) {
     int result_status;
-    
-    if (system->amount_stored == 0) {
+    int term;
+
+    STATS_COUNT(STATS_STEPS);
+    if (system->processing) {
+        // The processing time of the last conversion has elapsed
+        system_finish_conversion(system);
+    } else if (system->amount_stored == 0) {
         // Need to convert resources (consume and process)
-        result_status = system_convert(system);
+        result_status = system_convert(system, &term);
+        STATS_STATUS(result_status);
 
         if (result_status != STATUS_OK) {
-            // Report that resources were out / insufficient
-            event_init(&event, system, system->consumed.resource, result_status, PRIORITY_HIGH, system->consumed.resource->amount);
-            event_queue_push(system->event_queue, &event);    
-            // Sleep to prevent looping too frequently and spamming with events
-            usleep(SYSTEM_WAIT_TIME * 1000);          
+            // Report the input that was out / insufficient
+            ResourceAmount *input = &system->consumed[term];
+            system_report(system, input->resource, result_status, PRIORITY_HIGH);
+            // Block until a producer covers that input; without a wake hook, retry after a pause
+            if (system->wake == NULL) {
+                return SYSTEM_WAIT_TIME;
+            }
+            return resource_wait_amount(input->resource, system, input->amount) ? SYSTEM_BLOCKED : 0;
         }
+
+        return system_process_time(system);
     }
 
     if (system->amount_stored > 0) {
         // Attempt to store the produced resources
-        result_status = system_store_resources(system);
+        result_status = system_store_resources(system, &term);
+        STATS_STATUS(result_status);
 
         if (result_status != STATUS_OK) {
-            event_init(&event, system, system->produced.resource, result_status, PRIORITY_LOW, system->produced.resource->amount);
-            event_queue_push(system->event_queue, &event);
-            // Sleep to prevent looping too frequently and spamming with events
-            usleep(SYSTEM_WAIT_TIME * 1000);
+            Resource *output = system->produced[term].resource;
+            system_report(system, output, result_status, PRIORITY_LOW);
+            // Block until a consumer frees space in that output; without a wake hook, retry after a pause
+            if (system->wake == NULL) {
+                return SYSTEM_WAIT_TIME;
+            }
+            return resource_wait_space(output, system) ? SYSTEM_BLOCKED : 0;
         }
     }
+
+    return 0;
 }
 
 /**
- * Converts resources in a `System`.
+ * Starts a conversion in a `System`.
  *
- * Handles the consumption of required resources and simulates processing time.
- * Updates the amount of produced resources based on the system's configuration.
+ * Consumes every input of the recipe at once. On success the system is marked
+ * as processing; the outputs are credited by `system_finish_conversion` once the
+ * processing time has elapsed. Inputs the consume took below their low mark are
+ * reported as `STATUS_LOW`, once per drop.
  *
- * @param[in,out] system           Pointer to the `System` performing the conversion.
- * @return                         `STATUS_OK` if successful, or an error status code.
+ * @param[in,out] system  Pointer to the `System` performing the conversion.
+ * @param[out]    failed  On failure, index of the input that was not available.
+ * @return                `STATUS_OK` if successful, or an error status code.
  */
-static int system_convert(System *system) {
-    int status;
-    Resource *consumed_resource = system->consumed.resource;
-    int amount_consumed = system->consumed.amount;
+static int system_convert(System *system, int *failed) {
+    int status = STATUS_OK;
 
-    if (consumed_resource == NULL) {
-        status = STATUS_OK;
-    } else {
-        pthread_mutex_lock(&consumed_resource->mutex);
-        if (consumed_resource->amount >= amount_consumed) {
-            consumed_resource->amount -= amount_consumed;
-            status = STATUS_OK;
-        } else {
-            status = (consumed_resource->amount == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+    if (system->consumed_count > 0) {
+        status = resource_consume_all(system->consumed, system->consumed_count, failed);
+    }
+
+    if (status == STATUS_LOW) {
+        for (int i = 0; i < system->consumed_count; i++) {
+            if (resource_claim_low(system->consumed[i].resource)) {
+                STATS_STATUS(STATUS_LOW);
+                system_report(system, system->consumed[i].resource, STATUS_LOW, PRIORITY_MED);
+            }
         }
-        pthread_mutex_unlock(&consumed_resource->mutex);
+        status = STATUS_OK;
     }
 
     if (status == STATUS_OK) {
-        system_simulate_process_time(system);
-
-        if (system->produced.resource != NULL) {
-            system->amount_stored += system->produced.amount;
-        } else {
-            system->amount_stored = 0;
+        system->processing = 1;
+        STATS_COUNT(STATS_CONVERSIONS);
+        STATS_START(system->convert_started);
+        for (int i = 0; i < system->consumed_count; i++) {
+            trace_amount(system, system->consumed[i].resource, -system->consumed[i].amount);
         }
     }
 
@@ -147,18 +241,35 @@ static int system_convert(System *system) {
 }
 
 /**
- * Simulates the processing time for a `System`.
+ * Completes a conversion in a `System`.
+ *
+ * Credits every output of the recipe as pending until it is stored.
+ *
+ * @param[in,out] system  Pointer to the `System` whose conversion finished.
+ */
+static void system_finish_conversion(System *system) {
+    system->processing = 0;
+    STATS_RECORD(STATS_HIST_PROCESSING, system->convert_started);
+
+    for (int i = 0; i < system->produced_count; i++) {
+        system->pending[i] += system->produced[i].amount;
+        system->amount_stored += system->produced[i].amount;
+    }
+}
+
+/**
+ * Computes the processing time for a `System`.
  *
- * Adjusts the processing time based on the system's current status (e.g., SLOW, FAST)
- * and sleeps for the adjusted time to simulate processing.
+ * Adjusts the processing time based on the system's current status (e.g., SLOW, FAST).
  *
- * @param[in] system  Pointer to the `System` whose processing time is being simulated.
+ * @param[in] system  Pointer to the `System` whose processing time is being computed.
+ * @return            Adjusted processing time in milliseconds.
  */
-static void system_simulate_process_time(System *system) {
+static int system_process_time(System *system) {
     int adjusted_processing_time;
 
     // Adjust based on the current system status modifier
-    switch (system->status) {
+    switch (system_get_status(system)) {
         case SLOW:
             adjusted_processing_time = system->processing_time * 2;
             break;
@@ -169,45 +280,119 @@ static void system_simulate_process_time(System *system) {
             adjusted_processing_time = system->processing_time;
     }
 
-    // Sleep for the required time
-    usleep(adjusted_processing_time * 1000);
+    return adjusted_processing_time;
 }
 
 /**
  * Stores produced resources in a `System`.
  *
- * Adds the produced resources to the corresponding resource's amount,
- * considering the maximum capacity. Updates `amount_stored` to reflect
- * any leftover resources that couldn't be stored.
+ * Adds the pending units of every output to the corresponding resource, considering
+ * its maximum capacity. Outputs are independent: a full output keeps its leftover
+ * pending while the others are stored.
  *
  * @param[in,out] system  Pointer to the `System` storing resources.
+ * @param[out]    full    If not everything fit, index of the first output with units left.
  * @return                `STATUS_OK` if all resources were stored, or `STATUS_CAPACITY` if not all could be stored.
  */
-static int system_store_resources(System *system) {
-    Resource *produced_resource = system->produced.resource;
-    int available_space, amount_to_store;
-
-    if (produced_resource == NULL || system->amount_stored == 0) {
-        system->amount_stored = 0;
-        return STATUS_OK;
+static int system_store_resources(System *system, int *full) {
+    int status = STATUS_OK;
+
+    for (int i = system->produced_count - 1; i >= 0; i--) {
+        if (system->pending[i] > 0) {
+            int stored = resource_store(system->produced[i].resource, system->pending[i]);
+            system->pending[i] -= stored;
+            system->amount_stored -= stored;
+            if (stored > 0) {
+                trace_amount(system, system->produced[i].resource, stored);
+            }
+            if (system->pending[i] > 0) {
+                *full = i;
+                status = STATUS_CAPACITY;
+            }
+        }
     }
 
-    pthread_mutex_lock(&produced_resource->mutex);
-    amount_to_store = system->amount_stored;
-    available_space = produced_resource->max_capacity - produced_resource->amount;
+    return status;
+}
+
+/**
+ * Copies a recipe list into the arena.
+ *
+ * Terms without a resource or with a non-positive amount are dropped. With `sort`,
+ * terms are ordered by resource address, the global lock order (fixed because arena
+ * objects never move), and terms on the same resource are merged.
+ *
+ * @param[in,out] arena  Arena to copy into.
+ * @param[in]     terms  Terms to copy.
+ * @param[in]     count  Number of terms.
+ * @param[out]    copy   Receives the copy.
+ * @param[in]     sort   Non-zero to sort and merge.
+ * @return               Number of terms in the copy.
+ */
+static int recipe_copy(Arena *arena, const ResourceAmount *terms, int count, ResourceAmount **copy, int sort) {
+    int copied = 0;
+
+    *copy = arena_alloc(arena, sizeof(ResourceAmount) * (count + 1), _Alignof(ResourceAmount));
+    for (int i = 0; i < count; i++) {
+        if (terms[i].resource == NULL || terms[i].amount <= 0) {
+            continue;
+        }
 
-    if (available_space >= amount_to_store) {
-        produced_resource->amount += amount_to_store;
-        system->amount_stored = 0;
-    } else if (available_space > 0) {
-        produced_resource->amount += available_space;
-        system->amount_stored = amount_to_store - available_space;
+        int at = copied;
+        if (sort) {
+            // Insertion sort, recipes are a handful of terms
+            while (at > 0 && (uintptr_t)(*copy)[at - 1].resource > (uintptr_t)terms[i].resource) {
+                at--;
+            }
+            if (at > 0 && (*copy)[at - 1].resource == terms[i].resource) {
+                (*copy)[at - 1].amount += terms[i].amount;
+                continue;
+            }
+            memmove(&(*copy)[at + 1], &(*copy)[at], sizeof(ResourceAmount) * (copied - at));
+        }
+        (*copy)[at] = terms[i];
+        copied++;
     }
-    pthread_mutex_unlock(&produced_resource->mutex);
 
-    return (system->amount_stored == 0) ? STATUS_OK : STATUS_CAPACITY;
+    return copied;
 }
 
+/**
+ * Reports the state of a resource to the manager through the event queue.
+ *
+ * With an `event_interval`, a repeat of the previous event (same resource and
+ * status) within the interval is only counted; the count is carried by the next
+ * event that is pushed. A different event is always pushed immediately.
+ *
+ * @param[in,out] system    Pointer to the `System` reporting.
+ * @param[in]     resource  The `Resource` the event is about.
+ * @param[in]     status    Status code to report.
+ * @param[in]     priority  Priority of the event.
+ */
+static void system_report(System *system, Resource *resource, int status, int priority) {
+    Event event;
+    EventQueue *queue = system->event_queue;
+
+    event_init(&event, system, resource, status, priority, resource_get_amount(resource));
+    trace_event(system, &event);
+
+    if (system->event_interval > 0 && queue->clock != NULL) {
+        unsigned long long now = sim_clock_now(queue->clock);
+        int repeat = (system->last_event_resource == resource && system->last_event_status == status);
+
+        if (repeat && now - system->last_event_time < (unsigned long long)system->event_interval) {
+            system->suppressed++;
+            return;
+        }
+        system->last_event_time = now;
+    }
+
+    event.count += system->suppressed;
+    system->suppressed = 0;
+    system->last_event_resource = resource;
+    system->last_event_status = status;
+    event_queue_push(queue, &event);
+}
 
 /**
  * Initializes the `SystemArray`.
@@ -227,7 +412,9 @@ void system_array_init(SystemArray *array) {
 }
 
 /**
- * Cleans up the `SystemArray` by destroying all systems and freeing memory.
+ * Cleans up the `SystemArray` by destroying all systems and freeing the array memory.
+ *
+ * The systems themselves stay allocated until their arena is cleaned.
  *
  * @param[in,out] array  Pointer to the `SystemArray` to clean.
  */
@@ -240,6 +427,29 @@ void system_array_clean(SystemArray *array) {
     array->capacity = 0;
 }
 
+/**
+ * Grows the `SystemArray` so it holds at least `capacity` systems without resizing.
+ *
+ * @param[in,out] array     Pointer to the `SystemArray`.
+ * @param[in]     capacity  Number of systems to make room for.
+ */
+void system_array_reserve(SystemArray *array, int capacity) {
+    if (capacity <= array->capacity) {
+        return;
+    }
+
+    System **new_systems = malloc(sizeof(System *) * capacity);
+    if (new_systems == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for SystemArray resizing.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(new_systems, array->systems, sizeof(System *) * array->size);
+
+    free(array->systems);
+    array->systems = new_systems;
+    array->capacity = capacity;
+}
+
 /**
  * Adds a `System` to the `SystemArray`, resizing if necessary (doubling the size).
  *
@@ -248,22 +458,31 @@ void system_array_clean(SystemArray *array) {
  */
 void system_array_add(SystemArray *array, System *system) {
     if (array->size == array->capacity) {
-        int new_capacity = array->capacity * 2;
-        System **new_systems = malloc(sizeof(System *) * new_capacity);
-        if (new_systems == NULL) {
-            fprintf(stderr, "Error: Failed to allocate memory for SystemArray resizing.\n");
-            exit(EXIT_FAILURE);
-        }
+        system_array_reserve(array, array->capacity * 2);
+    }
 
-        // Copy existing systems to the new array
-        for (int i = 0; i < array->size; i++) {
-            new_systems[i] = array->systems[i];
-        }
+    system->id = array->size;
+    array->systems[array->size++] = system;
+}
 
-        free(array->systems);
-        array->systems = new_systems;
-        array->capacity = new_capacity;
+/**
+ * Adds a contiguous block of systems to the `SystemArray` with a single resize at most.
+ *
+ * The systems get consecutive ids, matching their slots in the block, and keep their
+ * addresses for as long as the arena holding the block lives.
+ *
+ * @param[in,out] array    Pointer to the `SystemArray`.
+ * @param[in]     systems  First of `count` initialized systems, adjacent in memory.
+ * @param[in]     count    Number of systems in the block.
+ */
+void system_array_add_block(SystemArray *array, System *systems, int count) {
+    if (array->size + count > array->capacity) {
+        int doubled = array->capacity * 2;
+        system_array_reserve(array, (array->size + count > doubled) ? array->size + count : doubled);
     }
 
-    array->systems[array->size++] = system;
+    for (int i = 0; i < count; i++) {
+        systems[i].id = array->size;
+        array->systems[array->size++] = &systems[i];
+    }
 }
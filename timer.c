@@ -0,0 +1,296 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+// Helper functions just used by this C file to clean up our code
+static void timer_wheel_place(TimerWheel *wheel, TimerNode *node);
+static void timer_wheel_cascade(TimerWheel *wheel, int level);
+static void timer_wheel_tick(TimerWheel *wheel, TimerNode **expired_tail);
+static void timer_list_append(TimerNode *head, TimerNode *node);
+static void timer_list_unlink(TimerNode *node);
+static unsigned long long monotonic_ms(void);
+
+/* SimClock functions */
+
+/**
+ * Initializes a `SimClock` at time zero.
+ *
+ * @param[out] clock       Pointer to the `SimClock` to initialize.
+ * @param[in]  is_virtual  Non-zero for a virtual clock that only moves through `sim_clock_set`.
+ */
+void sim_clock_init(SimClock *clock, int is_virtual) {
+    clock->is_virtual = is_virtual;
+    clock->start = monotonic_ms();
+    atomic_init(&clock->virtual_now, 0);
+}
+
+/**
+ * Reads the simulation time.
+ *
+ * @param[in] clock  Pointer to the `SimClock`.
+ * @return           Milliseconds since the clock was initialized (real or virtual).
+ */
+unsigned long long sim_clock_now(SimClock *clock) {
+    if (clock->is_virtual) {
+        return atomic_load_explicit(&clock->virtual_now, memory_order_acquire);
+    }
+    return monotonic_ms() - clock->start;
+}
+
+/**
+ * Moves a virtual clock to `now`. Has no effect on a real-time clock.
+ *
+ * @param[in,out] clock  Pointer to the `SimClock`.
+ * @param[in]     now    New virtual time in milliseconds; must not go backwards.
+ */
+void sim_clock_set(SimClock *clock, unsigned long long now) {
+    if (clock->is_virtual) {
+        atomic_store_explicit(&clock->virtual_now, now, memory_order_release);
+    }
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Milliseconds since an arbitrary fixed point.
+ */
+static unsigned long long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000ULL + (unsigned long long)now.tv_nsec / 1000000ULL;
+}
+
+/* TimerWheel functions */
+
+/**
+ * Initializes a `TimerWheel`.
+ *
+ * Every slot starts as an empty circular list around its sentinel node.
+ *
+ * @param[out] wheel  Pointer to the `TimerWheel` to initialize.
+ * @param[in]  now    Current time in ticks (milliseconds).
+ */
+void timer_wheel_init(TimerWheel *wheel, unsigned long long now) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            TimerNode *head = &wheel->slots[level][slot];
+            head->next = head;
+            head->prev = head;
+        }
+        wheel->level_count[level] = 0;
+    }
+    wheel->now = now;
+    wheel->count = 0;
+}
+
+/**
+ * Initializes a `TimerNode` so it can be added to a wheel.
+ *
+ * @param[out] node   Pointer to the `TimerNode` to initialize.
+ * @param[in]  owner  Object the timer belongs to, handed back when it expires.
+ */
+void timer_node_init(TimerNode *node, void *owner) {
+    node->next = NULL;
+    node->prev = NULL;
+    node->expiry = 0;
+    node->level = -1;
+    node->owner = owner;
+}
+
+/**
+ * Registers a timer to expire at `expiry`.
+ *
+ * O(1): the timer goes into the slot of the coarsest level that still resolves
+ * its distance from now, and moves down a level each time that slot cascades.
+ * Deadlines at or before the current tick expire on the next tick.
+ *
+ * @param[in,out] wheel   Pointer to the `TimerWheel`.
+ * @param[in,out] node    Timer to add; must not already be in a wheel.
+ * @param[in]     expiry  Tick (millisecond) at which the timer expires.
+ */
+void timer_wheel_add(TimerWheel *wheel, TimerNode *node, unsigned long long expiry) {
+    node->expiry = (expiry > wheel->now) ? expiry : wheel->now + 1;
+    timer_wheel_place(wheel, node);
+    wheel->count++;
+}
+
+/**
+ * Returns the earliest tick at which `timer_wheel_advance` can have work to do.
+ *
+ * The earlier of the first occupied level 0 slot and the tick at which the next
+ * occupied coarse slot of any level cascades, so sleeping (or jumping the virtual
+ * clock) until then never skips a timer or a cascade.
+ *
+ * @param[in] wheel  Pointer to the `TimerWheel`.
+ * @return           The tick, or `TIMER_NEVER` if no timers are registered.
+ */
+unsigned long long timer_wheel_next_expiry(const TimerWheel *wheel) {
+    unsigned long long next = TIMER_NEVER;
+
+    if (wheel->level_count[0] > 0) {
+        for (unsigned long long t = wheel->now + 1; t <= wheel->now + TIMER_WHEEL_SLOTS; t++) {
+            const TimerNode *head = &wheel->slots[0][t & TIMER_WHEEL_MASK];
+            if (head->next != head) {
+                next = t;
+                break;
+            }
+        }
+    }
+
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (wheel->level_count[level] == 0) {
+            continue;
+        }
+
+        int shift = level * TIMER_WHEEL_BITS;
+        unsigned long long base = wheel->now >> shift;
+        for (unsigned long long k = 1; k <= TIMER_WHEEL_SLOTS; k++) {
+            const TimerNode *head = &wheel->slots[level][(base + k) & TIMER_WHEEL_MASK];
+            if (head->next != head) {
+                unsigned long long cascade_at = (base + k) << shift;
+                if (cascade_at < next) {
+                    next = cascade_at;
+                }
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+/**
+ * Advances the wheel to tick `target` and collects every timer that expired.
+ *
+ * Stretches without work are skipped using `timer_wheel_next_expiry`, so the
+ * cost depends on the number of timers rather than on the elapsed time. Every
+ * occupied cascade boundary is still ticked, so coarse timers move down in time.
+ *
+ * @param[in,out] wheel   Pointer to the `TimerWheel`.
+ * @param[in]     target  Tick to advance to; ignored if not after the current tick.
+ * @return                Expired timers in expiry order, linked through `next`, or NULL.
+ */
+TimerNode *timer_wheel_advance(TimerWheel *wheel, unsigned long long target) {
+    TimerNode *expired = NULL;
+    TimerNode **expired_tail = &expired;
+
+    while (wheel->now < target) {
+        if (wheel->count == 0) {
+            wheel->now = target;
+            break;
+        }
+
+        // Every tick before the next expiry or occupied cascade boundary is a no-op
+        unsigned long long next = timer_wheel_next_expiry(wheel);
+        if (next > target) {
+            next = target;
+        }
+        wheel->now = next - 1;
+        timer_wheel_tick(wheel, expired_tail);
+        while (*expired_tail != NULL) {
+            expired_tail = &(*expired_tail)->next;
+        }
+    }
+
+    return expired;
+}
+
+/**
+ * Processes one tick: cascades coarse slots that reach the current window and expires level 0.
+ *
+ * @param[in,out] wheel         Pointer to the `TimerWheel`.
+ * @param[in,out] expired_tail  Where to append the timers that expire on this tick.
+ */
+static void timer_wheel_tick(TimerWheel *wheel, TimerNode **expired_tail) {
+    wheel->now++;
+
+    // Each time a level wraps around, the next slot of the level above moves down
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        int shift = (level - 1) * TIMER_WHEEL_BITS;
+        if (((wheel->now >> shift) & TIMER_WHEEL_MASK) != 0) {
+            break;
+        }
+        timer_wheel_cascade(wheel, level);
+    }
+
+    TimerNode *head = &wheel->slots[0][wheel->now & TIMER_WHEEL_MASK];
+    while (head->next != head) {
+        TimerNode *node = head->next;
+        timer_list_unlink(node);
+        wheel->level_count[0]--;
+        wheel->count--;
+
+        node->level = -1;
+        node->next = NULL;
+        *expired_tail = node;
+        expired_tail = &node->next;
+    }
+}
+
+/**
+ * Re-places every timer of the current slot of `level` relative to the current tick.
+ *
+ * @param[in,out] wheel  Pointer to the `TimerWheel`.
+ * @param[in]     level  Level whose current slot is cascaded.
+ */
+static void timer_wheel_cascade(TimerWheel *wheel, int level) {
+    unsigned long long index = (wheel->now >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+    TimerNode *head = &wheel->slots[level][index];
+
+    while (head->next != head) {
+        TimerNode *node = head->next;
+        timer_list_unlink(node);
+        wheel->level_count[level]--;
+        timer_wheel_place(wheel, node);
+    }
+}
+
+/**
+ * Puts a timer in the slot matching its distance from the current tick.
+ *
+ * Timers too far away for the top level wait in its farthest slot and are re-placed on cascade.
+ *
+ * @param[in,out] wheel  Pointer to the `TimerWheel`.
+ * @param[in,out] node   Timer with `expiry` already set.
+ */
+static void timer_wheel_place(TimerWheel *wheel, TimerNode *node) {
+    unsigned long long expiry = node->expiry;
+    unsigned long long delta = expiry - wheel->now;
+    int level = 0;
+
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TIMER_WHEEL_BITS))) {
+        level++;
+    }
+    if (delta >= (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS))) {
+        expiry = wheel->now + (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1;
+    }
+
+    unsigned long long index = (expiry >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+    node->level = level;
+    timer_list_append(&wheel->slots[level][index], node);
+    wheel->level_count[level]++;
+}
+
+/**
+ * Appends a node at the tail of a slot list, keeping insertion order within a slot.
+ *
+ * @param[in,out] head  Sentinel of the slot.
+ * @param[in,out] node  Node to append.
+ */
+static void timer_list_append(TimerNode *head, TimerNode *node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+/**
+ * Removes a node from whichever slot list it is in.
+ *
+ * @param[in,out] node  Node to unlink.
+ */
+static void timer_list_unlink(TimerNode *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
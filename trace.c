@@ -0,0 +1,253 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Helper functions just used by this C file to clean up our code
+static void trace_flush(System *system);
+static void trace_map(Trace *trace, size_t size);
+
+/**
+ * Initializes a `Trace` that is not recording.
+ *
+ * @param[out] trace  Pointer to the `Trace` to initialize.
+ */
+void trace_init(Trace *trace) {
+    trace->fd = -1;
+    trace->base = NULL;
+    trace->size = 0;
+    trace->record_offset = 0;
+    trace->record_count = 0;
+    trace->clock = NULL;
+    trace->systems = NULL;
+    trace->buffers = NULL;
+}
+
+/**
+ * Creates a trace file and starts recording every event and amount change of the systems.
+ *
+ * The file starts with the resources (at their current amounts) and system names,
+ * so a replay needs nothing but the file. Every system gets a buffer of its own:
+ * a system is only ever run by one thread at a time, so recording is a plain store
+ * into that buffer, and only a full buffer takes the lock to be copied into the
+ * mapped file. Must be called before the systems start running.
+ *
+ * @param[out]    trace      Pointer to the `Trace` to start.
+ * @param[in]     path       Path of the trace file to create.
+ * @param[in]     clock      Clock the records are stamped with.
+ * @param[in]     resources  Resources of the simulation, ids are their indices.
+ * @param[in,out] systems    Systems to record, ids are their indices.
+ */
+void trace_start(Trace *trace, const char *path, SimClock *clock, ResourceArray *resources, SystemArray *systems) {
+    size_t string_size = 0;
+
+    if (resources->size > UINT16_MAX + 1) {
+        fprintf(stderr, "Error: A trace holds at most %d resources.\n", UINT16_MAX + 1);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < resources->size; i++) {
+        string_size += strlen(resources->resources[i]->name) + 1;
+    }
+    for (int i = 0; i < systems->size; i++) {
+        string_size += strlen(systems->systems[i]->name) + 1;
+    }
+
+    size_t tables = sizeof(TraceHeader) + sizeof(TraceResource) * resources->size
+                  + sizeof(uint32_t) * systems->size;
+    trace->record_offset = (tables + string_size + 7) & ~(size_t)7;
+    trace->record_count = 0;
+    trace->clock = clock;
+    trace->systems = systems;
+
+    trace->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (trace->fd < 0) {
+        fprintf(stderr, "Error: Cannot create trace file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    trace->base = NULL;
+    trace_map(trace, trace->record_offset + sizeof(TraceRecord) * TRACE_INITIAL_RECORDS);
+    pthread_mutex_init(&trace->mutex, NULL);
+
+    // Tables, the file is zero-filled so the padding needs no writes
+    TraceHeader *header = (TraceHeader *)trace->base;
+    TraceResource *records = (TraceResource *)(trace->base + sizeof(TraceHeader));
+    uint32_t *system_names = (uint32_t *)(records + resources->size);
+    char *strings = trace->base + tables;
+    size_t offset = 0;
+
+    memcpy(header->magic, TRACE_MAGIC, sizeof(header->magic));
+    header->version = TRACE_VERSION;
+    header->resource_count = (uint32_t)resources->size;
+    header->system_count = (uint32_t)systems->size;
+    header->string_size = (uint32_t)string_size;
+    header->record_offset = trace->record_offset;
+    header->record_count = 0;
+
+    for (int i = 0; i < resources->size; i++) {
+        Resource *resource = resources->resources[i];
+        records[i].name_offset = (uint32_t)offset;
+        records[i].amount = resource_get_amount(resource);
+        records[i].max_capacity = resource->max_capacity;
+        strcpy(strings + offset, resource->name);
+        offset += strlen(resource->name) + 1;
+    }
+    for (int i = 0; i < systems->size; i++) {
+        system_names[i] = (uint32_t)offset;
+        strcpy(strings + offset, systems->systems[i]->name);
+        offset += strlen(systems->systems[i]->name) + 1;
+    }
+
+    trace->buffers = malloc(sizeof(TraceRecord) * TRACE_BUFFER_RECORDS * (systems->size + 1));
+    if (trace->buffers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for Trace buffers.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < systems->size; i++) {
+        systems->systems[i]->trace = trace;
+        systems->systems[i]->trace_records = trace->buffers + (size_t)i * TRACE_BUFFER_RECORDS;
+        systems->systems[i]->trace_count = 0;
+    }
+}
+
+/**
+ * Stops recording, copies the remaining buffers into the file and closes it.
+ *
+ * Must be called once no system runs anymore. Does nothing if the trace is not recording.
+ *
+ * @param[in,out] trace  Pointer to the `Trace` to stop.
+ */
+void trace_stop(Trace *trace) {
+    if (trace->base == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < trace->systems->size; i++) {
+        System *system = trace->systems->systems[i];
+        if (system->trace_count > 0) {
+            trace_flush(system);
+        }
+        system->trace = NULL;
+        system->trace_records = NULL;
+    }
+
+    size_t used = trace->record_offset + sizeof(TraceRecord) * trace->record_count;
+    munmap(trace->base, trace->size);
+    if (ftruncate(trace->fd, (off_t)used) != 0 || close(trace->fd) != 0) {
+        fprintf(stderr, "Error: Cannot finish the trace file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    free(trace->buffers);
+    pthread_mutex_destroy(&trace->mutex);
+    trace_init(trace);
+}
+
+/**
+ * Records an event reported by a `System`.
+ *
+ * Every occurrence is recorded, also those the event queue's rate limit holds back.
+ * Only the thread running the system may call this.
+ *
+ * @param[in,out] system  The `System` reporting the event.
+ * @param[in]     event   The event.
+ */
+void trace_event(System *system, const Event *event) {
+    if (system->trace == NULL) {
+        return;
+    }
+
+    TraceRecord *record = &system->trace_records[system->trace_count];
+    record->time = sim_clock_now(system->trace->clock);
+    record->system = (uint32_t)system->id;
+    record->resource = (uint16_t)event->resource->id;
+    record->type = TRACE_EVENT;
+    record->status = (int8_t)event->status;
+    record->amount = event->amount;
+    record->priority = (int16_t)event->priority;
+    record->count = 1;
+
+    if (++system->trace_count == TRACE_BUFFER_RECORDS) {
+        trace_flush(system);
+    }
+}
+
+/**
+ * Records a change of a resource amount made by a `System`.
+ *
+ * Only the thread running the system may call this.
+ *
+ * @param[in,out] system    The `System` that consumed or stored.
+ * @param[in]     resource  The `Resource` whose amount changed.
+ * @param[in]     change    Units added, negative when consumed.
+ */
+void trace_amount(System *system, Resource *resource, int change) {
+    if (system->trace == NULL) {
+        return;
+    }
+
+    TraceRecord *record = &system->trace_records[system->trace_count];
+    record->time = sim_clock_now(system->trace->clock);
+    record->system = (uint32_t)system->id;
+    record->resource = (uint16_t)resource->id;
+    record->type = TRACE_AMOUNT;
+    record->status = 0;
+    record->amount = change;
+    record->priority = 0;
+    record->count = 1;
+
+    if (++system->trace_count == TRACE_BUFFER_RECORDS) {
+        trace_flush(system);
+    }
+}
+
+/**
+ * Copies a system's buffered records into the trace file, doubling the file when it is full.
+ *
+ * @param[in,out] system  The `System` whose buffer is copied and emptied.
+ */
+static void trace_flush(System *system) {
+    Trace *trace = system->trace;
+    size_t bytes = sizeof(TraceRecord) * system->trace_count;
+
+    pthread_mutex_lock(&trace->mutex);
+    size_t end = trace->record_offset + sizeof(TraceRecord) * trace->record_count;
+    if (end + bytes > trace->size) {
+        size_t size = trace->size;
+        while (end + bytes > size) {
+            size *= 2;
+        }
+        munmap(trace->base, trace->size);
+        trace_map(trace, size);
+    }
+    memcpy(trace->base + end, system->trace_records, bytes);
+    trace->record_count += system->trace_count;
+    ((TraceHeader *)trace->base)->record_count = trace->record_count; // A crashed run leaves a readable trace
+    pthread_mutex_unlock(&trace->mutex);
+
+    system->trace_count = 0;
+}
+
+/**
+ * Sizes the trace file and maps all of it.
+ *
+ * The blocks are reserved up front, so a full disk is reported here rather than
+ * as a SIGBUS on a later store into the mapping.
+ *
+ * @param[in,out] trace  Pointer to the `Trace`, its previous mapping must be gone.
+ * @param[in]     size   New size of the file in bytes.
+ */
+static void trace_map(Trace *trace, size_t size) {
+    if (posix_fallocate(trace->fd, 0, (off_t)size) != 0) {
+        fprintf(stderr, "Error: Cannot grow the trace file to %zu bytes.\n", size);
+        exit(EXIT_FAILURE);
+    }
+    trace->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+    if (trace->base == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map the trace file.\n");
+        exit(EXIT_FAILURE);
+    }
+    trace->size = size;
+}